@@ -17,6 +17,6 @@ function setup_scene()
     add_walls(5, 12)
 
     for y = 1,3000 do
-        add_cube(math.sin(y), y*0.2+5, math.sin(y+1), 0.1)
+        add_debris(math.sin(y), y*0.2+5, math.sin(y+1), 0.1)
     end
 end
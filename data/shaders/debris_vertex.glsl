@@ -0,0 +1,15 @@
+#version 130
+
+uniform mat4 projection;
+in vec3 position;
+in vec3 normal;
+in vec4 instance; // xyz is position, w is half size
+
+out vec3 v_normal;
+out vec3 v_real_position;
+
+void main() {
+    v_normal = normal;
+    v_real_position = instance.xyz + position * instance.w;
+    gl_Position = projection * vec4(v_real_position, 1.0);
+}
@@ -0,0 +1,22 @@
+#version 130
+
+in vec3 v_normal;
+in vec3 v_real_position;
+
+out vec4 out_color;
+
+uniform vec3 light_pos;
+
+void main() {
+    const float ambiency = 0.3f;
+    const float diffuse_effect = 0.5f;
+    const vec3 fragment_color = vec3(0.4f, 0.8f, 1.0f);
+    const float alpha = 0.35f;
+
+    vec3 normal = normalize(v_normal);
+    vec3 light_dir = normalize(light_pos - v_real_position);
+    float diffuse = clamp(dot(normal, light_dir) * diffuse_effect, 0.0f, 1.0f);
+    float intencity = clamp(diffuse + ambiency, 0.0f, 1.0f);
+
+    out_color = vec4(fragment_color * intencity, alpha);
+}
@@ -0,0 +1,16 @@
+#version 130
+
+uniform mat4 projection;
+in vec3 position;
+in vec3 normal;
+in mat4 instance; // wheel transform, scaled to wheel size
+
+out vec3 v_normal;
+out vec3 v_real_position;
+
+void main() {
+    // the scale keeps cylinder normals pointing the right way
+    v_normal = (instance * vec4(normal, 0.0)).xyz;
+    v_real_position = (instance * vec4(position, 1.0)).xyz;
+    gl_Position = projection * vec4(v_real_position, 1.0);
+}
@@ -2,52 +2,337 @@
 
 #include "common.hpp"
 #include "gfx/gfx.hpp"
+#include "physics/recorder.hpp"
 #include "physics/world.hpp"
+#include "util/thread.hpp"
 #include <glm/gtc/matrix_transform.hpp>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
 
 /**
  * Some kind of integration layer for various game stuff
  *
  * This should only call thread safe functions, since it's supposed to
  * get called by some external threads
+ *
+ * Positions given to Game are world positions in double precision. Physics
+ * and graphics get them relative to origin, which is moved next to the
+ * camera or a focus point when one gets further than rebase_distance from
+ * it, so that everything near them stays precise in float.
  */
 struct Game {
     gfx::Graphics graphics;
     physics::World physics;
     ObjectId last_id;
 
-    Game() : last_id(0) {
+    // origin is written by the script thread and read by the render thread
+    static constexpr double REBASE_GRID = 256.0; // whole cells of every hash grid level
+    std::mutex origin_mutex;
+    glm::dvec3 origin;
+    double rebase_distance; // 0 never moves the origin
+
+    std::mutex events_mutex;
+    std::vector<physics::TriggerEvent> trigger_events;
+    static const size_t TELEMETRY_HISTORY = 600;
+    std::shared_ptr<physics::TelemetryStream> telemetry_stream;
+    std::mutex telemetry_mutex;
+    std::unordered_map<ObjectId, std::deque<physics::VehicleTelemetry>> telemetry;
+
+    // recording opened for show_replay, only used by the script thread
+    unique_ptr<physics::PoseReplay> replay;
+
+    // objects which own the ids following their own, and how many
+    std::unordered_map<ObjectId, int> id_groups;
+
+    static const int OVERLAY_INTERVAL = 30; // frames between overlay updates
+    std::atomic<bool> stats_overlay;
+    int overlay_frames;
+
+    // applied to the thread calling sync_changes, which is the render thread
+    std::mutex render_thread_mutex;
+    util::ThreadConfig render_thread;
+    bool render_thread_changed;
+
+    Game() : last_id(0), origin(0.0), rebase_distance(0), stats_overlay(false), overlay_frames(0),
+        render_thread("render"), render_thread_changed(true) {
+        telemetry_stream = physics.open_telemetry(1024);
         glm::mat4 groundtrans = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-        physics.add_cube(0, groundtrans, 0.0, 20, 1, 20);
+        physics.add_static_cube(0, groundtrans, 20, 1, 20);
         graphics.add_cube(0, groundtrans, 20, 1, 20);
     }
 
-    ObjectId add_cube(float x, float y, float z, float size) {
-        glm::mat4 trans = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    /** World position relative to the current origin */
+    glm::vec3 local(double x, double y, double z) const {
+        return glm::vec3(glm::dvec3(x, y, z) - origin);
+    }
+
+    /** Move the origin next to pos if pos is too far from it, pos is local */
+    void check_origin(glm::vec3& pos) {
+        if (rebase_distance <= 0 || glm::length(pos) <= rebase_distance) return;
+        const glm::vec3 offset(
+                std::round(pos.x / REBASE_GRID) * REBASE_GRID,
+                std::round(pos.y / REBASE_GRID) * REBASE_GRID,
+                std::round(pos.z / REBASE_GRID) * REBASE_GRID);
+        // queue the rebases under the lock too, so that anything placed
+        // relative to the new origin is queued after them
+        std::lock_guard<std::mutex> lock(origin_mutex);
+        origin += glm::dvec3(offset);
+        physics.rebase(offset);
+        graphics.rebase(offset);
+        pos -= offset;
+    }
+
+    void set_camera(double x, double y, double z, double tx, double ty, double tz) {
+        glm::vec3 pos = local(x, y, z);
+        check_origin(pos);
+        graphics.set_camera(pos, local(tx, ty, tz), glm::vec3(0.f, 1.f, 0.f));
+    }
+
+    void set_focus(int slot, double x, double y, double z) {
+        glm::vec3 pos = local(x, y, z);
+        check_origin(pos);
+        physics.set_focus(slot, pos);
+    }
+
+    ObjectId add_cube(double x, double y, double z, float size,
+            physics::Category category = physics::Category::Default) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
         auto id = new_id();
-        physics.add_cube(id, trans, size*size*size, size, size, size);
+        physics.add_cube(id, trans, size*size*size, size, size, size, category);
         graphics.add_cube(id, trans, size, size, size);
         return id;
     }
 
-    ObjectId add_car(float x, float y, float z) {
-        glm::mat4 trans = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    /** Convex body from a point cloud, drawn as its bounding box for now */
+    ObjectId add_convex(double x, double y, double z, float mass, const std::vector<glm::vec3>& points,
+            physics::Category category = physics::Category::Default) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
+        auto id = new_id();
+        physics.add_convex(id, trans, mass, points, category);
+        glm::vec3 extent(0.0f);
+        for (const auto& p : points) {
+            extent = glm::vec3(std::max(extent.x, std::abs(p.x)),
+                    std::max(extent.y, std::abs(p.y)), std::max(extent.z, std::abs(p.z)));
+        }
+        graphics.add_cube(id, trans, extent.x, extent.y, extent.z);
+        return id;
+    }
+
+    ObjectId add_static_cube(double x, double y, double z, float sx, float sy, float sz) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
         auto id = new_id();
-        physics.add_car(id, trans);
+        physics.add_static_cube(id, trans, sx, sy, sz);
+        graphics.add_cube(id, trans, sx, sy, sz);
+        return id;
+    }
+
+    ObjectId add_car(double x, double y, double z,
+            physics::Category category = physics::Category::Vehicle) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
+        auto id = new_id();
+        physics.add_car(id, trans, category);
         graphics.add_cube(id, trans, 1.0f, 0.5f, 2.0f);
         return id;
     }
 
+    /** Truck with trailers, segments appear in graphics through the snapshot */
+    ObjectId add_truck(double x, double y, double z, int trailers,
+            physics::Category category = physics::Category::Vehicle) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
+        trailers = std::max(0, std::min(trailers, physics::TRUCK_MAX_TRAILERS));
+        auto id = new_id();
+        // trailers use the ids following the tractor
+        last_id += trailers;
+        id_groups[id] = trailers;
+        physics.add_truck(id, trans, trailers, category);
+        return id;
+    }
+
+    /** Prefractured box, fragments appear in graphics through the snapshot */
+    ObjectId add_destructible(double x, double y, double z, float sx, float sy, float sz,
+            int pieces, float strength) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
+        pieces = std::max(pieces, 1);
+        auto id = new_id();
+        // fragments use the ids following the first one
+        last_id += pieces - 1;
+        id_groups[id] = pieces - 1;
+        physics.add_destructible(id, trans, sx*sy*sz, sx, sy, sz, pieces, strength);
+        return id;
+    }
+
     void remove_cube(ObjectId id) {
+        auto group = id_groups.find(id);
+        if (group != id_groups.end()) {
+            for (int i = 1; i <= group->second; i++) {
+                graphics.remove(id + i);
+                physics.remove(id + i);
+            }
+            id_groups.erase(group);
+        }
         graphics.remove(id);
         physics.remove(id);
+        std::lock_guard<std::mutex> lock(telemetry_mutex);
+        telemetry.erase(id);
+    }
+
+    /**
+     * Box following keyframes, drawn at the first one until physics moves
+     * it. Key positions are relative to the origin, see local.
+     */
+    ObjectId add_kinematic(float sx, float sy, float sz, bool loop,
+            const std::vector<physics::Keyframe>& keys) {
+        auto id = new_id();
+        if (keys.empty()) return id;
+        physics.add_kinematic(id, keys, loop, sx, sy, sz);
+        graphics.add_cube(id, glm::translate(glm::mat4(1.0f), keys.front().position), sx, sy, sz);
+        return id;
+    }
+
+    ObjectId add_trigger(double x, double y, double z, float sx, float sy, float sz) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), local(x, y, z));
+        auto id = new_id();
+        physics.add_trigger(id, trans, sx, sy, sz);
+        return id;
+    }
+
+    /** Trigger events since the last call */
+    std::vector<physics::TriggerEvent> take_trigger_events() {
+        std::vector<physics::TriggerEvent> events;
+        std::lock_guard<std::mutex> lock(events_mutex);
+        events.swap(trigger_events);
+        return events;
+    }
+
+    void add_debris(double x, double y, double z, float size, glm::vec3 velocity) {
+        physics.add_debris(local(x, y, z), velocity, size);
+    }
+
+    void promote_debris(double x, double y, double z, float radius) {
+        physics.promote_debris(local(x, y, z), radius);
+    }
+
+    /** Up to count latest telemetry samples of a vehicle, oldest first */
+    std::vector<physics::VehicleTelemetry> vehicle_telemetry(ObjectId id, size_t count) {
+        std::lock_guard<std::mutex> lock(telemetry_mutex);
+        std::vector<physics::VehicleTelemetry> samples;
+        auto it = telemetry.find(id);
+        if (it == telemetry.end()) return samples;
+        const auto& history = it->second;
+        count = std::min(count, history.size());
+        samples.assign(history.end() - count, history.end());
+        return samples;
     }
 
     void sync_changes() {
-        auto changes = physics.get_and_reset_changes();
-        for (const auto& x : changes) {
+        {
+            std::lock_guard<std::mutex> lock(render_thread_mutex);
+            if (render_thread_changed) {
+                render_thread_changed = false;
+                util::configure_thread(render_thread);
+            }
+        }
+        auto snapshot = physics.take_snapshot();
+        // physics and graphics run rebases at different times. Poses set
+        // here are for the origin graphics has now, new cubes are added
+        // after the rebases already queued for graphics.
+        glm::dvec3 queued_origin;
+        {
+            std::lock_guard<std::mutex> lock(origin_mutex);
+            queued_origin = origin;
+        }
+        const glm::vec4 to_queued(glm::vec3(snapshot.origin - queued_origin), 0.0f);
+        const glm::vec4 to_graphics(glm::vec3(snapshot.origin - graphics.origin()), 0.0f);
+        const bool rebasing = snapshot.origin != graphics.origin();
+        for (auto& c : snapshot.new_cubes) {
+            c.transform[3] += to_queued;
+            graphics.add_cube(c.id, c.transform, c.size.x, c.size.y, c.size.z);
+        }
+        for (auto& x : snapshot.changes) {
+            if (rebasing) x.second[3] += to_graphics;
             graphics.set_transform(x.first, x.second);
         }
+        if (!snapshot.trigger_events.empty()) {
+            std::lock_guard<std::mutex> lock(events_mutex);
+            trigger_events.insert(trigger_events.end(),
+                    snapshot.trigger_events.begin(), snapshot.trigger_events.end());
+        }
+        if (snapshot.debris_updated) {
+            if (rebasing) {
+                for (auto& d : snapshot.debris) d += to_graphics;
+            }
+            graphics.set_debris(move(snapshot.debris));
+        }
+        for (auto& w : snapshot.wheels) {
+            if (rebasing) {
+                for (auto& m : w.second) m[3] += to_graphics;
+            }
+            graphics.set_wheels(w.first, move(w.second));
+        }
+        if (stats_overlay && ++overlay_frames >= OVERLAY_INTERVAL) {
+            overlay_frames = 0;
+            update_overlay();
+        }
+        physics::VehicleTelemetry sample;
+        std::lock_guard<std::mutex> lock(telemetry_mutex);
+        while (telemetry_stream->pop(sample)) {
+            auto& history = telemetry[sample.vehicle];
+            history.push_back(sample);
+            if (history.size() > TELEMETRY_HISTORY) history.pop_front();
+        }
+    }
+
+    void set_render_thread_config(const util::ThreadConfig& config) {
+        std::lock_guard<std::mutex> lock(render_thread_mutex);
+        render_thread = config;
+        render_thread_changed = true;
+    }
+
+    /** Open a pose recording, throws std::runtime_error if it cannot be read */
+    void open_replay(const string& path) {
+        replay.reset(new physics::PoseReplay(path));
+    }
+
+    /** Draw bodies of the open replay at step as ghosts, false if not recorded */
+    bool show_replay(uint64_t step) {
+        std::vector<physics::ReplayPose> poses;
+        if (!replay || !replay->seek(step, poses, origin)) return false;
+        std::vector<glm::mat4> ghosts;
+        ghosts.reserve(poses.size());
+        for (const auto& p : poses) {
+            ghosts.push_back(glm::scale(glm::translate(p.transform, p.shape.center), p.shape.size));
+        }
+        graphics.set_ghosts(move(ghosts));
+        return true;
+    }
+
+    void close_replay() {
+        replay.reset();
+        graphics.set_ghosts(std::vector<glm::mat4>());
+    }
+
+    /** Show physics counters in the overlay, called from the main thread */
+    void update_overlay() {
+        const physics::WorldStats s = physics.stats();
+        const physics::GovernorMetrics g = physics.governor_metrics();
+        std::stringstream text;
+        text << "step " << s.step << " " << g.average_ms << " ms"
+            << " | bodies " << s.active_bodies << "/" << s.bodies
+            << " sleeping " << s.sleeping_bodies << " frozen " << s.frozen_bodies
+            << " | islands " << s.active_islands << "/" << s.islands
+            << " | pairs " << s.overlapping_pairs << " manifolds " << s.manifolds
+            << " contacts " << s.contact_points
+            << " | pools " << s.manifold_pool_used << "/" << s.manifold_pool_size
+            << " " << s.algorithm_pool_used << "/" << s.algorithm_pool_size
+            << " | late " << s.average_lateness_ms << " max " << s.max_lateness_ms << " ms"
+            << " | memory " << (s.memory.live_bytes[0] + s.memory.live_bytes[1]
+                    + s.memory.live_bytes[2]) / 1024 << " KB";
+        graphics.set_overlay(text.str());
     }
 
     ObjectId new_id() { return ++last_id; }
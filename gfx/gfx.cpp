@@ -10,6 +10,7 @@
 #include <sstream>
 #include <vector>
 #include <cstddef>
+#include <cmath>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -17,7 +18,8 @@
 #include "../util/task_list.hpp"
 
 const static int POSITION = 1,
-      NORMAL = 2;
+      NORMAL = 2,
+      INSTANCE = 3;
 
 struct V3 {
     float x, y, z;
@@ -136,33 +138,105 @@ namespace gfx {
 
 struct GraphicsResources {
     ShaderProgram program;
+    ShaderProgram debris_program;
     VertexArray cube_vao;
+    VertexArray debris_vao;
+    ShaderProgram wheel_program;
+    VertexArray wheel_vao;
+    ShaderProgram ghost_program;
+    VertexArray ghost_vao;
     util::TaskList tasks;
 };
 
-void Graphics::init_cube_vao() {
-    VertexArray& vao = res->cube_vao;
-
+static void init_cube_geometry(VertexArray& vao) {
     vao.set_vertex_buffer(VERTICES, VERTICES+LEN(VERTICES), GL_STATIC_DRAW);
     vao.set_index_buffer(INDICES, INDICES+LEN(INDICES), GL_STATIC_DRAW);
     vao.set_pointer(POSITION, 3, offsetof(Vertex, pos));
     vao.set_pointer(NORMAL, 3, offsetof(Vertex, normal));
 }
 
-void Graphics::init_shaders() {
-    ShaderProgram& prog = res->program;
+/** Cylinder of radius 1 from -1 to 1 along x */
+static void init_wheel_geometry(VertexArray& vao) {
+    const int SEGMENTS = 16;
+    std::vector<Vertex> vertices;
+    std::vector<GLint> indices;
+    for (int i = 0; i <= SEGMENTS; i++) {
+        float a = float(i) / SEGMENTS * 2 * float(M_PI);
+        float y = std::cos(a), z = std::sin(a);
+        vertices.push_back(Vertex { V3 {-1, y, z}, V3 {0, y, z} });
+        vertices.push_back(Vertex { V3 { 1, y, z}, V3 {0, y, z} });
+    }
+    for (int i = 0; i < SEGMENTS; i++) {
+        GLint k = i * 2;
+        indices.insert(indices.end(), { k, k + 2, k + 1, k + 1, k + 2, k + 3 });
+    }
+    for (int side = -1; side <= 1; side += 2) {
+        GLint center = GLint(vertices.size());
+        vertices.push_back(Vertex { V3 {float(side), 0, 0}, V3 {float(side), 0, 0} });
+        for (int i = 0; i < SEGMENTS; i++) {
+            float a = float(i) / SEGMENTS * 2 * float(M_PI);
+            vertices.push_back(Vertex { V3 {float(side), std::cos(a), std::sin(a)}, V3 {float(side), 0, 0} });
+        }
+        for (GLint i = 0; i < SEGMENTS; i++) {
+            GLint a = center + 1 + i, b = center + 1 + (i + 1) % SEGMENTS;
+            indices.insert(indices.end(), { center, side > 0 ? a : b, side > 0 ? b : a });
+        }
+    }
+    vao.set_vertex_buffer(vertices.begin(), vertices.end(), GL_STATIC_DRAW);
+    vao.set_index_buffer(indices.begin(), indices.end(), GL_STATIC_DRAW);
+    vao.set_pointer(POSITION, 3, offsetof(Vertex, pos));
+    vao.set_pointer(NORMAL, 3, offsetof(Vertex, normal));
+}
 
-    auto vs = util::read_file("data/shaders/render_vertex.glsl");
-    auto fs = util::read_file("data/shaders/render_fragment.glsl");
+void Graphics::init_cube_vao() {
+    init_cube_geometry(res->cube_vao);
+
+    // debris cubes are drawn with one instanced call, position and size per instance
+    VertexArray& debris = res->debris_vao;
+    init_cube_geometry(debris);
+    debris.set_instance_buffer(this->debris.begin(), this->debris.end());
+    debris.set_instance_pointer(INSTANCE, 4, 0);
+
+    // wheels of all vehicles are one instanced call too, a mat4 takes four
+    // attribute locations
+    VertexArray& wheels = res->wheel_vao;
+    init_wheel_geometry(wheels);
+    wheels.set_instance_buffer(this->wheel_instances.begin(), this->wheel_instances.end());
+    for (int i = 0; i < 4; i++) {
+        wheels.set_instance_pointer(INSTANCE + i, 4, i * sizeof(glm::vec4));
+    }
+
+    VertexArray& ghosts = res->ghost_vao;
+    init_cube_geometry(ghosts);
+    ghosts.set_instance_buffer(this->ghosts.begin(), this->ghosts.end());
+    for (int i = 0; i < 4; i++) {
+        ghosts.set_instance_pointer(INSTANCE + i, 4, i * sizeof(glm::vec4));
+    }
+}
+
+static void build_program(ShaderProgram& prog, const char* vertex_file,
+        const char* fragment_file = "data/shaders/render_fragment.glsl") {
+    auto vs = util::read_file(vertex_file);
+    auto fs = util::read_file(fragment_file);
 
     prog.add_shader_from_source(GL_VERTEX_SHADER, vs.c_str());
     prog.add_shader_from_source(GL_FRAGMENT_SHADER, fs.c_str());
 
     prog.bind_attribute_location("position", POSITION);
     prog.bind_attribute_location("normal", NORMAL);
+    prog.bind_attribute_location("instance", INSTANCE);
     prog.link();
 }
 
+void Graphics::init_shaders() {
+    build_program(res->program, "data/shaders/render_vertex.glsl");
+    build_program(res->debris_program, "data/shaders/debris_vertex.glsl");
+    build_program(res->wheel_program, "data/shaders/wheel_vertex.glsl");
+    // ghosts are placed by a mat4 per instance like wheels
+    build_program(res->ghost_program, "data/shaders/wheel_vertex.glsl",
+            "data/shaders/ghost_fragment.glsl");
+}
+
 void initialize() {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0) {
         throw_sdl_error("SDL_Init failed");
@@ -180,7 +254,7 @@ void cleanup() {
     SDL_Quit();
 }
 
-Graphics::Graphics() {
+Graphics::Graphics() : wheels_changed(false), world_origin(0.0) {
     this->window = SDL_CreateWindow(
             "test", 0, 0, 512, 512, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
     if (!this->window) {
@@ -203,6 +277,12 @@ Graphics::Graphics() {
     this->uniforms.world = res->program.get_uniform_location("world");
     this->uniforms.world_projection = res->program.get_uniform_location("world_projection");
     this->uniforms.light_pos = res->program.get_uniform_location("light_pos");
+    this->uniforms.debris_projection = res->debris_program.get_uniform_location("projection");
+    this->uniforms.debris_light_pos = res->debris_program.get_uniform_location("light_pos");
+    this->uniforms.wheel_projection = res->wheel_program.get_uniform_location("projection");
+    this->uniforms.wheel_light_pos = res->wheel_program.get_uniform_location("light_pos");
+    this->uniforms.ghost_projection = res->ghost_program.get_uniform_location("projection");
+    this->uniforms.ghost_light_pos = res->ghost_program.get_uniform_location("light_pos");
 
     camera.pos = glm::vec3(0, 5, 35);
     camera.target = glm::vec3(0, 0, 0);
@@ -223,6 +303,9 @@ void Graphics::add_cube(ObjectId id, const glm::mat4& transform,
 void Graphics::remove(ObjectId id) {
     res->tasks.add([=]() {
         this->cubes.erase(id);
+        if (this->wheels.erase(id)) {
+            this->wheels_changed = true;
+        }
     });
 }
 
@@ -243,6 +326,40 @@ void Graphics::render() {
 
         res->cube_vao.draw();
     }
+
+    if (!this->debris.empty()) {
+        res->debris_program.activate();
+        glUniform3f(this->uniforms.debris_light_pos, 20.0f, 20.0f, 20.0f);
+        glUniformMatrix4fv(uniforms.debris_projection, 1, GL_FALSE, glm::value_ptr(projection));
+        res->debris_vao.draw_instanced(this->debris.size());
+    }
+
+    if (this->wheels_changed) {
+        this->wheel_instances.clear();
+        for (const auto& kv : this->wheels) {
+            wheel_instances.insert(wheel_instances.end(), kv.second.begin(), kv.second.end());
+        }
+        res->wheel_vao.set_instance_buffer(wheel_instances.begin(), wheel_instances.end());
+        this->wheels_changed = false;
+    }
+    if (!this->wheel_instances.empty()) {
+        res->wheel_program.activate();
+        glUniform3f(this->uniforms.wheel_light_pos, 20.0f, 20.0f, 20.0f);
+        glUniformMatrix4fv(uniforms.wheel_projection, 1, GL_FALSE, glm::value_ptr(projection));
+        res->wheel_vao.draw_instanced(this->wheel_instances.size());
+    }
+    // translucent, so last and without writing depth
+    if (!this->ghosts.empty()) {
+        res->ghost_program.activate();
+        glUniform3f(this->uniforms.ghost_light_pos, 20.0f, 20.0f, 20.0f);
+        glUniformMatrix4fv(uniforms.ghost_projection, 1, GL_FALSE, glm::value_ptr(projection));
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+        res->ghost_vao.draw_instanced(this->ghosts.size());
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    }
     SDL_GL_SwapWindow(this->window);
     check_gl_error("after render");
 }
@@ -254,6 +371,27 @@ void Graphics::set_transform(ObjectId index, const glm::mat4& transform) {
     }
 }
 
+void Graphics::set_debris(std::vector<glm::vec4> instances) {
+    this->debris.swap(instances);
+    res->debris_vao.set_instance_buffer(this->debris.begin(), this->debris.end());
+}
+
+void Graphics::set_wheels(ObjectId id, std::vector<glm::mat4> transforms) {
+    // a late snapshot must not bring back wheels of a removed vehicle
+    if (this->cubes.count(id)) {
+        this->wheels[id].swap(transforms);
+        this->wheels_changed = true;
+    }
+}
+
+void Graphics::set_ghosts(std::vector<glm::mat4> transforms) {
+    auto shared = std::make_shared<std::vector<glm::mat4>>(move(transforms));
+    res->tasks.add([=]() {
+        this->ghosts.swap(*shared);
+        res->ghost_vao.set_instance_buffer(this->ghosts.begin(), this->ghosts.end());
+    });
+}
+
 void Graphics::set_camera(glm::vec3 pos, glm::vec3 target, glm::vec3 up) {
     res->tasks.add([=]() {
         this->camera.pos = pos;
@@ -262,4 +400,34 @@ void Graphics::set_camera(glm::vec3 pos, glm::vec3 target, glm::vec3 up) {
     });
 }
 
+void Graphics::rebase(glm::vec3 offset) {
+    res->tasks.add([=]() {
+        const glm::vec4 shift(offset, 0.0f);
+        for (auto& kv : this->cubes) {
+            kv.second.transform[3] -= shift;
+        }
+        for (glm::vec4& d : this->debris) {
+            d -= shift;
+        }
+        res->debris_vao.set_instance_buffer(this->debris.begin(), this->debris.end());
+        for (auto& kv : this->wheels) {
+            for (glm::mat4& m : kv.second) m[3] -= shift;
+        }
+        this->wheels_changed = true;
+        for (glm::mat4& m : this->ghosts) {
+            m[3] -= shift;
+        }
+        res->ghost_vao.set_instance_buffer(this->ghosts.begin(), this->ghosts.end());
+        this->camera.pos -= offset;
+        this->camera.target -= offset;
+        this->world_origin += glm::dvec3(offset);
+    });
+}
+
+void Graphics::set_overlay(const std::string& text) {
+    res->tasks.add([=]() {
+        SDL_SetWindowTitle(this->window, text.c_str());
+    });
+}
+
 }; // end namespace gfx
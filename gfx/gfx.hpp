@@ -3,6 +3,8 @@
 #include "../common.hpp"
 
 #include <map>
+#include <string>
+#include <vector>
 
 class SDL_Window;
 
@@ -14,6 +16,9 @@ namespace gfx {
 
     struct Uniforms {
         int world, world_projection, light_pos;
+        int debris_projection, debris_light_pos;
+        int wheel_projection, wheel_light_pos;
+        int ghost_projection, ghost_light_pos;
     };
     struct Camera {
         glm::vec3 pos, target, up;
@@ -22,10 +27,16 @@ namespace gfx {
     class GraphicsResources;
     class Graphics : NoCopy {
         std::map<ObjectId, Cube> cubes;
+        std::vector<glm::vec4> debris; // xyz is position, w is half size
+        std::map<ObjectId, std::vector<glm::mat4>> wheels;
+        std::vector<glm::mat4> wheel_instances; // all wheels, as uploaded
+        bool wheels_changed;
+        std::vector<glm::mat4> ghosts;
         SDL_Window* window;
         void* gl_context;
         Uniforms uniforms;
         Camera camera;
+        glm::dvec3 world_origin;
         unique_ptr<GraphicsResources> res;
 
         void init_shaders();
@@ -39,7 +50,32 @@ namespace gfx {
                 float x, float y, float z);
         void remove(ObjectId id);
         void set_transform(ObjectId id, const glm::mat4& transform);
+        /** Replace all debris particles, xyz is position and w is half size */
+        void set_debris(std::vector<glm::vec4> instances);
+        /**
+         * Replace wheels of a vehicle, transforms are scaled so that a
+         * cylinder of radius 1 from -1 to 1 along x fills the wheel
+         */
+        void set_wheels(ObjectId id, std::vector<glm::mat4> transforms);
+        /**
+         * Replace translucent ghost boxes, for replays. Transforms are
+         * scaled so that a cube from -1 to 1 fills the box.
+         */
+        void set_ghosts(std::vector<glm::mat4> transforms);
         void set_camera(glm::vec3 pos, glm::vec3 target, glm::vec3 up);
+        /**
+         * Move everything drawn and the camera by -offset, see
+         * physics::World::rebase. Calls after this are relative to the new
+         * origin.
+         */
+        void rebase(glm::vec3 offset);
+        /**
+         * Where the origin is after the rebases run so far, only for the
+         * render thread
+         */
+        glm::dvec3 origin() const { return world_origin; }
+        /** Show text over the scene, for now it goes to the window title */
+        void set_overlay(const std::string& text);
         void render();
     };
 
@@ -1,17 +1,21 @@
 #pragma once
 
 class VertexArray : public NoCopy {
-    GLuint vao, vbo, ibo;
+    GLuint vao, vbo, ibo, instance_vbo;
     unsigned int item_count;
     unsigned int item_size;
+    unsigned int instance_size;
+    size_t instance_capacity;
 
 public:
-    VertexArray() {
+    VertexArray() : instance_size(0), instance_capacity(0) {
         glGenVertexArrays(1, &this->vao);
         glGenBuffers(1, &this->vbo);
         glGenBuffers(1, &this->ibo);
+        glGenBuffers(1, &this->instance_vbo);
     }
     ~VertexArray() {
+        glDeleteBuffers(1, &this->instance_vbo);
         glDeleteBuffers(1, &this->ibo);
         glDeleteBuffers(1, &this->vbo);
         glDeleteVertexArrays(1, &this->vao);
@@ -21,7 +25,7 @@ public:
     void set_vertex_buffer(Iterator begin, Iterator end, GLuint usage) {
         this->item_size = sizeof(*begin);
         glBindVertexArray(this->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, this->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
         glBufferData(
                 GL_ARRAY_BUFFER,
                 (end-begin) * sizeof(*begin),
@@ -53,6 +57,42 @@ public:
         glVertexAttribPointer(location, sz, GL_FLOAT, 0, stride, offset_);
     }
 
+    /** Upload per-instance data, buffer storage is reused when it is big enough */
+    template<class Iterator>
+    void set_instance_buffer(Iterator begin, Iterator end) {
+        this->instance_size = sizeof(*begin);
+        size_t bytes = (end-begin) * sizeof(*begin);
+        glBindVertexArray(this->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, this->instance_vbo);
+        if (bytes > this->instance_capacity) {
+            this->instance_capacity = bytes * 2;
+            glBufferData(GL_ARRAY_BUFFER, this->instance_capacity, nullptr, GL_STREAM_DRAW);
+        }
+        if (bytes > 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &(*begin));
+        }
+    }
+
+    /** Attribute from the instance buffer, advanced once per instance */
+    void set_instance_pointer(GLuint location, GLint sz, int offset) {
+        auto stride = this->instance_size;
+        assert(stride);
+        glBindVertexArray(this->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, this->instance_vbo);
+        glEnableVertexAttribArray(location);
+        auto offset_ = (char*)0 + offset;
+        glVertexAttribPointer(location, sz, GL_FLOAT, 0, stride, offset_);
+        glVertexAttribDivisor(location, 1);
+    }
+
+    void draw_instanced(size_t instances) {
+        assert(this->item_count > 0);
+        glBindVertexArray(this->vao);
+        glDrawElementsInstanced(
+                GL_TRIANGLES, GLint(this->item_count),
+                GL_UNSIGNED_INT, nullptr, GLsizei(instances));
+    }
+
     void draw() {
         assert(this->item_count > 0);
         glBindVertexArray(this->vao);
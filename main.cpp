@@ -4,6 +4,7 @@
 #include "physics/world.hpp"
 #include "scripting/lua.hpp"
 #include "scripting/api.hpp"
+#include "util/thread.hpp"
 
 
 #include <SDL2/SDL.h>
@@ -13,28 +14,34 @@
 #include <atomic>
 
 int main() {
-    gfx::initialize();
+    // before any world exists, Bullet cannot free blocks of another allocator
+    physics::install_allocator();
+    {
+        gfx::initialize();
 
-    Game game;
+        Game game;
 
-    volatile bool keep_running = true;
+        volatile bool keep_running = true;
 
-    scripting::Lua lua;
-    scripting::register_game_functions(game, lua);
+        scripting::Lua lua;
+        scripting::register_game_functions(game, lua);
 
-    std::thread t([&keep_running, &lua]() {
-        lua.runfile("data/scripts/main.lua");
-        keep_running = false;
-    });
+        std::thread t([&keep_running, &lua]() {
+            util::configure_thread(util::ThreadConfig("script"));
+            lua.runfile("data/scripts/main.lua");
+            keep_running = false;
+        });
 
-    while (keep_running) {
-        game.sync_changes();
-        game.graphics.render();
-    }
+        while (keep_running) {
+            game.sync_changes();
+            game.graphics.render();
+        }
 
-    t.join();
+        t.join();
 
-    game.physics.stop();
-    cout << "phys stopped" << endl;
-    gfx::cleanup();
+        game.physics.stop();
+        cout << "phys stopped" << endl;
+        gfx::cleanup();
+    }
+    physics::uninstall_allocator();
 }
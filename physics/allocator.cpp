@@ -0,0 +1,146 @@
+#include "allocator.hpp"
+
+#include <LinearMath/btAlignedAllocator.h>
+
+#include <cstdlib>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace physics {
+
+// every block starts with a header, so payloads of pool blocks keep the
+// 16 byte alignment Bullet asks for
+const size_t HEADER = 16;
+const int SIZE_CLASSES = 6; // payloads of 16 to 512 bytes
+const size_t CHUNK_BYTES = 64 * 1024;
+const uint8_t LARGE = 0xff;
+
+struct Header {
+    void* next; // next free block in a pool, heap block of large allocations
+    uint32_t size;
+    uint8_t size_class;
+    uint8_t category;
+};
+static_assert(sizeof(Header) <= HEADER, "allocation header does not fit");
+
+struct Allocator {
+    std::mutex mutex;
+    Header* free_lists[SIZE_CLASSES];
+    std::vector<char*> chunks;
+    AllocatorStats stats;
+    bool installed;
+};
+
+static Allocator& allocator() {
+    static Allocator a;
+    return a;
+}
+
+static thread_local AllocCategory current_category = AllocCategory::World;
+
+static int size_class_of(size_t size) {
+    int c = 0;
+    for (size_t payload = 16; payload < size && c < SIZE_CLASSES; payload *= 2) c++;
+    return c;
+}
+
+/** Carve a new chunk into blocks of a size class, lock must be held */
+static bool refill(Allocator& a, int size_class) {
+    const size_t block = HEADER + (size_t(16) << size_class);
+    char* chunk = static_cast<char*>(std::malloc(CHUNK_BYTES));
+    if (!chunk) return false;
+    a.chunks.push_back(chunk);
+    for (char* p = chunk; p + block <= chunk + CHUNK_BYTES; p += block) {
+        Header* h = reinterpret_cast<Header*>(p);
+        h->next = a.free_lists[size_class];
+        a.free_lists[size_class] = h;
+    }
+    a.stats.pooled_bytes += CHUNK_BYTES;
+    return true;
+}
+
+static void* allocate(size_t size, int alignment) {
+    Allocator& a = allocator();
+    const int size_class = size_t(alignment) <= HEADER ? size_class_of(size) : SIZE_CLASSES;
+    const int category = int(current_category);
+    Header* h;
+    if (size_class < SIZE_CLASSES) {
+        std::lock_guard<std::mutex> lock(a.mutex);
+        if (!a.free_lists[size_class] && !refill(a, size_class)) return nullptr;
+        h = a.free_lists[size_class];
+        a.free_lists[size_class] = static_cast<Header*>(h->next);
+        a.stats.live_bytes[category] += size;
+        a.stats.allocations[category]++;
+    } else {
+        const size_t align = std::max(size_t(alignment), HEADER);
+        char* raw = static_cast<char*>(std::malloc(size + HEADER + align));
+        if (!raw) return nullptr;
+        uintptr_t payload = (reinterpret_cast<uintptr_t>(raw) + HEADER + align - 1) & ~uintptr_t(align - 1);
+        h = reinterpret_cast<Header*>(payload - HEADER);
+        h->next = raw;
+        std::lock_guard<std::mutex> lock(a.mutex);
+        a.stats.live_bytes[category] += size;
+        a.stats.allocations[category]++;
+        a.stats.heap_bytes += size;
+    }
+    h->size = uint32_t(size);
+    h->size_class = size_class < SIZE_CLASSES ? uint8_t(size_class) : LARGE;
+    h->category = uint8_t(category);
+    return reinterpret_cast<char*>(h) + HEADER;
+}
+
+static void deallocate(void* ptr) {
+    if (!ptr) return;
+    Allocator& a = allocator();
+    Header* h = reinterpret_cast<Header*>(static_cast<char*>(ptr) - HEADER);
+    std::lock_guard<std::mutex> lock(a.mutex);
+    a.stats.live_bytes[h->category] -= h->size;
+    if (h->size_class == LARGE) {
+        a.stats.heap_bytes -= h->size;
+        std::free(h->next);
+    } else {
+        h->next = a.free_lists[h->size_class];
+        a.free_lists[h->size_class] = h;
+    }
+}
+
+void install_allocator() {
+    Allocator& a = allocator();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    if (a.installed) return;
+    btAlignedAllocSetCustomAligned(allocate, deallocate);
+    a.installed = true;
+}
+
+bool uninstall_allocator() {
+    Allocator& a = allocator();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    if (!a.installed) return true;
+    for (size_t bytes : a.stats.live_bytes) {
+        if (bytes > 0) return false;
+    }
+    btAlignedAllocSetCustomAligned(nullptr, nullptr);
+    a.installed = false;
+    for (char* chunk : a.chunks) std::free(chunk);
+    a.chunks.clear();
+    for (auto& list : a.free_lists) list = nullptr;
+    a.stats.pooled_bytes = 0;
+    return true;
+}
+
+AllocScope::AllocScope(AllocCategory category) : previous(current_category) {
+    current_category = category;
+}
+
+AllocScope::~AllocScope() {
+    current_category = previous;
+}
+
+AllocatorStats allocator_stats() {
+    Allocator& a = allocator();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    return a.stats;
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../common.hpp"
+
+namespace physics {
+
+    /** What Bullet was doing when it allocated memory */
+    enum class AllocCategory {
+        World, // objects, shapes, islands and everything else
+        Collision, // broadphase and narrowphase
+        Solver // constraint solver
+    };
+    const int ALLOC_CATEGORIES = 3;
+
+    /** Counters of the Bullet allocator, shared by all worlds of the process */
+    struct AllocatorStats {
+        size_t live_bytes[ALLOC_CATEGORIES]; // requested and not freed yet
+        uint64_t allocations[ALLOC_CATEGORIES]; // so far
+        size_t pooled_bytes; // size class pools, used or free
+        size_t heap_bytes; // live allocations too big for the pools
+    };
+
+    /**
+     * Allocations of this thread count to category until the scope ends
+     *
+     * Once install_allocator is called, Bullet's allocations go through a
+     * custom allocator. Small ones come from size class pools, big ones
+     * straight from the heap.
+     */
+    class AllocScope : NoCopy {
+        AllocCategory previous;
+    public:
+        explicit AllocScope(AllocCategory category);
+        ~AllocScope();
+    };
+
+    /**
+     * Route Bullet's allocations through the pooled allocator. Call before
+     * creating any world, blocks Bullet got from its own allocator cannot be
+     * freed by this one. Counters stay at zero until then.
+     */
+    void install_allocator();
+    /**
+     * Give Bullet back its own allocator and free the pools, call after the
+     * last world is destroyed. Returns false and stays installed while
+     * Bullet still holds blocks from the pools.
+     */
+    bool uninstall_allocator();
+
+    AllocatorStats allocator_stats();
+}
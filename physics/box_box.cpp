@@ -0,0 +1,487 @@
+#include "box_box.hpp"
+#include "simd.hpp"
+
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcher.h>
+#include <BulletCollision/CollisionDispatch/btCollisionObjectWrapper.h>
+#include <BulletCollision/CollisionDispatch/btManifoldResult.h>
+#include <BulletCollision/CollisionShapes/btBoxShape.h>
+
+#include <cfloat>
+#include <cstring>
+
+// helpers of btBoxBoxDetector.cpp, not declared in its header
+void dLineClosestApproach(const btVector3& pa, const btVector3& ua,
+        const btVector3& pb, const btVector3& ub, btScalar* alpha, btScalar* beta);
+void cullPoints2(int n, btScalar p[], int m, int i0, int iret[]);
+
+namespace physics {
+
+namespace {
+
+// edge axes must be this much better than face axes to be chosen
+const btScalar EDGE_FUDGE = 1.05f;
+// added to the absolute rotation for the edge axes, for nearly parallel edges
+const btScalar ROTATION_FUDGE = 1.0e-5f;
+const int MAX_CONTACTS = 4;
+
+/**
+ * Separating axis test of boxes a and b: 3 face normals of a, 3 of b and 9
+ * edge cross products, in this order
+ */
+struct Axes {
+    btScalar center[16]; // distance of the centers along the axis
+    btScalar depth[16]; // separation along the axis, > 0 when separated
+    btScalar length[12]; // of the edge axes
+    btScalar scaled[12]; // depth along edge axes divided by length
+    btScalar rotation[3][4]; // rotation of b relative to a, rows
+};
+
+#ifdef PHYSICS_USE_SSE
+template <int I>
+inline __m128 lane(__m128 v) {
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I));
+}
+
+/** Separation along axes, |center distance| - projected extents */
+inline __m128 depth_of(__m128 center, __m128 extent) {
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    return _mm_sub_ps(_mm_and_ps(center, abs_mask), extent);
+}
+#endif
+
+/**
+ * Fill axes, false if some axis separates the boxes. Every value is summed
+ * in the same order as in dBoxBox2 of btBoxBoxDetector.cpp, with four
+ * lanes at a time.
+ */
+bool find_axes(const btTransform& ta, const btVector3& ha, const btTransform& tb, const btVector3& hb,
+        Axes& axes) {
+    const btMatrix3x3& a = ta.getBasis();
+    const btMatrix3x3& b = tb.getBasis();
+#ifdef PHYSICS_USE_SSE
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 a0 = _mm_loadu_ps(a[0].m_floats);
+    const __m128 a1 = _mm_loadu_ps(a[1].m_floats);
+    const __m128 a2 = _mm_loadu_ps(a[2].m_floats);
+    const __m128 b0 = _mm_loadu_ps(b[0].m_floats);
+    const __m128 b1 = _mm_loadu_ps(b[1].m_floats);
+    const __m128 b2 = _mm_loadu_ps(b[2].m_floats);
+    const __m128 A = _mm_loadu_ps(ha.m_floats);
+    const __m128 B = _mm_loadu_ps(hb.m_floats);
+    const __m128 p = _mm_sub_ps(_mm_loadu_ps(tb.getOrigin().m_floats),
+            _mm_loadu_ps(ta.getOrigin().m_floats));
+
+    // pp = p in coordinates of a, R = rotation of b in a
+    const __m128 pp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lane<0>(p), a0),
+                _mm_mul_ps(lane<1>(p), a1)), _mm_mul_ps(lane<2>(p), a2));
+    __m128 r[3];
+    r[0] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lane<0>(a0), b0), _mm_mul_ps(lane<0>(a1), b1)),
+            _mm_mul_ps(lane<0>(a2), b2));
+    r[1] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lane<1>(a0), b0), _mm_mul_ps(lane<1>(a1), b1)),
+            _mm_mul_ps(lane<1>(a2), b2));
+    r[2] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lane<2>(a0), b0), _mm_mul_ps(lane<2>(a1), b1)),
+            _mm_mul_ps(lane<2>(a2), b2));
+    __m128 q[3] = { _mm_and_ps(r[0], abs_mask), _mm_and_ps(r[1], abs_mask), _mm_and_ps(r[2], abs_mask) };
+    __m128 qc[4] = { q[0], q[1], q[2], _mm_setzero_ps() };
+    _MM_TRANSPOSE4_PS(qc[0], qc[1], qc[2], qc[3]);
+
+    // faces of a, then faces of b
+    const __m128 center_a = pp;
+    const __m128 extent_a = _mm_add_ps(_mm_add_ps(_mm_add_ps(A, _mm_mul_ps(lane<0>(B), qc[0])),
+                _mm_mul_ps(lane<1>(B), qc[1])), _mm_mul_ps(lane<2>(B), qc[2]));
+    const __m128 center_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lane<0>(p), b0),
+                _mm_mul_ps(lane<1>(p), b1)), _mm_mul_ps(lane<2>(p), b2));
+    const __m128 extent_b = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lane<0>(A), q[0]),
+                    _mm_mul_ps(lane<1>(A), q[1])), _mm_mul_ps(lane<2>(A), q[2])), B);
+    const __m128 depth_a = depth_of(center_a, extent_a);
+    const __m128 depth_b = depth_of(center_b, extent_b);
+    const __m128 zero = _mm_setzero_ps();
+    if ((_mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(depth_a, zero), _mm_cmpgt_ps(depth_b, zero))) & 7) != 0) {
+        return false;
+    }
+
+    // edges of a crossed with the edges of b, the edges of b in the lanes
+    const __m128 fudge = _mm_set1_ps(ROTATION_FUDGE);
+    const __m128 qf[3] = { _mm_add_ps(q[0], fudge), _mm_add_ps(q[1], fudge), _mm_add_ps(q[2], fudge) };
+    const __m128 B_first = _mm_shuffle_ps(B, B, _MM_SHUFFLE(3, 0, 0, 1));
+    const __m128 B_second = _mm_shuffle_ps(B, B, _MM_SHUFFLE(3, 1, 2, 2));
+    auto extent = [&](__m128 first, __m128 second, __m128 qrow) {
+        return _mm_add_ps(_mm_add_ps(_mm_add_ps(first, second),
+                    _mm_mul_ps(B_first, _mm_shuffle_ps(qrow, qrow, _MM_SHUFFLE(3, 1, 2, 2)))),
+                _mm_mul_ps(B_second, _mm_shuffle_ps(qrow, qrow, _MM_SHUFFLE(3, 0, 0, 1))));
+    };
+    const __m128 center_1 = _mm_sub_ps(_mm_mul_ps(lane<2>(pp), r[1]), _mm_mul_ps(lane<1>(pp), r[2]));
+    const __m128 center_2 = _mm_sub_ps(_mm_mul_ps(lane<0>(pp), r[2]), _mm_mul_ps(lane<2>(pp), r[0]));
+    const __m128 center_3 = _mm_sub_ps(_mm_mul_ps(lane<1>(pp), r[0]), _mm_mul_ps(lane<0>(pp), r[1]));
+    const __m128 depth_1 = depth_of(center_1,
+            extent(_mm_mul_ps(lane<1>(A), qf[2]), _mm_mul_ps(lane<2>(A), qf[1]), qf[0]));
+    const __m128 depth_2 = depth_of(center_2,
+            extent(_mm_mul_ps(lane<0>(A), qf[2]), _mm_mul_ps(lane<2>(A), qf[0]), qf[1]));
+    const __m128 depth_3 = depth_of(center_3,
+            extent(_mm_mul_ps(lane<0>(A), qf[1]), _mm_mul_ps(lane<1>(A), qf[0]), qf[2]));
+    const __m128 epsilon = _mm_set1_ps(SIMD_EPSILON);
+    if ((_mm_movemask_ps(_mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(depth_1, epsilon), _mm_cmpgt_ps(depth_2, epsilon)),
+                        _mm_cmpgt_ps(depth_3, epsilon))) & 7) != 0) {
+        return false;
+    }
+
+    // stores overlap by a lane, the next one overwrites the unused fourth
+    _mm_storeu_ps(axes.center, center_a);
+    _mm_storeu_ps(axes.center + 3, center_b);
+    _mm_storeu_ps(axes.center + 6, center_1);
+    _mm_storeu_ps(axes.center + 9, center_2);
+    _mm_storeu_ps(axes.center + 12, center_3);
+    _mm_storeu_ps(axes.depth, depth_a);
+    _mm_storeu_ps(axes.depth + 3, depth_b);
+    _mm_storeu_ps(axes.depth + 6, depth_1);
+    _mm_storeu_ps(axes.depth + 9, depth_2);
+    _mm_storeu_ps(axes.depth + 12, depth_3);
+    const __m128 length_1 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r[2], r[2]), _mm_mul_ps(r[1], r[1])));
+    const __m128 length_2 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r[2], r[2]), _mm_mul_ps(r[0], r[0])));
+    const __m128 length_3 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r[1], r[1]), _mm_mul_ps(r[0], r[0])));
+    _mm_storeu_ps(axes.length, length_1);
+    _mm_storeu_ps(axes.length + 3, length_2);
+    _mm_storeu_ps(axes.length + 6, length_3);
+    _mm_storeu_ps(axes.scaled, _mm_div_ps(depth_1, length_1));
+    _mm_storeu_ps(axes.scaled + 3, _mm_div_ps(depth_2, length_2));
+    _mm_storeu_ps(axes.scaled + 6, _mm_div_ps(depth_3, length_3));
+    for (int i = 0; i < 3; i++) _mm_storeu_ps(axes.rotation[i], r[i]);
+    return true;
+#else
+    const btVector3 p = tb.getOrigin() - ta.getOrigin();
+    btScalar pp[3], R[3][3], Q[3][3];
+    for (int k = 0; k < 3; k++) pp[k] = a[0][k] * p[0] + a[1][k] * p[1] + a[2][k] * p[2];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            R[i][j] = a[0][i] * b[0][j] + a[1][i] * b[1][j] + a[2][i] * b[2][j];
+            Q[i][j] = btFabs(R[i][j]);
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        axes.center[i] = pp[i];
+        axes.depth[i] = btFabs(pp[i]) - (ha[i] + hb[0] * Q[i][0] + hb[1] * Q[i][1] + hb[2] * Q[i][2]);
+        if (axes.depth[i] > 0) return false;
+    }
+    for (int j = 0; j < 3; j++) {
+        axes.center[3 + j] = b[0][j] * p[0] + b[1][j] * p[1] + b[2][j] * p[2];
+        axes.depth[3 + j] = btFabs(axes.center[3 + j])
+            - (ha[0] * Q[0][j] + ha[1] * Q[1][j] + ha[2] * Q[2][j] + hb[j]);
+        if (axes.depth[3 + j] > 0) return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) Q[i][j] += ROTATION_FUDGE;
+    }
+    // axis i x j projects the center on pp[c0] * R[c1][j] - pp[c1] * R[c0][j],
+    // the other two edges of b are j1 and j2
+    static const int cross[3][2] = { { 2, 1 }, { 0, 2 }, { 1, 0 } };
+    static const int other[3][2] = { { 1, 2 }, { 0, 2 }, { 0, 1 } };
+    for (int i = 0; i < 3; i++) {
+        const int c0 = cross[i][0], c1 = cross[i][1];
+        for (int j = 0; j < 3; j++) {
+            const int j1 = other[j][0], j2 = other[j][1];
+            const int k = 6 + i * 3 + j;
+            axes.center[k] = pp[c0] * R[c1][j] - pp[c1] * R[c0][j];
+            axes.depth[k] = btFabs(axes.center[k])
+                - (ha[c1] * Q[c0][j] + ha[c0] * Q[c1][j] + hb[j1] * Q[i][j2] + hb[j2] * Q[i][j1]);
+            if (axes.depth[k] > SIMD_EPSILON) return false;
+            axes.length[i * 3 + j] = btSqrt(R[c0][j] * R[c0][j] + R[c1][j] * R[c1][j]);
+            axes.scaled[i * 3 + j] = axes.depth[k] / axes.length[i * 3 + j];
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) axes.rotation[i][j] = R[i][j];
+    }
+    return true;
+#endif
+}
+
+}
+
+int collide_boxes(const btTransform& ta, const btVector3& ha, const btTransform& tb, const btVector3& hb,
+        btDiscreteCollisionDetectorInterface::Result& out) {
+    Axes axes;
+    if (!find_axes(ta, ha, tb, hb, axes)) return 0;
+
+    // deepest axis, preferring faces over edges
+    btScalar s = -FLT_MAX;
+    int code = 0;
+    bool invert_normal = false;
+    btVector3 normal_c(0, 0, 0);
+    for (int i = 0; i < 6; i++) {
+        if (axes.depth[i] > s) {
+            s = axes.depth[i];
+            invert_normal = axes.center[i] < 0;
+            code = i + 1;
+        }
+    }
+    const btScalar (*r)[4] = axes.rotation;
+    for (int k = 0; k < 9; k++) {
+        const btScalar l = axes.length[k];
+        if (l <= SIMD_EPSILON) continue;
+        const btScalar s2 = axes.scaled[k];
+        if (s2 * EDGE_FUDGE > s) {
+            const int i = k / 3, j = k % 3;
+            s = s2;
+            if (i == 0) normal_c.setValue(0, -r[2][j] / l, r[1][j] / l);
+            else if (i == 1) normal_c.setValue(r[2][j] / l, 0, -r[0][j] / l);
+            else normal_c.setValue(-r[1][j] / l, r[0][j] / l, 0);
+            invert_normal = axes.center[6 + k] < 0;
+            code = 7 + k;
+        }
+    }
+    if (!code) return 0;
+
+    // from here on as in dBoxBox2, R[row * 4 + column] are the bases,
+    // which is how btMatrix3x3 stores its rows
+    static_assert(sizeof(btVector3) == 4 * sizeof(btScalar), "basis rows are not padded to 4");
+    const btScalar* R1 = reinterpret_cast<const btScalar*>(&ta.getBasis());
+    const btScalar* R2 = reinterpret_cast<const btScalar*>(&tb.getBasis());
+    const btVector3& p1 = ta.getOrigin();
+    const btVector3& p2 = tb.getOrigin();
+    const btScalar A[3] = { ha[0], ha[1], ha[2] };
+    const btScalar B[3] = { hb[0], hb[1], hb[2] };
+
+    btVector3 normal;
+    if (code <= 3) {
+        normal.setValue(R1[code - 1], R1[4 + code - 1], R1[8 + code - 1]);
+    } else if (code <= 6) {
+        normal.setValue(R2[code - 4], R2[4 + code - 4], R2[8 + code - 4]);
+    } else {
+        for (int i = 0; i < 3; i++) {
+            normal[i] = R1[4 * i] * normal_c[0] + R1[4 * i + 1] * normal_c[1] + R1[4 * i + 2] * normal_c[2];
+        }
+    }
+    if (invert_normal) normal = -normal;
+    const btScalar depth = -s;
+    auto dot14 = [](const btScalar* a, const btScalar* b) { return a[0] * b[0] + a[1] * b[4] + a[2] * b[8]; };
+    auto dot44 = [](const btScalar* a, const btScalar* b) { return a[0] * b[0] + a[4] * b[4] + a[8] * b[8]; };
+
+    if (code > 6) {
+        // an edge of a touches an edge of b, one contact on the edge of b
+        btVector3 pa = p1;
+        for (int j = 0; j < 3; j++) {
+            const btScalar sign = dot14(normal.m_floats, R1 + j) > 0 ? 1 : -1;
+            for (int i = 0; i < 3; i++) pa[i] += sign * A[j] * R1[i * 4 + j];
+        }
+        btVector3 pb = p2;
+        for (int j = 0; j < 3; j++) {
+            const btScalar sign = dot14(normal.m_floats, R2 + j) > 0 ? -1 : 1;
+            for (int i = 0; i < 3; i++) pb[i] += sign * B[j] * R2[i * 4 + j];
+        }
+        btVector3 ua, ub;
+        for (int i = 0; i < 3; i++) ua[i] = R1[(code - 7) / 3 + i * 4];
+        for (int i = 0; i < 3; i++) ub[i] = R2[(code - 7) % 3 + i * 4];
+        btScalar alpha, beta;
+        dLineClosestApproach(pa, ua, pb, ub, &alpha, &beta);
+        for (int i = 0; i < 3; i++) pb[i] += ub[i] * beta;
+        out.addContactPoint(-normal, pb, -depth);
+        return 1;
+    }
+
+    // a face of one box is the reference face, the most antiparallel face
+    // of the other box is clipped against it
+    const btScalar *Ra, *Rb, *pa, *pb, *Sa, *Sb;
+    if (code <= 3) {
+        Ra = R1; Rb = R2; pa = p1.m_floats; pb = p2.m_floats; Sa = A; Sb = B;
+    } else {
+        Ra = R2; Rb = R1; pa = p2.m_floats; pb = p1.m_floats; Sa = B; Sb = A;
+    }
+    const btVector3 normal2 = code <= 3 ? normal : -normal;
+    btVector3 nr, anr;
+    for (int i = 0; i < 3; i++) nr[i] = dot14(normal2.m_floats, Rb + i);
+    for (int i = 0; i < 3; i++) anr[i] = btFabs(nr[i]);
+
+    // incident face normal is the largest of anr, a1 and a2 span the face
+    int lanr, a1, a2;
+    if (anr[1] > anr[0]) {
+        if (anr[1] > anr[2]) { a1 = 0; lanr = 1; a2 = 2; }
+        else { a1 = 0; a2 = 1; lanr = 2; }
+    } else {
+        if (anr[0] > anr[2]) { lanr = 0; a1 = 1; a2 = 2; }
+        else { a1 = 0; a2 = 1; lanr = 2; }
+    }
+
+    // center of the incident face relative to the reference box
+    btVector3 center;
+    if (nr[lanr] < 0) {
+        for (int i = 0; i < 3; i++) center[i] = pb[i] - pa[i] + Sb[lanr] * Rb[i * 4 + lanr];
+    } else {
+        for (int i = 0; i < 3; i++) center[i] = pb[i] - pa[i] - Sb[lanr] * Rb[i * 4 + lanr];
+    }
+
+    // normal axis and face axes of the reference box
+    const int codeN = code <= 3 ? code - 1 : code - 4;
+    const int code1 = codeN == 0 ? 1 : 0;
+    const int code2 = codeN == 2 ? 1 : 2;
+
+    // incident face corners in reference face coordinates
+    btScalar quad[8];
+    const btScalar c1 = dot14(center.m_floats, Ra + code1);
+    const btScalar c2 = dot14(center.m_floats, Ra + code2);
+    btScalar m11 = dot44(Ra + code1, Rb + a1);
+    btScalar m12 = dot44(Ra + code1, Rb + a2);
+    btScalar m21 = dot44(Ra + code2, Rb + a1);
+    btScalar m22 = dot44(Ra + code2, Rb + a2);
+    {
+        const btScalar k1 = m11 * Sb[a1];
+        const btScalar k2 = m21 * Sb[a1];
+        const btScalar k3 = m12 * Sb[a2];
+        const btScalar k4 = m22 * Sb[a2];
+        quad[0] = c1 - k1 - k3;
+        quad[1] = c2 - k2 - k4;
+        quad[2] = c1 - k1 + k3;
+        quad[3] = c2 - k2 + k4;
+        quad[4] = c1 + k1 + k3;
+        quad[5] = c2 + k2 + k4;
+        quad[6] = c1 + k1 - k3;
+        quad[7] = c2 + k2 - k4;
+    }
+
+    // clip the quad with the reference face rectangle, one side at a time
+    const btScalar rect[2] = { Sa[code1], Sa[code2] };
+    btScalar ret[16], buffer[16];
+    int n;
+    {
+        btScalar* q = quad;
+        btScalar* r = ret;
+        int nq = 4, nr = 0;
+        for (int dir = 0; dir <= 1 && nr < 8; dir++) {
+            for (int sign = -1; sign <= 1 && nr < 8; sign += 2) {
+                btScalar* pq = q;
+                btScalar* pr = r;
+                nr = 0;
+                for (int i = nq; i > 0; i--) {
+                    if (sign * pq[dir] < rect[dir]) {
+                        pr[0] = pq[0];
+                        pr[1] = pq[1];
+                        pr += 2;
+                        if (++nr & 8) break;
+                    }
+                    btScalar* nextq = i > 1 ? pq + 2 : q;
+                    if ((sign * pq[dir] < rect[dir]) ^ (sign * nextq[dir] < rect[dir])) {
+                        pr[1 - dir] = pq[1 - dir] + (nextq[1 - dir] - pq[1 - dir])
+                            / (nextq[dir] - pq[dir]) * (sign * rect[dir] - pq[dir]);
+                        pr[dir] = sign * rect[dir];
+                        pr += 2;
+                        if (++nr & 8) break;
+                    }
+                    pq += 2;
+                }
+                q = r;
+                r = q == ret ? buffer : ret;
+                nq = nr;
+            }
+        }
+        if (q != ret) memcpy(ret, q, nr * 2 * sizeof(btScalar));
+        n = nr;
+    }
+    if (n < 1) return 0;
+
+    // back to 3d, keeping the points which penetrate
+    btScalar px[8], py[8], pz[8], dep[8];
+    const btScalar det1 = 1.f / (m11 * m22 - m12 * m21);
+    m11 *= det1;
+    m12 *= det1;
+    m21 *= det1;
+    m22 *= det1;
+#ifdef PHYSICS_USE_SSE
+    // four points at a time, lanes past n are garbage and not used
+    for (int j = 0; j < n; j += 4) {
+        const __m128 v0 = _mm_loadu_ps(ret + j * 2);
+        const __m128 v1 = _mm_loadu_ps(ret + j * 2 + 4);
+        const __m128 dx = _mm_sub_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_set1_ps(c1));
+        const __m128 dy = _mm_sub_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)), _mm_set1_ps(c2));
+        const __m128 k1 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(m22), dx), _mm_mul_ps(_mm_set1_ps(m12), dy));
+        const __m128 k2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-m21), dx), _mm_mul_ps(_mm_set1_ps(m11), dy));
+        __m128 p[3];
+        for (int i = 0; i < 3; i++) {
+            p[i] = _mm_add_ps(_mm_add_ps(_mm_set1_ps(center[i]), _mm_mul_ps(k1, _mm_set1_ps(Rb[i * 4 + a1]))),
+                    _mm_mul_ps(k2, _mm_set1_ps(Rb[i * 4 + a2])));
+        }
+        const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normal2[0]), p[0]),
+                    _mm_mul_ps(_mm_set1_ps(normal2[1]), p[1])), _mm_mul_ps(_mm_set1_ps(normal2[2]), p[2]));
+        _mm_storeu_ps(px + j, p[0]);
+        _mm_storeu_ps(py + j, p[1]);
+        _mm_storeu_ps(pz + j, p[2]);
+        _mm_storeu_ps(dep + j, _mm_sub_ps(_mm_set1_ps(Sa[codeN]), d));
+    }
+#else
+    for (int j = 0; j < n; j++) {
+        const btScalar k1 = m22 * (ret[j * 2] - c1) - m12 * (ret[j * 2 + 1] - c2);
+        const btScalar k2 = -m21 * (ret[j * 2] - c1) + m11 * (ret[j * 2 + 1] - c2);
+        px[j] = center[0] + k1 * Rb[a1] + k2 * Rb[a2];
+        py[j] = center[1] + k1 * Rb[4 + a1] + k2 * Rb[4 + a2];
+        pz[j] = center[2] + k1 * Rb[8 + a1] + k2 * Rb[8 + a2];
+        dep[j] = Sa[codeN] - (normal2[0] * px[j] + normal2[1] * py[j] + normal2[2] * pz[j]);
+    }
+#endif
+    int cnum = 0;
+    for (int j = 0; j < n; j++) {
+        if (dep[j] < 0) continue;
+        px[cnum] = px[j];
+        py[cnum] = py[j];
+        pz[cnum] = pz[j];
+        dep[cnum] = dep[j];
+        ret[cnum * 2] = ret[j * 2];
+        ret[cnum * 2 + 1] = ret[j * 2 + 1];
+        cnum++;
+    }
+    if (cnum < 1) return 0;
+
+    // contacts on the faces of b are moved onto the surface of a
+    auto add = [&](int j) {
+        const btVector3 p(px[j] + pa[0], py[j] + pa[1], pz[j] + pa[2]);
+        if (code < 4) out.addContactPoint(-normal, p, -dep[j]);
+        else out.addContactPoint(-normal, p - normal * dep[j], -dep[j]);
+    };
+    if (cnum <= MAX_CONTACTS) {
+        for (int j = 0; j < cnum; j++) add(j);
+        return cnum;
+    }
+    // too many, keep the deepest and the ones best spread around it
+    int i1 = 0;
+    for (int i = 1; i < cnum; i++) {
+        if (dep[i] > dep[i1]) i1 = i;
+    }
+    int iret[8];
+    cullPoints2(cnum, ret, MAX_CONTACTS, i1, iret);
+    for (int j = 0; j < MAX_CONTACTS; j++) add(iret[j]);
+    return MAX_CONTACTS;
+}
+
+BoxBoxAlgorithm::BoxBoxAlgorithm(btPersistentManifold* manifold, const btCollisionAlgorithmConstructionInfo& ci,
+        const btCollisionObjectWrapper* body0, const btCollisionObjectWrapper* body1)
+    : btActivatingCollisionAlgorithm(ci, body0, body1), own_manifold(false), manifold(manifold) {
+    if (!manifold && m_dispatcher->needsCollision(body0->getCollisionObject(), body1->getCollisionObject())) {
+        this->manifold = m_dispatcher->getNewManifold(body0->getCollisionObject(), body1->getCollisionObject());
+        own_manifold = true;
+    }
+}
+
+BoxBoxAlgorithm::~BoxBoxAlgorithm() {
+    if (own_manifold && manifold) m_dispatcher->releaseManifold(manifold);
+}
+
+void BoxBoxAlgorithm::processCollision(const btCollisionObjectWrapper* body0,
+        const btCollisionObjectWrapper* body1, const btDispatcherInfo&, btManifoldResult* result) {
+    if (!manifold) return;
+    const btBoxShape* box0 = static_cast<const btBoxShape*>(body0->getCollisionShape());
+    const btBoxShape* box1 = static_cast<const btBoxShape*>(body1->getCollisionShape());
+    result->setPersistentManifold(manifold);
+    collide_boxes(body0->getWorldTransform(), box0->getHalfExtentsWithMargin(),
+            body1->getWorldTransform(), box1->getHalfExtentsWithMargin(), *result);
+    // contacts are persistent, drop the ones which drifted apart
+    if (own_manifold) result->refreshContactPoints();
+}
+
+void BoxBoxAlgorithm::getAllContactManifolds(btManifoldArray& manifolds) {
+    if (manifold && own_manifold) manifolds.push_back(manifold);
+}
+
+btCollisionAlgorithm* BoxBoxAlgorithm::CreateFunc::CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo& ci,
+        const btCollisionObjectWrapper* body0, const btCollisionObjectWrapper* body1) {
+    void* mem = ci.m_dispatcher1->allocateCollisionAlgorithm(sizeof(BoxBoxAlgorithm));
+    return new (mem) BoxBoxAlgorithm(nullptr, ci, body0, body1);
+}
+
+}
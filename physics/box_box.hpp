@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../common.hpp"
+
+#include <BulletCollision/CollisionDispatch/btActivatingCollisionAlgorithm.h>
+#include <BulletCollision/CollisionDispatch/btCollisionCreateFunc.h>
+#include <BulletCollision/NarrowPhaseCollision/btDiscreteCollisionDetectorInterface.h>
+
+class btPersistentManifold;
+
+namespace physics {
+
+    /**
+     * Contacts between boxes of half extents half_a and half_b, margins
+     * included, added to out
+     *
+     * Same contacts as btBoxBoxDetector, which is the ODE box-box test: the
+     * separating axis test picks the axis of least penetration and the
+     * contacts are clipped from the faces or edges along it. Here the
+     * depths along all 15 axes are computed at once with SSE, summed in the
+     * same order as the scalar code so the chosen axis and the contacts
+     * come out the same. Returns the number of contacts.
+     */
+    int collide_boxes(const btTransform& a, const btVector3& half_a,
+            const btTransform& b, const btVector3& half_b,
+            btDiscreteCollisionDetectorInterface::Result& out);
+
+    /** btBoxBoxCollisionAlgorithm on collide_boxes */
+    class BoxBoxAlgorithm : public btActivatingCollisionAlgorithm {
+        bool own_manifold;
+        btPersistentManifold* manifold;
+
+    public:
+        BoxBoxAlgorithm(btPersistentManifold* manifold, const btCollisionAlgorithmConstructionInfo& ci,
+                const btCollisionObjectWrapper* body0, const btCollisionObjectWrapper* body1);
+        virtual ~BoxBoxAlgorithm();
+
+        virtual void processCollision(const btCollisionObjectWrapper* body0,
+                const btCollisionObjectWrapper* body1, const btDispatcherInfo& info,
+                btManifoldResult* result);
+        virtual btScalar calculateTimeOfImpact(btCollisionObject*, btCollisionObject*,
+                const btDispatcherInfo&, btManifoldResult*) { return 1; }
+        virtual void getAllContactManifolds(btManifoldArray& manifolds);
+
+        /** Register with registerCollisionCreateFunc for box pairs */
+        struct CreateFunc : public btCollisionAlgorithmCreateFunc {
+            virtual btCollisionAlgorithm* CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo& ci,
+                    const btCollisionObjectWrapper* body0, const btCollisionObjectWrapper* body1);
+        };
+    };
+}
@@ -0,0 +1,197 @@
+#include "debris.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace physics {
+
+const float RESTITUTION = 0.3f;
+const float FRICTION = 0.9f; // velocity kept per step on ground
+const float REST_SPEED = 0.5f; // slower bounces are stopped
+const float KILL_DEPTH = 100.0f;
+const int MAX_GRID_CELLS = 1 << 20;
+
+Debris::Debris()
+    : count(0), grid_x(0), grid_z(0), cell_size(1.0f), grid_w(0), grid_h(0),
+    kill_height(-KILL_DEPTH) {}
+
+void Debris::add(glm::vec3 pos, glm::vec3 vel, float half_size) {
+    if (count == px.size()) {
+        size_t cap = std::max<size_t>(64, px.size() * 2);
+        for (auto v : { &px, &py, &pz, &vx, &vy, &vz, &half }) {
+            v->resize(cap, 0.0f);
+        }
+        heights.resize(cap, 0.0f);
+    }
+    px[count] = pos.x; py[count] = pos.y; pz[count] = pos.z;
+    vx[count] = vel.x; vy[count] = vel.y; vz[count] = vel.z;
+    half[count] = half_size;
+    count++;
+}
+
+void Debris::remove_at(size_t i) {
+    size_t last = count - 1;
+    for (auto v : { &px, &py, &pz, &vx, &vy, &vz, &half }) {
+        (*v)[i] = (*v)[last];
+        (*v)[last] = 0.0f;
+    }
+    count--;
+}
+
+void Debris::set_ground(const std::vector<GroundBox>& boxes) {
+    grid.clear();
+    grid_w = grid_h = 0;
+    kill_height = -KILL_DEPTH;
+    if (boxes.empty()) return;
+
+    glm::vec3 lo = boxes[0].min, hi = boxes[0].max;
+    for (const auto& b : boxes) {
+        lo.x = std::min(lo.x, b.min.x); lo.y = std::min(lo.y, b.min.y); lo.z = std::min(lo.z, b.min.z);
+        hi.x = std::max(hi.x, b.max.x); hi.z = std::max(hi.z, b.max.z);
+    }
+    kill_height = lo.y - KILL_DEPTH;
+
+    // one meter cells unless the world is huge
+    cell_size = 1.0f;
+    while ((hi.x - lo.x) * (hi.z - lo.z) / (cell_size * cell_size) > MAX_GRID_CELLS) {
+        cell_size *= 2.0f;
+    }
+    grid_x = lo.x;
+    grid_z = lo.z;
+    grid_w = int(std::ceil((hi.x - lo.x) / cell_size)) + 1;
+    grid_h = int(std::ceil((hi.z - lo.z) / cell_size)) + 1;
+    grid.assign(size_t(grid_w) * grid_h, -std::numeric_limits<float>::infinity());
+
+    for (const auto& b : boxes) {
+        int x0 = int((b.min.x - grid_x) / cell_size), x1 = int((b.max.x - grid_x) / cell_size);
+        int z0 = int((b.min.z - grid_z) / cell_size), z1 = int((b.max.z - grid_z) / cell_size);
+        for (int z = z0; z <= z1; z++) {
+            for (int x = x0; x <= x1; x++) {
+                float& h = grid[size_t(z) * grid_w + x];
+                h = std::max(h, b.max.y);
+            }
+        }
+    }
+}
+
+float Debris::ground_height(float x, float z) const {
+    int cx = int(std::floor((x - grid_x) / cell_size));
+    int cz = int(std::floor((z - grid_z) / cell_size));
+    if (cx < 0 || cz < 0 || cx >= grid_w || cz >= grid_h) {
+        return -std::numeric_limits<float>::infinity();
+    }
+    return grid[size_t(cz) * grid_w + cx];
+}
+
+void Debris::step(float dt, glm::vec3 gravity) {
+    const size_t n = (count + 3) & ~size_t(3);
+    for (size_t i = 0; i < count; i++) {
+        heights[i] = ground_height(px[i], pz[i]);
+    }
+#ifdef PHYSICS_USE_SSE
+    const __m128 t = _mm_set1_ps(dt);
+    const __m128 gx = _mm_set1_ps(gravity.x * dt);
+    const __m128 gy = _mm_set1_ps(gravity.y * dt);
+    const __m128 gz = _mm_set1_ps(gravity.z * dt);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 restitution = _mm_set1_ps(-RESTITUTION);
+    const __m128 friction = _mm_set1_ps(FRICTION);
+    const __m128 rest_speed = _mm_set1_ps(REST_SPEED);
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 vx4 = _mm_add_ps(_mm_loadu_ps(&vx[i]), gx);
+        __m128 vy4 = _mm_add_ps(_mm_loadu_ps(&vy[i]), gy);
+        __m128 vz4 = _mm_add_ps(_mm_loadu_ps(&vz[i]), gz);
+        __m128 px4 = _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(vx4, t));
+        __m128 py4 = _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(vy4, t));
+        __m128 pz4 = _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(vz4, t));
+
+        // push particles below ground back up, bounce and slow them down
+        __m128 s4 = _mm_loadu_ps(&half[i]);
+        __m128 h4 = _mm_add_ps(_mm_loadu_ps(&heights[i]), s4);
+        __m128 below = _mm_cmplt_ps(py4, h4);
+        __m128 falling = _mm_and_ps(below, _mm_cmplt_ps(vy4, zero));
+        __m128 bounce = _mm_mul_ps(vy4, restitution);
+        bounce = _mm_and_ps(bounce, _mm_cmpgt_ps(bounce, rest_speed));
+        py4 = _mm_or_ps(_mm_and_ps(below, h4), _mm_andnot_ps(below, py4));
+        vy4 = _mm_or_ps(_mm_and_ps(falling, bounce), _mm_andnot_ps(falling, vy4));
+        __m128 slow = _mm_or_ps(_mm_and_ps(below, friction), _mm_andnot_ps(below, _mm_set1_ps(1.0f)));
+        vx4 = _mm_mul_ps(vx4, slow);
+        vz4 = _mm_mul_ps(vz4, slow);
+
+        _mm_storeu_ps(&vx[i], vx4); _mm_storeu_ps(&vy[i], vy4); _mm_storeu_ps(&vz[i], vz4);
+        _mm_storeu_ps(&px[i], px4); _mm_storeu_ps(&py[i], py4); _mm_storeu_ps(&pz[i], pz4);
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+        vx[i] += gravity.x * dt; vy[i] += gravity.y * dt; vz[i] += gravity.z * dt;
+        px[i] += vx[i] * dt; py[i] += vy[i] * dt; pz[i] += vz[i] * dt;
+        float h = heights[i] + half[i];
+        if (py[i] < h) {
+            py[i] = h;
+            if (vy[i] < 0) {
+                float bounce = -vy[i] * RESTITUTION;
+                vy[i] = bounce > REST_SPEED ? bounce : 0.0f;
+            }
+            vx[i] *= FRICTION;
+            vz[i] *= FRICTION;
+        }
+    }
+#endif
+    // padding lanes must stay zero
+    for (size_t i = count; i < n; i++) {
+        px[i] = py[i] = pz[i] = vx[i] = vy[i] = vz[i] = 0.0f;
+    }
+    for (size_t i = count; i-- > 0;) {
+        if (py[i] < kill_height) remove_at(i);
+    }
+}
+
+void Debris::shift(glm::vec3 offset) {
+    for (size_t i = 0; i < count; i++) {
+        px[i] -= offset.x; py[i] -= offset.y; pz[i] -= offset.z;
+    }
+    grid_x -= offset.x;
+    grid_z -= offset.z;
+    kill_height -= offset.y;
+    for (float& h : grid) h -= offset.y;
+}
+
+void Debris::take(glm::vec3 center, float radius,
+        std::vector<glm::vec4>& pos_size, std::vector<glm::vec3>& vel) {
+    const float r2 = radius * radius;
+    for (size_t i = count; i-- > 0;) {
+        float dx = px[i] - center.x, dy = py[i] - center.y, dz = pz[i] - center.z;
+        if (dx*dx + dy*dy + dz*dz <= r2) {
+            pos_size.push_back(glm::vec4(px[i], py[i], pz[i], half[i]));
+            vel.push_back(glm::vec3(vx[i], vy[i], vz[i]));
+            remove_at(i);
+        }
+    }
+}
+
+void Debris::export_instances(std::vector<glm::vec4>& out) const {
+    const size_t n = (count + 3) & ~size_t(3);
+    out.resize(n);
+#ifdef PHYSICS_USE_SSE
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 a = _mm_loadu_ps(&px[i]);
+        __m128 b = _mm_loadu_ps(&py[i]);
+        __m128 c = _mm_loadu_ps(&pz[i]);
+        __m128 d = _mm_loadu_ps(&half[i]);
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        float* dst = &out[i].x;
+        _mm_storeu_ps(dst, a);
+        _mm_storeu_ps(dst + 4, b);
+        _mm_storeu_ps(dst + 8, c);
+        _mm_storeu_ps(dst + 12, d);
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+        out[i] = glm::vec4(px[i], py[i], pz[i], half[i]);
+    }
+#endif
+    out.resize(count);
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../common.hpp"
+#include <vector>
+
+namespace physics {
+
+    /** Axis-aligned box of the static world, used as debris ground */
+    struct GroundBox {
+        glm::vec3 min, max;
+    };
+
+    /**
+     * Lightweight debris particles
+     *
+     * Particles are cubes without rotation, stored as structure of arrays and
+     * integrated four at a time with SSE. They never collide with each other,
+     * only with a height grid built from the static world, so even 100k of
+     * them are cheap. Particles that fall far below the ground are dropped.
+     */
+    class Debris {
+        // storage is padded to a multiple of 4, unused lanes are zero
+        std::vector<float> px, py, pz, vx, vy, vz, half;
+        std::vector<float> heights; // scratch for ground heights
+        size_t count;
+
+        // ground heights, max top of static boxes per cell
+        std::vector<float> grid;
+        float grid_x, grid_z, cell_size;
+        int grid_w, grid_h;
+        float kill_height;
+
+        float ground_height(float x, float z) const;
+        void remove_at(size_t i);
+
+    public:
+        Debris();
+
+        void add(glm::vec3 pos, glm::vec3 vel, float half_size);
+        size_t size() const { return count; }
+
+        /** Rebuild the ground height grid from boxes of the static world */
+        void set_ground(const std::vector<GroundBox>& boxes);
+
+        void step(float dt, glm::vec3 gravity);
+
+        /** Move particles and the ground by -offset, for World::rebase */
+        void shift(glm::vec3 offset);
+
+        /**
+         * Remove particles within radius of center, for turning them into
+         * real bodies. Positions and sizes go to pos_size, velocities to vel.
+         */
+        void take(glm::vec3 center, float radius,
+                std::vector<glm::vec4>& pos_size, std::vector<glm::vec3>& vel);
+
+        /** Render instances, xyz is position and w is half size */
+        void export_instances(std::vector<glm::vec4>& out) const;
+    };
+}
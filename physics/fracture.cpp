@@ -0,0 +1,67 @@
+#include "fracture.hpp"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+
+namespace physics {
+
+typedef std::array<float, 4> FractureKey;
+
+static std::mutex memo_mutex;
+static std::map<FractureKey, std::vector<Fragment>> memo;
+
+static std::vector<Fragment> cut(glm::vec3 size, int pieces) {
+    // seeded from the arguments so that fracturing is reproducible
+    uint32_t seed = uint32_t(pieces);
+    for (int i = 0; i < 3; i++) {
+        uint32_t bits;
+        std::memcpy(&bits, &size[i], sizeof(bits));
+        seed = seed * 31 + bits;
+    }
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> where(0.3f, 0.7f);
+
+    std::vector<Fragment> out;
+    Fragment whole;
+    whole.center = glm::vec3(0.0f);
+    whole.size = size;
+    out.push_back(whole);
+    while (int(out.size()) < pieces) {
+        auto volume = [](const Fragment& f) { return f.size.x * f.size.y * f.size.z; };
+        auto largest = std::max_element(out.begin(), out.end(),
+                [&](const Fragment& a, const Fragment& b) { return volume(a) < volume(b); });
+        Fragment a = *largest;
+        int axis = 0;
+        if (a.size[1] > a.size[axis]) axis = 1;
+        if (a.size[2] > a.size[axis]) axis = 2;
+
+        // split [c - s, c + s] at c - s + 2s * t
+        const float t = where(rng);
+        const float c = a.center[axis], s = a.size[axis];
+        Fragment b = a;
+        a.size[axis] = s * t;
+        a.center[axis] = c - s + a.size[axis];
+        b.size[axis] = s * (1 - t);
+        b.center[axis] = c + s - b.size[axis];
+        *largest = a;
+        out.push_back(b);
+    }
+    return out;
+}
+
+std::vector<Fragment> prefracture(glm::vec3 size, int pieces) {
+    const FractureKey key = {{ size.x, size.y, size.z, float(pieces) }};
+    {
+        std::lock_guard<std::mutex> lock(memo_mutex);
+        auto it = memo.find(key);
+        if (it != memo.end()) return it->second;
+    }
+    auto fragments = cut(size, std::max(pieces, 1));
+    std::lock_guard<std::mutex> lock(memo_mutex);
+    memo[key] = fragments;
+    return fragments;
+}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../common.hpp"
+#include <vector>
+
+namespace physics {
+
+    /** Piece of a prefractured box */
+    struct Fragment {
+        glm::vec3 center; // relative to the center of the box
+        glm::vec3 size; // half extents
+    };
+
+    /**
+     * Cut a box with given half extents into pieces box shaped fragments
+     *
+     * The largest fragment is cut across its longest axis at a random point
+     * until there are enough pieces, so fragments vary in size but none is
+     * a sliver. Same arguments give the same fragments, results are memoized.
+     * Thread safe.
+     */
+    std::vector<Fragment> prefracture(glm::vec3 size, int pieces);
+}
@@ -0,0 +1,61 @@
+#include "governor.hpp"
+
+#include <LinearMath/btScalar.h>
+
+namespace physics {
+
+const QualityLevel QUALITY_LEVELS[] = {
+    { 10, 1, BT_LARGE_FLOAT },
+    { 6, 1, 0.05f },
+    { 4, 1, 0.02f },
+    { 2, 1, 0.01f },
+};
+const int QUALITY_LEVEL_COUNT = sizeof(QUALITY_LEVELS) / sizeof(*QUALITY_LEVELS);
+
+Governor::Governor() : enabled(true), level(0), steps_since_change(0), average_ms(0) {
+    metrics = GovernorMetrics();
+    update_metrics(0);
+}
+
+bool Governor::update(float step_ms) {
+    average_ms = average_ms * 0.9f + step_ms * 0.1f;
+    steps_since_change++;
+    int old_level = level;
+    if (enabled) {
+        if (average_ms > PRESSURE_MS && level + 1 < QUALITY_LEVEL_COUNT
+                && steps_since_change >= DOWNGRADE_COOLDOWN) {
+            level++;
+        } else if (average_ms < RELAXED_MS && level > 0
+                && steps_since_change >= UPGRADE_COOLDOWN) {
+            level--;
+        }
+    } else {
+        level = 0;
+    }
+    if (level != old_level) {
+        steps_since_change = 0;
+    }
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    if (level > old_level) metrics.downgrades++;
+    if (level < old_level) metrics.upgrades++;
+    update_metrics(step_ms);
+    return level != old_level;
+}
+
+GovernorMetrics Governor::read_metrics() {
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    return metrics;
+}
+
+void Governor::update_metrics(float step_ms) {
+    const QualityLevel& q = quality();
+    metrics.enabled = enabled;
+    metrics.level = level;
+    metrics.solver_iterations = q.solver_iterations;
+    metrics.substeps = q.substeps;
+    metrics.contact_threshold = q.contact_threshold;
+    metrics.step_ms = step_ms;
+    metrics.average_ms = average_ms;
+}
+
+}
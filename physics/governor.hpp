@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../common.hpp"
+#include <mutex>
+
+namespace physics {
+
+    /** Decisions of the frame-time governor, see World::governor_metrics */
+    struct GovernorMetrics {
+        bool enabled;
+        int level; // 0 is full quality, higher is cheaper
+        int solver_iterations;
+        int substeps;
+        float contact_threshold;
+        float step_ms; // duration of the last step
+        float average_ms; // smoothed step duration
+        unsigned downgrades, upgrades; // level changes so far
+    };
+
+    struct QualityLevel {
+        int solver_iterations;
+        int substeps;
+        float contact_threshold;
+    };
+
+    /**
+     * Solver settings from best to cheapest, the governor walks this table.
+     * Level 0 is Bullet's defaults with one step per frame.
+     */
+    extern const QualityLevel QUALITY_LEVELS[];
+    extern const int QUALITY_LEVEL_COUNT;
+
+    /**
+     * Frame-time governor
+     *
+     * Watches a smoothed step time and drops to a cheaper quality level when
+     * it gets close to the frame budget, and goes back up when there is
+     * plenty of headroom again. Between the two thresholds the level stays
+     * where it is, and level changes are rate limited to avoid oscillation.
+     */
+    struct Governor {
+        static constexpr float BUDGET_MS = 1000.0f / 60.0f;
+        static constexpr float PRESSURE_MS = BUDGET_MS * 0.8f;
+        static constexpr float RELAXED_MS = BUDGET_MS * 0.35f;
+        static const int DOWNGRADE_COOLDOWN = 30;
+        static const int UPGRADE_COOLDOWN = 180;
+
+        bool enabled;
+        int level;
+        int steps_since_change;
+        float average_ms;
+        GovernorMetrics metrics; // guarded by metrics_mutex
+        std::mutex metrics_mutex;
+
+        Governor();
+
+        const QualityLevel& quality() const {
+            return QUALITY_LEVELS[level];
+        }
+
+        /** Feed time of the last step, returns true if quality level changed */
+        bool update(float step_ms);
+
+        /** Copy of the metrics, can be called from other threads */
+        GovernorMetrics read_metrics();
+
+    private:
+        void update_metrics(float step_ms);
+    };
+}
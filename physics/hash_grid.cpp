@@ -0,0 +1,333 @@
+#include "hash_grid.hpp"
+
+#include <BulletCollision/BroadphaseCollision/btOverlappingPairCache.h>
+#include <LinearMath/btAabbUtil2.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace physics {
+
+// cell coordinates are packed in 20 bits each, level in the top 4 bits
+const int COORD_BITS = 20;
+const int COORD_LIMIT = 1 << (COORD_BITS - 1);
+const uint64_t NO_KEY = ~uint64_t(0);
+const size_t MIN_CELLS = 1024;
+
+static uint64_t cell_key(int level, int x, int y, int z) {
+    const uint64_t mask = (uint64_t(1) << COORD_BITS) - 1;
+    return uint64_t(level) << (3 * COORD_BITS)
+        | (uint64_t(x + COORD_LIMIT) & mask) << (2 * COORD_BITS)
+        | (uint64_t(y + COORD_LIMIT) & mask) << COORD_BITS
+        | (uint64_t(z + COORD_LIMIT) & mask);
+}
+
+static int cell_coord(btScalar x, btScalar inverse_size) {
+    const double c = std::floor(double(x) * inverse_size);
+    // far away boxes share the edge cells, which only costs time
+    if (!(c > -COORD_LIMIT)) return -COORD_LIMIT;
+    if (c > COORD_LIMIT - 1) return COORD_LIMIT - 1;
+    return int(c);
+}
+
+HashGridBroadphase::HashGridBroadphase(btScalar cell_size, btOverlappingPairCache* pairs)
+    : cells(MIN_CELLS, Cell { NO_KEY, -1 }), cells_used(0), free_node(-1),
+    update_stamp(1), query_stamp(0), next_uid(0), pairs(pairs), owns_pairs(!pairs) {
+    btScalar size = cell_size;
+    for (int i = 0; i < HASH_GRID_LEVELS; i++) {
+        cell_sizes[i] = size;
+        inverse_sizes[i] = 1 / size;
+        size *= HASH_GRID_LEVEL_SCALE;
+    }
+    cell_shift = 64;
+    for (size_t n = cells.size(); n > 1; n /= 2) cell_shift--;
+    if (owns_pairs) this->pairs = new btHashedOverlappingPairCache();
+}
+
+HashGridBroadphase::~HashGridBroadphase() {
+    for (Proxy* p : proxies) delete p;
+    if (owns_pairs) delete pairs;
+}
+
+int HashGridBroadphase::level_for(const btVector3& min, const btVector3& max) const {
+    const btVector3 size = max - min;
+    const btScalar extent = std::max(size.x(), std::max(size.y(), size.z()));
+    for (int i = 0; i < HASH_GRID_LEVELS; i++) {
+        if (extent <= cell_sizes[i]) return i;
+    }
+    return HASH_GRID_LEVELS;
+}
+
+void HashGridBroadphase::cell_range(int level, const btVector3& min, const btVector3& max,
+        int* lo, int* hi) const {
+    for (int i = 0; i < 3; i++) {
+        lo[i] = cell_coord(min[i], inverse_sizes[level]);
+        hi[i] = cell_coord(max[i], inverse_sizes[level]);
+    }
+}
+
+HashGridBroadphase::Cell* HashGridBroadphase::find_cell(uint64_t key) {
+    const size_t mask = cells.size() - 1;
+    for (size_t i = size_t((key * 0x9E3779B97F4A7C15ull) >> cell_shift);; i = (i + 1) & mask) {
+        Cell& c = cells[i];
+        if (c.key == key) return &c;
+        if (c.key == NO_KEY) return nullptr;
+    }
+}
+
+HashGridBroadphase::Cell& HashGridBroadphase::add_cell(uint64_t key) {
+    if ((cells_used + 1) * 2 > cells.size()) grow_cells();
+    const size_t mask = cells.size() - 1;
+    for (size_t i = size_t((key * 0x9E3779B97F4A7C15ull) >> cell_shift);; i = (i + 1) & mask) {
+        Cell& c = cells[i];
+        if (c.key == key) return c;
+        if (c.key == NO_KEY) {
+            c.key = key;
+            c.head = -1;
+            cells_used++;
+            return c;
+        }
+    }
+}
+
+void HashGridBroadphase::grow_cells() {
+    // cells which were emptied are dropped here, the table only grows if
+    // the occupied ones need it
+    std::vector<Cell> old;
+    old.swap(cells);
+    size_t occupied = 0;
+    for (const Cell& c : old) occupied += c.head >= 0;
+    size_t size = MIN_CELLS;
+    while (size < occupied * 4) size *= 2;
+    cells.assign(size, Cell { NO_KEY, -1 });
+    cell_shift = 64;
+    for (size_t n = size; n > 1; n /= 2) cell_shift--;
+    cells_used = 0;
+    for (const Cell& c : old) {
+        if (c.head < 0) continue;
+        const size_t mask = cells.size() - 1;
+        size_t i = size_t((c.key * 0x9E3779B97F4A7C15ull) >> cell_shift);
+        while (cells[i].key != NO_KEY) i = (i + 1) & mask;
+        cells[i] = c;
+        cells_used++;
+    }
+}
+
+void HashGridBroadphase::insert(Proxy* p) {
+    std::vector<int>& list = by_level[p->level];
+    p->level_index = int(list.size());
+    list.push_back(p->index);
+    if (p->level == HASH_GRID_LEVELS) return;
+    for (int x = p->lo[0]; x <= p->hi[0]; x++)
+    for (int y = p->lo[1]; y <= p->hi[1]; y++)
+    for (int z = p->lo[2]; z <= p->hi[2]; z++) {
+        int node = free_node;
+        if (node >= 0) {
+            free_node = nodes[node].next;
+        } else {
+            node = int(nodes.size());
+            nodes.push_back(Node());
+        }
+        Cell& c = add_cell(cell_key(p->level, x, y, z));
+        nodes[node].proxy = p->index;
+        nodes[node].next = c.head;
+        c.head = node;
+    }
+}
+
+void HashGridBroadphase::erase(Proxy* p) {
+    std::vector<int>& list = by_level[p->level];
+    const int last = list.back();
+    list[p->level_index] = last;
+    proxies[last]->level_index = p->level_index;
+    list.pop_back();
+    if (p->level == HASH_GRID_LEVELS) return;
+    for (int x = p->lo[0]; x <= p->hi[0]; x++)
+    for (int y = p->lo[1]; y <= p->hi[1]; y++)
+    for (int z = p->lo[2]; z <= p->hi[2]; z++) {
+        Cell* c = find_cell(cell_key(p->level, x, y, z));
+        btAssert(c);
+        int* link = &c->head;
+        while (nodes[*link].proxy != p->index) link = &nodes[*link].next;
+        const int node = *link;
+        *link = nodes[node].next;
+        nodes[node].next = free_node;
+        free_node = node;
+    }
+}
+
+void HashGridBroadphase::mark_moved(Proxy* p) {
+    if (p->moved == update_stamp) return;
+    p->moved = update_stamp;
+    moved.push_back(p);
+}
+
+template <typename F>
+void HashGridBroadphase::query(const btVector3& min, const btVector3& max, F f) {
+    const uint64_t stamp = ++query_stamp;
+    auto visit = [&](int index) {
+        Proxy* p = proxies[index];
+        if (p->seen == stamp) return;
+        p->seen = stamp;
+        f(p);
+    };
+    for (int level = 0; level < HASH_GRID_LEVELS; level++) {
+        const std::vector<int>& list = by_level[level];
+        if (list.empty()) continue;
+        int lo[3], hi[3];
+        cell_range(level, min, max, lo, hi);
+        const double count = double(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+        if (count > list.size()) {
+            // the box covers more cells than there are proxies on the level
+            for (int index : list) visit(index);
+            continue;
+        }
+        for (int x = lo[0]; x <= hi[0]; x++)
+        for (int y = lo[1]; y <= hi[1]; y++)
+        for (int z = lo[2]; z <= hi[2]; z++) {
+            const Cell* c = find_cell(cell_key(level, x, y, z));
+            if (!c) continue;
+            for (int node = c->head; node >= 0; node = nodes[node].next) visit(nodes[node].proxy);
+        }
+    }
+    for (int index : by_level[HASH_GRID_LEVELS]) visit(index);
+}
+
+btBroadphaseProxy* HashGridBroadphase::createProxy(const btVector3& aabbMin, const btVector3& aabbMax,
+        int /*shapeType*/, void* userPtr, short int collisionFilterGroup,
+        short int collisionFilterMask, btDispatcher* /*dispatcher*/, void* /*multiSapProxy*/) {
+    Proxy* p = new Proxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask);
+    p->m_uniqueId = next_uid++;
+    if (free_proxies.empty()) {
+        p->index = int(proxies.size());
+        proxies.push_back(p);
+    } else {
+        p->index = free_proxies.back();
+        free_proxies.pop_back();
+        proxies[p->index] = p;
+    }
+    p->level = level_for(aabbMin, aabbMax);
+    if (p->level < HASH_GRID_LEVELS) cell_range(p->level, aabbMin, aabbMax, p->lo, p->hi);
+    insert(p);
+    mark_moved(p);
+    return p;
+}
+
+void HashGridBroadphase::destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher) {
+    Proxy* p = static_cast<Proxy*>(proxy);
+    pairs->removeOverlappingPairsContainingProxy(p, dispatcher);
+    erase(p);
+    if (p->moved == update_stamp) moved.erase(std::find(moved.begin(), moved.end(), p));
+    proxies[p->index] = nullptr;
+    free_proxies.push_back(p->index);
+    delete p;
+}
+
+void HashGridBroadphase::setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin,
+        const btVector3& aabbMax, btDispatcher* /*dispatcher*/) {
+    Proxy* p = static_cast<Proxy*>(proxy);
+    if (p->m_aabbMin == aabbMin && p->m_aabbMax == aabbMax) return;
+    p->m_aabbMin = aabbMin;
+    p->m_aabbMax = aabbMax;
+    mark_moved(p);
+    const int level = level_for(aabbMin, aabbMax);
+    int lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+    if (level < HASH_GRID_LEVELS) cell_range(level, aabbMin, aabbMax, lo, hi);
+    if (level == p->level && std::equal(lo, lo + 3, p->lo) && std::equal(hi, hi + 3, p->hi)) return;
+    erase(p);
+    p->level = level;
+    std::copy(lo, lo + 3, p->lo);
+    std::copy(hi, hi + 3, p->hi);
+    insert(p);
+}
+
+void HashGridBroadphase::getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const {
+    aabbMin = proxy->m_aabbMin;
+    aabbMax = proxy->m_aabbMax;
+}
+
+void HashGridBroadphase::rayTest(const btVector3& rayFrom, const btVector3& rayTo,
+        btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin, const btVector3& aabbMax) {
+    btVector3 min = rayFrom, max = rayFrom;
+    min.setMin(rayTo);
+    max.setMax(rayTo);
+    query(min + aabbMin, max + aabbMax, [&](Proxy* p) {
+        // same test as the tree does for its leaves, the box grown by the
+        // swept shape
+        btVector3 bounds[2] = { p->m_aabbMin - aabbMax, p->m_aabbMax - aabbMin };
+        btScalar t;
+        if (btRayAabb2(rayFrom, rayCallback.m_rayDirectionInverse, rayCallback.m_signs,
+                    bounds, t, 0, rayCallback.m_lambda_max)) {
+            rayCallback.process(p);
+        }
+    });
+}
+
+void HashGridBroadphase::aabbTest(const btVector3& aabbMin, const btVector3& aabbMax,
+        btBroadphaseAabbCallback& callback) {
+    query(aabbMin, aabbMax, [&](Proxy* p) {
+        if (TestAabbAgainstAabb2(aabbMin, aabbMax, p->m_aabbMin, p->m_aabbMax)) callback.process(p);
+    });
+}
+
+void HashGridBroadphase::calculateOverlappingPairs(btDispatcher* dispatcher) {
+    for (Proxy* p : moved) {
+        query(p->m_aabbMin, p->m_aabbMax, [&](Proxy* other) {
+            // pairs of two moved proxies are added by the older one
+            if (other == p || (other->moved == update_stamp && other->m_uniqueId < p->m_uniqueId)) return;
+            if (TestAabbAgainstAabb2(p->m_aabbMin, p->m_aabbMax, other->m_aabbMin, other->m_aabbMax)) {
+                pairs->addOverlappingPair(p, other);
+            }
+        });
+    }
+    if (!moved.empty()) {
+        // removing swaps the last pair in, so go from the end
+        btBroadphasePairArray& array = pairs->getOverlappingPairArray();
+        for (int i = array.size() - 1; i >= 0; i--) {
+            Proxy* a = static_cast<Proxy*>(array[i].m_pProxy0);
+            Proxy* b = static_cast<Proxy*>(array[i].m_pProxy1);
+            if (a->moved != update_stamp && b->moved != update_stamp) continue;
+            if (!TestAabbAgainstAabb2(a->m_aabbMin, a->m_aabbMax, b->m_aabbMin, b->m_aabbMax)) {
+                pairs->removeOverlappingPair(a, b, dispatcher);
+            }
+        }
+    }
+    moved.clear();
+    update_stamp++;
+}
+
+void HashGridBroadphase::shift(const btVector3& offset) {
+    std::fill(cells.begin(), cells.end(), Cell { NO_KEY, -1 });
+    cells_used = 0;
+    nodes.clear();
+    free_node = -1;
+    for (std::vector<int>& list : by_level) list.clear();
+    for (Proxy* p : proxies) {
+        if (!p) continue;
+        p->m_aabbMin -= offset;
+        p->m_aabbMax -= offset;
+        p->level = level_for(p->m_aabbMin, p->m_aabbMax);
+        if (p->level < HASH_GRID_LEVELS) cell_range(p->level, p->m_aabbMin, p->m_aabbMax, p->lo, p->hi);
+        insert(p);
+    }
+}
+
+void HashGridBroadphase::getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const {
+    aabbMin.setValue(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+    aabbMax.setValue(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+}
+
+void HashGridBroadphase::printStats() {
+    printf("hash grid: %d proxies, %d large, %d cells of %d, %d pairs\n",
+            int(proxies.size() - free_proxies.size()), int(by_level[HASH_GRID_LEVELS].size()),
+            int(occupied_cells()), int(cells.size()), pairs->getNumOverlappingPairs());
+}
+
+size_t HashGridBroadphase::occupied_cells() const {
+    size_t n = 0;
+    for (const Cell& c : cells) n += c.head >= 0;
+    return n;
+}
+
+}
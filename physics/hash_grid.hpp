@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../common.hpp"
+
+#include <BulletCollision/BroadphaseCollision/btBroadphaseInterface.h>
+#include <BulletCollision/BroadphaseCollision/btBroadphaseProxy.h>
+#include <vector>
+
+class btOverlappingPairCache;
+
+namespace physics {
+
+    /**
+     * Broadphase of uniform grids in a hash table
+     *
+     * Each proxy goes to the finest level whose cells are at least as big
+     * as its box, so it is in at most 8 cells. Levels grow by
+     * HASH_GRID_LEVEL_SCALE, boxes bigger than the coarsest cells are kept
+     * in a list and tested against everything. Moving a proxy only touches
+     * the cells it leaves and enters. Pairs are looked for around moved
+     * proxies only, which suits many similar small bodies: a new cube costs
+     * the same however many there are, unlike in a tree which needs
+     * rebalancing.
+     *
+     * Cells of all levels share one open addressing table, and the proxies
+     * of a cell are a linked list in a flat node array.
+     */
+    const int HASH_GRID_LEVELS = 4;
+    const int HASH_GRID_LEVEL_SCALE = 4;
+
+    class HashGridBroadphase : public btBroadphaseInterface, NoCopy {
+        struct Proxy : public btBroadphaseProxy {
+            int index; // in proxies
+            int level; // HASH_GRID_LEVELS for the large ones
+            int level_index; // in by_level of level
+            int lo[3], hi[3]; // cells at level
+            uint64_t moved; // stamp of the last update it moved in
+            uint64_t seen; // stamp of the last query it was found in
+
+            Proxy(const btVector3& min, const btVector3& max, void* user, short group, short mask)
+                : btBroadphaseProxy(min, max, user, group, mask), index(-1), level(0),
+                level_index(-1), moved(0), seen(0) {}
+        };
+        struct Cell {
+            uint64_t key;
+            int head; // first node, -1 when empty
+        };
+        struct Node {
+            int proxy;
+            int next;
+        };
+
+        btScalar cell_sizes[HASH_GRID_LEVELS];
+        btScalar inverse_sizes[HASH_GRID_LEVELS];
+        std::vector<Proxy*> proxies; // null for free slots
+        std::vector<int> free_proxies;
+        std::vector<int> by_level[HASH_GRID_LEVELS + 1];
+        std::vector<Cell> cells; // power of two size
+        int cell_shift; // 64 - log2 of the size
+        size_t cells_used; // keys in cells, also ones left empty
+        std::vector<Node> nodes;
+        int free_node;
+        std::vector<Proxy*> moved;
+        uint64_t update_stamp, query_stamp;
+        int next_uid;
+        btOverlappingPairCache* pairs;
+        bool owns_pairs;
+
+        int level_for(const btVector3& min, const btVector3& max) const;
+        void cell_range(int level, const btVector3& min, const btVector3& max, int* lo, int* hi) const;
+        Cell* find_cell(uint64_t key);
+        Cell& add_cell(uint64_t key);
+        void grow_cells();
+        void insert(Proxy* p);
+        void erase(Proxy* p);
+        void mark_moved(Proxy* p);
+
+        /** Call f for every proxy whose box may overlap min..max, once each */
+        template <typename F>
+        void query(const btVector3& min, const btVector3& max, F f);
+
+    public:
+        /**
+         * Finest cells of cell_size, pairs go to pairs or to a hashed pair
+         * cache owned by the broadphase
+         */
+        explicit HashGridBroadphase(btScalar cell_size = 0.5f, btOverlappingPairCache* pairs = nullptr);
+        virtual ~HashGridBroadphase();
+
+        virtual btBroadphaseProxy* createProxy(const btVector3& aabbMin, const btVector3& aabbMax,
+                int shapeType, void* userPtr, short int collisionFilterGroup,
+                short int collisionFilterMask, btDispatcher* dispatcher, void* multiSapProxy);
+        virtual void destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher);
+        virtual void setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin,
+                const btVector3& aabbMax, btDispatcher* dispatcher);
+        virtual void getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const;
+
+        virtual void rayTest(const btVector3& rayFrom, const btVector3& rayTo,
+                btBroadphaseRayCallback& rayCallback,
+                const btVector3& aabbMin = btVector3(0, 0, 0), const btVector3& aabbMax = btVector3(0, 0, 0));
+        virtual void aabbTest(const btVector3& aabbMin, const btVector3& aabbMax,
+                btBroadphaseAabbCallback& callback);
+
+        virtual void calculateOverlappingPairs(btDispatcher* dispatcher);
+
+        virtual btOverlappingPairCache* getOverlappingPairCache() { return pairs; }
+        virtual const btOverlappingPairCache* getOverlappingPairCache() const { return pairs; }
+
+        virtual void getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const;
+        virtual void printStats();
+
+        /**
+         * Move every proxy by -offset, for World::rebase. The cells are
+         * filled again, pairs stay as they are.
+         */
+        void shift(const btVector3& offset);
+
+        /** Cells with at least one proxy */
+        size_t occupied_cells() const;
+    };
+}
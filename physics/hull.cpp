@@ -0,0 +1,167 @@
+#include "hull.hpp"
+#include "../util/file.hpp"
+
+#include <LinearMath/btConvexHullComputer.h>
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace physics {
+
+const char* HULL_CACHE_DIR = "data/cache/hulls";
+
+// bump when simplification changes, so old cache files are not used
+const uint32_t HULL_VERSION = 1;
+const char HULL_MAGIC[4] = { 'H', 'U', 'L', 'L' };
+
+static std::mutex memo_mutex;
+static std::unordered_map<uint64_t, std::vector<glm::vec3>> memo;
+static string cache_dir = HULL_CACHE_DIR; // guarded by memo_mutex
+
+void set_hull_cache_dir(const string& dir) {
+    std::lock_guard<std::mutex> lock(memo_mutex);
+    cache_dir = dir;
+}
+
+void clear_hull_memo() {
+    std::lock_guard<std::mutex> lock(memo_mutex);
+    memo.clear();
+}
+
+uint64_t hull_key(const std::vector<glm::vec3>& points, int max_vertices) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto feed = [&hash](const void* data, size_t len) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < len; i++) {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    feed(&HULL_VERSION, sizeof(HULL_VERSION));
+    feed(&max_vertices, sizeof(max_vertices));
+    for (const auto& p : points) {
+        feed(&p.x, sizeof(float));
+        feed(&p.y, sizeof(float));
+        feed(&p.z, sizeof(float));
+    }
+    return hash;
+}
+
+static std::vector<glm::vec3> compute_hull(const std::vector<btVector3>& points) {
+    btConvexHullComputer hc;
+    if (!points.empty()) {
+        hc.compute(&points[0].m_floats[0], sizeof(btVector3), int(points.size()), 0, 0);
+    }
+    std::vector<glm::vec3> out;
+    for (int i = 0; i < hc.vertices.size(); i++) {
+        const btVector3& v = hc.vertices[i];
+        out.push_back(glm::vec3(v.x(), v.y(), v.z()));
+    }
+    return out;
+}
+
+static std::vector<glm::vec3> simplify(const std::vector<glm::vec3>& points, int max_vertices) {
+    std::vector<btVector3> input;
+    for (const auto& p : points) input.push_back(btVector3(p.x, p.y, p.z));
+    auto hull = compute_hull(input);
+    if (int(hull.size()) <= max_vertices || max_vertices < 4) return hull;
+
+    // support points of directions on a Fibonacci sphere
+    std::vector<bool> picked(hull.size(), false);
+    std::vector<btVector3> reduced;
+    const float golden = 2.39996323f;
+    for (int i = 0; i < max_vertices; i++) {
+        float y = 1.0f - 2.0f * (i + 0.5f) / max_vertices;
+        float r = std::sqrt(1.0f - y*y);
+        btVector3 dir(std::cos(golden * i) * r, y, std::sin(golden * i) * r);
+        size_t best = 0;
+        float best_dot = -BT_LARGE_FLOAT;
+        for (size_t j = 0; j < hull.size(); j++) {
+            float d = dir.dot(btVector3(hull[j].x, hull[j].y, hull[j].z));
+            if (d > best_dot) {
+                best_dot = d;
+                best = j;
+            }
+        }
+        if (!picked[best]) {
+            picked[best] = true;
+            reduced.push_back(btVector3(hull[best].x, hull[best].y, hull[best].z));
+        }
+    }
+    if (reduced.size() < 4) return hull;
+    return compute_hull(reduced);
+}
+
+static string cache_file(const string& dir, uint64_t key) {
+    std::stringstream ss;
+    ss << dir << '/' << std::hex << key << ".hull";
+    return ss.str();
+}
+
+static bool load_cached(const string& dir, uint64_t key, std::vector<glm::vec3>& out) {
+    string data;
+    try {
+        data = util::read_file(cache_file(dir, key).c_str());
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    uint32_t count;
+    const size_t header = sizeof(HULL_MAGIC) + sizeof(count);
+    if (data.size() < header || memcmp(data.data(), HULL_MAGIC, sizeof(HULL_MAGIC)) != 0) {
+        return false;
+    }
+    memcpy(&count, data.data() + sizeof(HULL_MAGIC), sizeof(count));
+    if (data.size() != header + count * 3 * sizeof(float)) return false;
+    out.resize(count);
+    const char* p = data.data() + header;
+    for (uint32_t i = 0; i < count; i++, p += 3 * sizeof(float)) {
+        memcpy(&out[i].x, p, sizeof(float));
+        memcpy(&out[i].y, p + sizeof(float), sizeof(float));
+        memcpy(&out[i].z, p + 2 * sizeof(float), sizeof(float));
+    }
+    return true;
+}
+
+static void store_cached(const string& dir, uint64_t key, const std::vector<glm::vec3>& hull) {
+    string data(HULL_MAGIC, sizeof(HULL_MAGIC));
+    uint32_t count = hull.size();
+    data.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& v : hull) {
+        data.append(reinterpret_cast<const char*>(&v.x), sizeof(float));
+        data.append(reinterpret_cast<const char*>(&v.y), sizeof(float));
+        data.append(reinterpret_cast<const char*>(&v.z), sizeof(float));
+    }
+    try {
+        util::make_dirs(dir.c_str());
+        util::write_file(cache_file(dir, key).c_str(), data);
+    } catch (const std::runtime_error& e) {
+        cerr << "Hull cache not written: " << e.what() << endl;
+    }
+}
+
+std::vector<glm::vec3> simplified_hull(const std::vector<glm::vec3>& points, int max_vertices) {
+    const uint64_t key = hull_key(points, max_vertices);
+    string dir;
+    {
+        std::lock_guard<std::mutex> lock(memo_mutex);
+        auto it = memo.find(key);
+        if (it != memo.end()) return it->second;
+        dir = cache_dir;
+    }
+
+    std::vector<glm::vec3> hull;
+    if (!load_cached(dir, key, hull)) {
+        hull = simplify(points, max_vertices);
+        store_cached(dir, key, hull);
+    }
+
+    std::lock_guard<std::mutex> lock(memo_mutex);
+    memo[key] = hull;
+    return hull;
+}
+
+}
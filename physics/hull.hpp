@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../common.hpp"
+#include <vector>
+
+namespace physics {
+
+    /** Default directory for simplified hulls, relative to the game directory */
+    extern const char* HULL_CACHE_DIR;
+
+    /** Cache simplified hulls on disk under dir instead of HULL_CACHE_DIR */
+    void set_hull_cache_dir(const string& dir);
+    /** Forget the hulls memoized in memory, the disk cache stays */
+    void clear_hull_memo();
+
+    /** Hash of a point cloud and vertex budget, identifies a simplified hull */
+    uint64_t hull_key(const std::vector<glm::vec3>& points, int max_vertices);
+
+    /**
+     * Convex hull of points with at most max_vertices vertices
+     *
+     * The exact hull is computed with btConvexHullComputer and, when it has
+     * too many vertices, reduced to the support points of max_vertices
+     * evenly spread directions. Results are memoized in memory and cached
+     * on disk by hull_key, so each mesh is simplified only once.
+     * Thread safe.
+     */
+    std::vector<glm::vec3> simplified_hull(const std::vector<glm::vec3>& points, int max_vertices);
+}
@@ -0,0 +1,540 @@
+#include "recorder.hpp"
+
+#include <LinearMath/btTransform.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace physics {
+
+/*
+ * File layout, all little endian:
+ *
+ * FileHeader, then chunks until the end of the file. A chunk is a
+ * ChunkHeader followed by its columns, each starting at a multiple of 8
+ * bytes from the chunk start:
+ *
+ *   step numbers        u64[steps]
+ *   pose start          u32[steps + 1]   poses of step k are [start[k], start[k+1])
+ *   removed start       u32[steps + 1]
+ *   ids                 u64[poses]
+ *   x, y, z             i32[poses] each, millimeters
+ *   qx, qy, qz, qw      i16[poses] each, rotation quaternion times 32767
+ *   removed ids         u64[removed]     applied before the poses of a step
+ *   shape ids           u64[shapes]
+ *   cx, cy, cz          f32[shapes] each, shape center
+ *   sx, sy, sz          f32[shapes] each, half extents
+ *
+ * The first step of a chunk carries every live body, later steps only the
+ * bodies which moved. Shapes of all bodies of the chunk are in the chunk.
+ * The header is written last, so a chunk cut short by a crash is ignored.
+ */
+
+static const char FILE_MAGIC[8] = { 'T', 'F', 'P', 'O', 'S', 'E', 'S', '1' };
+static const uint32_t CHUNK_MAGIC = 0x4b484350; // "PCHK"
+static const float POSITION_UNIT = 0.001f;
+static const float ROTATION_SCALE = 32767.0f;
+static const size_t RECORDER_FRAMES = 16;
+static const size_t MIN_GROWTH = 16 << 20;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t chunk_steps;
+    float position_unit;
+};
+
+struct ChunkHeader {
+    uint32_t magic;
+    uint32_t steps;
+    uint64_t poses;
+    uint64_t removed;
+    uint64_t shapes;
+    uint64_t size; // header and columns
+};
+
+/** Offsets of the columns of a chunk from its start */
+struct ChunkLayout {
+    size_t step_numbers, pose_start, removed_start;
+    size_t ids, position[3], rotation[4];
+    size_t removed, shape_ids, center[3], size[3];
+    size_t end;
+
+    explicit ChunkLayout(const ChunkHeader& h) {
+        end = sizeof(ChunkHeader);
+        step_numbers = column(size_t(h.steps) * 8);
+        pose_start = column((size_t(h.steps) + 1) * 4);
+        removed_start = column((size_t(h.steps) + 1) * 4);
+        ids = column(h.poses * 8);
+        for (size_t& c : position) c = column(h.poses * 4);
+        for (size_t& c : rotation) c = column(h.poses * 2);
+        removed = column(h.removed * 8);
+        shape_ids = column(h.shapes * 8);
+        for (size_t& c : center) c = column(h.shapes * 4);
+        for (size_t& c : size) c = column(h.shapes * 4);
+    }
+
+    size_t column(size_t bytes) {
+        const size_t at = (end + 7) & ~size_t(7);
+        end = at + bytes;
+        return at;
+    }
+};
+
+/** Pose as stored in the file */
+struct PackedPose {
+    int32_t position[3];
+    int16_t rotation[4];
+};
+
+/** Pose relative to origin packed as a pose relative to the first origin */
+static PackedPose pack_pose(const glm::mat4& m, const glm::dvec3& origin) {
+    btTransform trans;
+    trans.setFromOpenGLMatrix(glm::value_ptr(m));
+    btQuaternion q = trans.getRotation();
+    // q and -q are the same rotation, keep w positive
+    if (q.w() < 0) q = -q;
+    PackedPose p;
+    for (int i = 0; i < 3; i++) {
+        p.position[i] = int32_t(std::lround((trans.getOrigin()[i] + origin[i]) / POSITION_UNIT));
+    }
+    const btScalar c[4] = { q.x(), q.y(), q.z(), q.w() };
+    for (int i = 0; i < 4; i++) {
+        p.rotation[i] = int16_t(std::lround(c[i] * ROTATION_SCALE));
+    }
+    return p;
+}
+
+static glm::mat4 unpack_pose(const int32_t position[3], const int16_t rotation[4],
+        const glm::dvec3& origin) {
+    btQuaternion q(rotation[0], rotation[1], rotation[2], rotation[3]);
+    q.normalize();
+    btVector3 pos;
+    for (int i = 0; i < 3; i++) pos[i] = btScalar(position[i] * double(POSITION_UNIT) - origin[i]);
+    const btTransform trans(q, pos);
+    glm::mat4 m;
+    trans.getOpenGLMatrix(glm::value_ptr(m));
+    return m;
+}
+
+static void throw_errno(const string& what, const string& path) {
+    throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+/**
+ * Appends chunks to the mapped file, only touched by the writer thread
+ * after construction
+ */
+struct PoseRecorder::Writer {
+    string path;
+    int fd;
+    char* map;
+    size_t capacity, used;
+    uint32_t chunk_steps;
+
+    // latest pose and shape of every live body
+    std::unordered_map<ObjectId, PackedPose> state;
+    std::unordered_map<ObjectId, RecordedShape> shapes;
+
+    // chunk being collected
+    std::vector<uint64_t> step_numbers;
+    std::vector<uint32_t> pose_start, removed_start;
+    std::vector<ObjectId> ids, removed;
+    std::vector<PackedPose> poses;
+    std::vector<ObjectId> chunk_bodies;
+
+    Writer(const string& path, int chunk_steps)
+        : path(path), map(nullptr), capacity(0), used(0),
+        chunk_steps(uint32_t(std::max(chunk_steps, 1))) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw_errno("Cannot create", path);
+        FileHeader header;
+        std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        header.chunk_steps = this->chunk_steps;
+        header.position_unit = POSITION_UNIT;
+        try {
+            append(&header, sizeof(header));
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        start_chunk();
+    }
+
+    ~Writer() {
+        try {
+            flush();
+        } catch (const std::exception& e) {
+            cerr << "Pose recording lost its last chunk: " << e.what() << endl;
+        }
+        if (map) munmap(map, capacity);
+        // the mapping grew in big steps, cut the file to what was written
+        if (ftruncate(fd, off_t(used)) != 0) {
+            cerr << "Cannot truncate " << path << ": " << std::strerror(errno) << endl;
+        }
+        ::close(fd);
+    }
+
+    /** Make room for n more bytes, remapping the file when it grows */
+    void reserve(size_t n) {
+        if (used + n <= capacity) return;
+        const size_t grown = std::max(used + n, std::max(capacity * 2, MIN_GROWTH));
+        if (ftruncate(fd, off_t(grown)) != 0) throw_errno("Cannot grow", path);
+        if (map) munmap(map, capacity);
+        void* p = mmap(nullptr, grown, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            map = nullptr;
+            capacity = 0;
+            throw_errno("Cannot map", path);
+        }
+        map = static_cast<char*>(p);
+        capacity = grown;
+    }
+
+    void append(const void* data, size_t n) {
+        reserve(n);
+        std::memcpy(map + used, data, n);
+        used += n;
+    }
+
+    void start_chunk() {
+        step_numbers.clear();
+        pose_start.assign(1, 0);
+        removed_start.assign(1, 0);
+        ids.clear();
+        removed.clear();
+        poses.clear();
+    }
+
+    void add(const RecorderFrame& frame) {
+        for (ObjectId id : frame.removed) state.erase(id);
+        for (const RecordedShape& s : frame.shapes) shapes[s.id] = s;
+        removed.insert(removed.end(), frame.removed.begin(), frame.removed.end());
+        for (size_t i = 0; i < frame.ids.size(); i++) {
+            state[frame.ids[i]] = pack_pose(frame.transforms[i], frame.origin);
+        }
+        if (step_numbers.empty()) {
+            // key step, everything alive
+            for (const auto& kv : state) {
+                ids.push_back(kv.first);
+                poses.push_back(kv.second);
+            }
+        } else {
+            ids.insert(ids.end(), frame.ids.begin(), frame.ids.end());
+            for (ObjectId id : frame.ids) poses.push_back(state[id]);
+        }
+        step_numbers.push_back(frame.step);
+        pose_start.push_back(uint32_t(ids.size()));
+        removed_start.push_back(uint32_t(removed.size()));
+        if (step_numbers.size() >= chunk_steps) flush();
+    }
+
+    template <typename T, typename F>
+    void fill(size_t offset, size_t count, F value) {
+        T* out = reinterpret_cast<T*>(map + used + offset);
+        for (size_t i = 0; i < count; i++) out[i] = value(i);
+    }
+
+    /** Write the collected steps as a chunk */
+    void flush() {
+        if (step_numbers.empty()) return;
+        chunk_bodies.assign(ids.begin(), ids.end());
+        std::sort(chunk_bodies.begin(), chunk_bodies.end());
+        chunk_bodies.erase(std::unique(chunk_bodies.begin(), chunk_bodies.end()), chunk_bodies.end());
+        // bodies without a known shape get the default one from the reader
+        chunk_bodies.erase(std::remove_if(chunk_bodies.begin(), chunk_bodies.end(),
+                    [this](ObjectId id) { return !shapes.count(id); }), chunk_bodies.end());
+
+        ChunkHeader h;
+        h.magic = 0;
+        h.steps = uint32_t(step_numbers.size());
+        h.poses = ids.size();
+        h.removed = removed.size();
+        h.shapes = chunk_bodies.size();
+        const ChunkLayout layout(h);
+        h.size = (layout.end + 7) & ~size_t(7);
+        reserve(h.size);
+        std::memset(map + used, 0, h.size);
+
+        std::memcpy(map + used + layout.step_numbers, step_numbers.data(), h.steps * 8);
+        std::memcpy(map + used + layout.pose_start, pose_start.data(), (h.steps + 1) * 4);
+        std::memcpy(map + used + layout.removed_start, removed_start.data(), (h.steps + 1) * 4);
+        std::memcpy(map + used + layout.ids, ids.data(), h.poses * 8);
+        for (int c = 0; c < 3; c++) {
+            fill<int32_t>(layout.position[c], h.poses, [&](size_t i) { return poses[i].position[c]; });
+        }
+        for (int c = 0; c < 4; c++) {
+            fill<int16_t>(layout.rotation[c], h.poses, [&](size_t i) { return poses[i].rotation[c]; });
+        }
+        std::memcpy(map + used + layout.removed, removed.data(), h.removed * 8);
+        std::memcpy(map + used + layout.shape_ids, chunk_bodies.data(), h.shapes * 8);
+        for (int c = 0; c < 3; c++) {
+            fill<float>(layout.center[c], h.shapes,
+                    [&](size_t i) { return shapes[chunk_bodies[i]].center[c]; });
+            fill<float>(layout.size[c], h.shapes,
+                    [&](size_t i) { return shapes[chunk_bodies[i]].size[c]; });
+        }
+        h.magic = CHUNK_MAGIC;
+        std::memcpy(map + used, &h, sizeof(h));
+        used += h.size;
+
+        // shapes of removed bodies were kept for the steps before removal
+        for (auto it = shapes.begin(); it != shapes.end();) {
+            if (state.count(it->first)) ++it;
+            else it = shapes.erase(it);
+        }
+        start_chunk();
+    }
+};
+
+PoseRecorder::PoseRecorder(const string& path, int chunk_steps)
+    : writer(new Writer(path, chunk_steps)), frames(RECORDER_FRAMES),
+    free_frames(RECORDER_FRAMES), full_frames(RECORDER_FRAMES),
+    stopping(false), running(true), dropped_count(0), submitted_count(0), written_count(0) {
+    for (RecorderFrame& frame : frames) free_frames.push(&frame);
+    thread = std::thread([this]() { run(); });
+}
+
+PoseRecorder::~PoseRecorder() {
+    stop();
+    thread.join();
+}
+
+void PoseRecorder::stop() {
+    stopping.store(true, std::memory_order_release);
+}
+
+void PoseRecorder::drain() {
+    const uint64_t submitted = submitted_count.load(std::memory_order_acquire);
+    while (written_count.load(std::memory_order_acquire) < submitted
+            && running.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void PoseRecorder::run() {
+    try {
+        for (;;) {
+            // frames submitted before stopping was set are drained below
+            const bool stop = stopping.load(std::memory_order_acquire);
+            bool wrote = false;
+            RecorderFrame* frame;
+            while (full_frames.pop(frame)) {
+                writer->add(*frame);
+                free_frames.push(frame);
+                written_count.fetch_add(1, std::memory_order_release);
+                wrote = true;
+            }
+            if (stop) break;
+            if (!wrote) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        writer.reset();
+    } catch (const std::exception& e) {
+        // out of disk space, most likely. Recording stops, the game goes on
+        // and the chunks written so far stay readable.
+        cerr << "Pose recording failed: " << e.what() << endl;
+        writer.reset();
+    }
+    running.store(false, std::memory_order_release);
+}
+
+RecorderFrame* PoseRecorder::begin_frame() {
+    RecorderFrame* frame;
+    if (!free_frames.pop(frame)) {
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    frame->ids.clear();
+    frame->transforms.clear();
+    frame->shapes.clear();
+    frame->removed.clear();
+    return frame;
+}
+
+void PoseRecorder::submit(RecorderFrame* frame) {
+    submitted_count.fetch_add(1, std::memory_order_release);
+    full_frames.push(frame);
+}
+
+template <typename T>
+inline const T* column(const char* chunk, size_t offset) {
+    return reinterpret_cast<const T*>(chunk + offset);
+}
+
+static uint64_t first_step_of(const char* chunk, const ChunkHeader& h) {
+    uint64_t step;
+    std::memcpy(&step, chunk + ChunkLayout(h).step_numbers, 8);
+    return step;
+}
+
+/** Start indices which begin at 0, never decrease and end at count */
+static bool valid_starts(const uint32_t* start, uint32_t steps, uint64_t count) {
+    if (start[0] != 0 || start[steps] != count) return false;
+    for (uint32_t k = 0; k < steps; k++) {
+        if (start[k] > start[k + 1]) return false;
+    }
+    return true;
+}
+
+/** Whether every index seek follows stays inside the chunk */
+static bool valid_chunk(const char* chunk, const ChunkHeader& h) {
+    // every column entry takes at least two bytes, larger counts overflow
+    const uint64_t limit = h.size / 2;
+    if (h.steps == 0 || h.steps > limit || h.poses > limit || h.removed > limit
+            || h.shapes > limit) {
+        return false;
+    }
+    const ChunkLayout layout(h);
+    if (layout.end > h.size) return false;
+    const uint64_t* steps = column<uint64_t>(chunk, layout.step_numbers);
+    for (uint32_t k = 1; k < h.steps; k++) {
+        if (steps[k - 1] >= steps[k]) return false;
+    }
+    const ObjectId* shape_ids = column<ObjectId>(chunk, layout.shape_ids);
+    for (uint64_t i = 1; i < h.shapes; i++) {
+        if (shape_ids[i - 1] >= shape_ids[i]) return false;
+    }
+    return valid_starts(column<uint32_t>(chunk, layout.pose_start), h.steps, h.poses)
+        && valid_starts(column<uint32_t>(chunk, layout.removed_start), h.steps, h.removed);
+}
+
+PoseReplay::PoseReplay(const string& path) : data(nullptr), size(0) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw_errno("Cannot open", path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw_errno("Cannot stat", path);
+    }
+    size = size_t(st.st_size);
+    if (size < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error(path + " is not a pose recording");
+    }
+    void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) throw_errno("Cannot map", path);
+    data = static_cast<const char*>(p);
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0
+            || header.position_unit != POSITION_UNIT) {
+        munmap(const_cast<char*>(data), size);
+        throw std::runtime_error(path + " is not a pose recording");
+    }
+
+    // a recorder which did not close properly leaves zeros or a chunk cut
+    // short after its complete chunks
+    size_t offset = sizeof(FileHeader);
+    while (offset + sizeof(ChunkHeader) <= size) {
+        ChunkHeader h;
+        std::memcpy(&h, data + offset, sizeof(h));
+        if (h.magic != CHUNK_MAGIC || h.size > size - offset) break;
+        if (!valid_chunk(data + offset, h)
+                || (!chunks.empty() && chunks.back().first_step >= first_step_of(data + offset, h))) {
+            munmap(const_cast<char*>(data), size);
+            throw std::runtime_error(path + " is a corrupt pose recording");
+        }
+        Chunk chunk;
+        chunk.offset = offset;
+        chunk.steps = h.steps;
+        chunk.first_step = first_step_of(data + offset, h);
+        chunks.push_back(chunk);
+        offset += h.size;
+    }
+}
+
+PoseReplay::~PoseReplay() {
+    munmap(const_cast<char*>(data), size);
+}
+
+uint64_t PoseReplay::first_step() const {
+    return chunks.empty() ? 0 : chunks.front().first_step;
+}
+
+uint64_t PoseReplay::last_step() const {
+    if (chunks.empty()) return 0;
+    const Chunk& chunk = chunks.back();
+    ChunkHeader h;
+    std::memcpy(&h, data + chunk.offset, sizeof(h));
+    uint64_t step;
+    std::memcpy(&step, data + chunk.offset + ChunkLayout(h).step_numbers + (h.steps - 1) * 8, 8);
+    return step;
+}
+
+bool PoseReplay::seek(uint64_t step, std::vector<ReplayPose>& out, const glm::dvec3& origin) const {
+    out.clear();
+    if (chunks.empty() || step < first_step() || step > last_step()) return false;
+    // last chunk starting at or before step
+    auto it = std::upper_bound(chunks.begin(), chunks.end(), step,
+            [](uint64_t s, const Chunk& c) { return s < c.first_step; }) - 1;
+    const char* chunk = data + it->offset;
+    ChunkHeader h;
+    std::memcpy(&h, chunk, sizeof(h));
+    const ChunkLayout layout(h);
+
+    // dropped steps are missing, the last step recorded before counts
+    const uint64_t* steps = column<uint64_t>(chunk, layout.step_numbers);
+    const uint32_t last = uint32_t(std::upper_bound(steps, steps + h.steps, step) - steps);
+
+    std::unordered_map<ObjectId, size_t> latest; // id to pose index
+    const uint32_t* pose_start = column<uint32_t>(chunk, layout.pose_start);
+    const uint32_t* removed_start = column<uint32_t>(chunk, layout.removed_start);
+    const ObjectId* ids = column<ObjectId>(chunk, layout.ids);
+    const ObjectId* removed = column<ObjectId>(chunk, layout.removed);
+    for (uint32_t k = 0; k < last; k++) {
+        for (uint32_t i = removed_start[k]; i < removed_start[k + 1]; i++) {
+            latest.erase(removed[i]);
+        }
+        for (uint32_t i = pose_start[k]; i < pose_start[k + 1]; i++) {
+            latest[ids[i]] = i;
+        }
+    }
+
+    const ObjectId* shape_ids = column<ObjectId>(chunk, layout.shape_ids);
+    out.reserve(latest.size());
+    for (const auto& kv : latest) {
+        const size_t i = kv.second;
+        ReplayPose pose;
+        pose.id = kv.first;
+        const int32_t position[3] = {
+            column<int32_t>(chunk, layout.position[0])[i],
+            column<int32_t>(chunk, layout.position[1])[i],
+            column<int32_t>(chunk, layout.position[2])[i],
+        };
+        const int16_t rotation[4] = {
+            column<int16_t>(chunk, layout.rotation[0])[i],
+            column<int16_t>(chunk, layout.rotation[1])[i],
+            column<int16_t>(chunk, layout.rotation[2])[i],
+            column<int16_t>(chunk, layout.rotation[3])[i],
+        };
+        pose.transform = unpack_pose(position, rotation, origin);
+        pose.shape.id = kv.first;
+        pose.shape.center = glm::vec3(0.0f);
+        pose.shape.size = glm::vec3(0.5f);
+        const ObjectId* s = std::lower_bound(shape_ids, shape_ids + h.shapes, kv.first);
+        if (s != shape_ids + h.shapes && *s == kv.first) {
+            const size_t j = s - shape_ids;
+            for (int c = 0; c < 3; c++) {
+                pose.shape.center[c] = column<float>(chunk, layout.center[c])[j];
+                pose.shape.size[c] = column<float>(chunk, layout.size[c])[j];
+            }
+        }
+        out.push_back(pose);
+    }
+    std::sort(out.begin(), out.end(),
+            [](const ReplayPose& a, const ReplayPose& b) { return a.id < b.id; });
+    return true;
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../common.hpp"
+#include "../util/spsc_ring.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace physics {
+
+    /** Bounding box of a recorded body in its own coordinates */
+    struct RecordedShape {
+        ObjectId id;
+        glm::vec3 center, size; // size is half extents
+    };
+
+    /** What the physics thread hands to the writer after a step */
+    struct RecorderFrame {
+        uint64_t step;
+        std::vector<ObjectId> ids;
+        std::vector<glm::mat4> transforms;
+        std::vector<RecordedShape> shapes; // bodies seen for the first time
+        std::vector<ObjectId> removed;
+        glm::dvec3 origin; // of the world, see World::rebase
+
+        RecorderFrame() : origin(0.0) {}
+    };
+
+    /**
+     * Flight recorder of body poses
+     *
+     * The physics thread fills a frame per step and submits it without
+     * waiting. A background writer quantizes positions to millimeters and
+     * rotations to 16 bit quaternions and appends them to a memory mapped
+     * file in chunks of columns. Each chunk starts with every live body so
+     * a reader can start from any chunk. When the writer falls behind, frames
+     * are dropped and counted, and the next frame should carry every body.
+     */
+    class PoseRecorder : NoCopy {
+        struct Writer;
+        unique_ptr<Writer> writer;
+        std::vector<RecorderFrame> frames;
+        util::SpscRing<RecorderFrame*> free_frames; // writer to physics
+        util::SpscRing<RecorderFrame*> full_frames; // physics to writer
+        std::atomic<bool> stopping, running;
+        std::atomic<uint64_t> dropped_count, submitted_count, written_count;
+        std::thread thread;
+        void run();
+
+    public:
+        /** Create or truncate file at path, throws std::runtime_error on failure */
+        PoseRecorder(const string& path, int chunk_steps = 64);
+        /** Writes the frames submitted so far and closes the file */
+        ~PoseRecorder();
+
+        /**
+         * Ask the writer to write what was submitted and close the file,
+         * without waiting for it. Nothing can be submitted after this.
+         */
+        void stop();
+        /** Wait until the writer has taken every submitted frame, or failed */
+        void drain();
+
+        /**
+         * Frame to fill, or nullptr when all frames are still being written,
+         * the step is dropped then. Called by the recording thread only.
+         */
+        RecorderFrame* begin_frame();
+        void submit(RecorderFrame* frame);
+
+        /** Steps dropped because the writer was behind */
+        uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+    };
+
+    struct ReplayPose {
+        ObjectId id;
+        glm::mat4 transform;
+        RecordedShape shape;
+    };
+
+    /** Reads a file written by PoseRecorder */
+    class PoseReplay : NoCopy {
+        struct Chunk {
+            size_t offset;
+            uint64_t first_step;
+            uint32_t steps;
+        };
+        const char* data;
+        size_t size;
+        std::vector<Chunk> chunks;
+
+    public:
+        /** Map file at path, throws std::runtime_error if it is not a recording */
+        explicit PoseReplay(const string& path);
+        ~PoseReplay();
+
+        bool empty() const { return chunks.empty(); }
+        uint64_t first_step() const;
+        uint64_t last_step() const;
+
+        /**
+         * Poses of all bodies at step relative to origin, false when it was
+         * not recorded. Positions are stored relative to the origin the
+         * world had when it was created, whatever it was rebased to later.
+         */
+        bool seek(uint64_t step, std::vector<ReplayPose>& out,
+                const glm::dvec3& origin = glm::dvec3(0.0)) const;
+    };
+}
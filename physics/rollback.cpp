@@ -0,0 +1,90 @@
+#include "rollback.hpp"
+
+#include <algorithm>
+
+namespace physics {
+
+RollbackRing::RollbackRing(int steps)
+    : records(std::max(steps, 0)), head(0), count(0), serial(0), base_step(0) {}
+
+void RollbackRing::reset(uint64_t step) {
+    head = 0;
+    count = 0;
+    base_step = step;
+    current.clear();
+    current_data.clear();
+}
+
+void RollbackRing::add(ObjectId id, const btScalar* state, size_t n) {
+    Current& c = current[id];
+    c.offset = uint32_t(current_data.size());
+    c.size = uint32_t(n);
+    c.stamp = 0;
+    current_data.insert(current_data.end(), state, state + n);
+}
+
+void RollbackRing::begin(uint64_t step) {
+    if (records.empty()) return;
+    if (count == records.size()) {
+        // the oldest record falls out, its states are older than the window
+        base_step = record(0).step;
+        head = (head + 1) % records.size();
+        count--;
+    }
+    Record& r = record(count++);
+    r.step = step;
+    r.ids.clear();
+    r.offsets.assign(1, 0);
+    r.data.clear();
+    r.undos.clear();
+    serial++;
+}
+
+void RollbackRing::appear(ObjectId id, const btScalar* state, size_t n) {
+    if (records.empty()) return;
+    add(id, state, n);
+    // nothing to restore for the step it appeared in
+    current[id].stamp = serial;
+}
+
+void RollbackRing::log_undo(std::function<void()> undo) {
+    if (records.empty()) return;
+    record(count - 1).undos.push_back(std::move(undo));
+}
+
+bool RollbackRing::change(ObjectId id, const btScalar* state, size_t n) {
+    auto it = current.find(id);
+    if (it == current.end() || it->second.size != n) return false;
+    Current& c = it->second;
+    btScalar* now = &current_data[c.offset];
+    if (c.stamp != serial) {
+        // first change in this step, keep what it was before
+        c.stamp = serial;
+        Record& r = record(count - 1);
+        r.ids.push_back(id);
+        r.data.insert(r.data.end(), now, now + n);
+        r.offsets.push_back(uint32_t(r.data.size()));
+    }
+    std::copy(state, state + n, now);
+    return true;
+}
+
+bool RollbackRing::has(uint64_t step) const {
+    if (step == base_step) return true;
+    // steps of the records increase
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (record(mid).step < step) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < count && record(lo).step == step;
+}
+
+size_t RollbackRing::stored_scalars() const {
+    size_t n = current_data.size();
+    for (size_t i = 0; i < count; i++) n += record(i).data.size();
+    return n;
+}
+
+}
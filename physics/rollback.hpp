@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../common.hpp"
+
+#include <LinearMath/btScalar.h>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace physics {
+
+    /**
+     * Undo log of object states for the last steps
+     *
+     * State of an object is whatever its owner saves, a few scalars. After
+     * each step the objects which changed are passed to change(), and the
+     * ring keeps what they were before the step. Rewinding applies those
+     * in reverse, so it costs as much as the changes being undone, bodies
+     * which slept all along are not touched.
+     *
+     * Objects which appear during the window are known from then on, going
+     * back past that does not touch them. Other changes to the structure of
+     * the world are undone by callbacks logged with the record of their
+     * step, or by starting a new window with reset.
+     */
+    class RollbackRing : NoCopy {
+        struct Record {
+            uint64_t step;
+            std::vector<ObjectId> ids;
+            std::vector<uint32_t> offsets; // of ids in data, one extra at the end
+            std::vector<btScalar> data;
+            std::vector<std::function<void()>> undos; // in the order logged
+        };
+        struct Current {
+            uint32_t offset, size; // in current_data
+            uint64_t stamp; // serial of the last record the object changed in
+        };
+
+        std::vector<Record> records; // ring, oldest at head
+        size_t head, count;
+        uint64_t serial; // of the record being filled
+        uint64_t base_step; // states before the oldest record are from here
+        std::unordered_map<ObjectId, Current> current;
+        std::vector<btScalar> current_data;
+
+        Record& record(size_t i) { return records[(head + i) % records.size()]; }
+        const Record& record(size_t i) const { return records[(head + i) % records.size()]; }
+
+    public:
+        /** Keep steps records, 0 disables the ring */
+        explicit RollbackRing(int steps = 0);
+
+        int capacity() const { return int(records.size()); }
+        bool enabled() const { return !records.empty(); }
+
+        /** Forget everything, the window starts again at step */
+        void reset(uint64_t step);
+        /** State of an object at the step of the last reset */
+        void add(ObjectId id, const btScalar* state, size_t n);
+
+        /** Open a record for step, which is later than any recorded step */
+        void begin(uint64_t step);
+        /** Object appeared during the step of the open record in state */
+        void appear(ObjectId id, const btScalar* state, size_t n);
+        /**
+         * Structural change made during the step of the open record. When
+         * going back past the step, undo is called before the states of the
+         * record are restored, latest change first.
+         */
+        void log_undo(std::function<void()> undo);
+        /**
+         * Object changed during the step of the open record and is now in
+         * state. False if it is unknown or its state size differs, the
+         * window must be reset then.
+         */
+        bool change(ObjectId id, const btScalar* state, size_t n);
+
+        /** Latest state of an object, nullptr if it is unknown */
+        const btScalar* state(ObjectId id) const {
+            auto it = current.find(id);
+            return it == current.end() ? nullptr : &current_data[it->second.offset];
+        }
+
+        /** Object was passed to change since begin */
+        bool changed(ObjectId id) const {
+            auto it = current.find(id);
+            return it != current.end() && it->second.stamp == serial;
+        }
+
+        uint64_t first_step() const { return base_step; }
+        uint64_t last_step() const { return count ? record(count - 1).step : base_step; }
+        /** Step is the reset step or the step of a record */
+        bool has(uint64_t step) const;
+
+        /**
+         * Go back to step: restore(id, state, n) is called with the state at
+         * step of each object changed since, possibly many times for one
+         * object, the oldest state comes last. Records after step are
+         * dropped. False, and nothing called, if has(step) is false.
+         */
+        template <typename F>
+        bool rewind(uint64_t step, F restore) {
+            if (!has(step)) return false;
+            while (count > 0 && record(count - 1).step > step) {
+                Record& r = record(count - 1);
+                for (size_t i = r.undos.size(); i-- > 0;) r.undos[i]();
+                for (size_t i = 0; i < r.ids.size(); i++) {
+                    const btScalar* state = &r.data[r.offsets[i]];
+                    const size_t n = r.offsets[i + 1] - r.offsets[i];
+                    Current& c = current[r.ids[i]];
+                    std::copy(state, state + n, &current_data[c.offset]);
+                    restore(r.ids[i], state, n);
+                }
+                count--;
+            }
+            return true;
+        }
+
+        /** Scalars held by the records, for tuning the window */
+        size_t stored_scalars() const;
+    };
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// SSE2 is always there on x86-64, other targets use the scalar code paths
+
+#if defined(__SSE2__) && !defined(BT_USE_DOUBLE_PRECISION)
+#define PHYSICS_USE_SSE
+#include <emmintrin.h>
+#endif
@@ -0,0 +1,62 @@
+#include "tires.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace physics {
+
+// common longitudinal values for road surfaces, the lateral curve is close
+// enough at this level of detail
+static const TireParams TIRES[TIRE_TYPES] = {
+    { "stock", 0, 0, 0, 0 },
+    { "dry", 10.0f, 1.9f, 0.97f, 1.0f },
+    { "wet", 12.0f, 2.3f, 1.0f, 0.82f },
+    { "snow", 5.0f, 2.0f, 1.0f, 0.3f },
+    { "ice", 4.0f, 2.0f, 1.0f, 0.1f },
+};
+
+const TireParams& tire_params(TireType type) {
+    return TIRES[int(type)];
+}
+
+bool tire_type_by_name(const string& name, TireType& type) {
+    for (int i = 0; i < TIRE_TYPES; i++) {
+        if (name == TIRES[i].name) {
+            type = TireType(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+float tire_formula(TireType type, float slip) {
+    const TireParams& p = tire_params(type);
+    if (type == TireType::Stock) return 0.0f;
+    const float ba = p.b * std::atan(slip);
+    return std::sin(p.c * std::atan(ba - p.e * (ba - std::atan(ba))));
+}
+
+const float* tire_curves() {
+    // the friction coefficient is applied with the load, the curves only
+    // carry the shape
+    static const std::vector<float> curves = [] {
+        std::vector<float> c(TIRE_TYPES * TIRE_SAMPLES);
+        for (int t = 0; t < TIRE_TYPES; t++) {
+            for (int i = 0; i < TIRE_SAMPLES; i++) {
+                c[t * TIRE_SAMPLES + i] = tire_formula(TireType(t), i / TIRE_SLIP_SCALE);
+            }
+        }
+        return c;
+    }();
+    return curves.data();
+}
+
+float tire_force(TireType type, float slip) {
+    const float* curve = tire_curves() + int(type) * TIRE_SAMPLES;
+    const float x = std::min(std::fabs(slip) * TIRE_SLIP_SCALE, float(TIRE_SAMPLES - 1));
+    const int i = std::min(int(x), TIRE_SAMPLES - 2);
+    const float f = curve[i] + (curve[i + 1] - curve[i]) * (x - i);
+    return slip < 0 ? -f : f;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../common.hpp"
+
+namespace physics {
+
+    /**
+     * Tires of a car. Stock is Bullet's own model, grip without limit until
+     * the side impulse hits frictionSlip. The others follow Pacejka's magic
+     * formula for the usual road conditions.
+     */
+    enum class TireType { Stock, Dry, Wet, Snow, Ice };
+    const int TIRE_TYPES = 5;
+
+    /**
+     * Magic formula coefficients, lateral force against slip angle a is
+     * friction * load * sin(c * atan(b*a - e*(b*a - atan(b*a))))
+     */
+    struct TireParams {
+        const char* name;
+        float b, c, e;
+        float friction; // peak, at nominal load
+    };
+
+    const TireParams& tire_params(TireType type);
+    bool tire_type_by_name(const string& name, TireType& type);
+
+    // Curves are baked against the tangent of the slip angle, lateral over
+    // forward speed, so evaluating one takes no trigonometry
+    const int TIRE_SAMPLES = 64;
+    const float TIRE_MAX_SLIP = 1.0f; // 45 degrees at the last sample, flat after
+    const float TIRE_SLIP_SCALE = (TIRE_SAMPLES - 1) / TIRE_MAX_SLIP;
+
+    /** Baked curves of all types after each other, force per load */
+    const float* tire_curves();
+
+    /** Curve of type at slip, interpolated from the baked samples */
+    float tire_force(TireType type, float slip);
+
+    /** Magic formula evaluated directly, what the curves are baked from */
+    float tire_formula(TireType type, float slip);
+}
@@ -0,0 +1,477 @@
+#include "vehicles.hpp"
+#include "simd.hpp"
+
+#include <BulletDynamics/Vehicle/btRaycastVehicle.h>
+#include <BulletCollision/CollisionDispatch/btCollisionWorld.h>
+#include <LinearMath/btAabbUtil2.h>
+
+#include <cmath>
+
+namespace physics {
+
+namespace {
+
+// Four lanes of floats, SSE when available. Comparisons give masks which
+// only select() understands.
+#ifdef PHYSICS_USE_SSE
+struct F4 {
+    __m128 v;
+    F4() {}
+    F4(__m128 v) : v(v) {}
+    F4(float f) : v(_mm_set1_ps(f)) {}
+    static F4 load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+inline F4 operator/(F4 a, F4 b) { return _mm_div_ps(a.v, b.v); }
+inline F4 operator<(F4 a, F4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline F4 operator>(F4 a, F4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline F4 operator>=(F4 a, F4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline F4 operator!=(F4 a, F4 b) { return _mm_cmpneq_ps(a.v, b.v); }
+inline F4 operator&(F4 a, F4 b) { return _mm_and_ps(a.v, b.v); }
+inline F4 operator|(F4 a, F4 b) { return _mm_or_ps(a.v, b.v); }
+inline F4 min(F4 a, F4 b) { return _mm_min_ps(a.v, b.v); }
+inline F4 max(F4 a, F4 b) { return _mm_max_ps(a.v, b.v); }
+inline F4 sqrt(F4 a) { return _mm_sqrt_ps(a.v); }
+inline F4 abs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline F4 select(F4 mask, F4 a, F4 b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+#else
+struct F4 {
+    float v[4];
+    F4() {}
+    F4(float f) { for (int i = 0; i < 4; i++) v[i] = f; }
+    static F4 load(const float* p) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+};
+#define F4_OP(op, expr) \
+    inline F4 op(F4 a, F4 b) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = (expr); return r; }
+F4_OP(operator+, a.v[i] + b.v[i])
+F4_OP(operator-, a.v[i] - b.v[i])
+F4_OP(operator*, a.v[i] * b.v[i])
+F4_OP(operator/, a.v[i] / b.v[i])
+F4_OP(operator<, a.v[i] < b.v[i] ? 1.0f : 0.0f)
+F4_OP(operator>, a.v[i] > b.v[i] ? 1.0f : 0.0f)
+F4_OP(operator>=, a.v[i] >= b.v[i] ? 1.0f : 0.0f)
+F4_OP(operator!=, a.v[i] != b.v[i] ? 1.0f : 0.0f)
+F4_OP(operator&, a.v[i] != 0 && b.v[i] != 0 ? 1.0f : 0.0f)
+F4_OP(operator|, a.v[i] != 0 || b.v[i] != 0 ? 1.0f : 0.0f)
+F4_OP(min, std::min(a.v[i], b.v[i]))
+F4_OP(max, std::max(a.v[i], b.v[i]))
+#undef F4_OP
+inline F4 sqrt(F4 a) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline F4 abs(F4 a) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = std::fabs(a.v[i]); return r; }
+inline F4 select(F4 mask, F4 a, F4 b) {
+    F4 r; for (int i = 0; i < 4; i++) r.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i]; return r;
+}
+#endif
+
+struct V4 {
+    F4 x, y, z;
+    V4() {}
+    V4(F4 x, F4 y, F4 z) : x(x), y(y), z(z) {}
+};
+inline V4 operator+(const V4& a, const V4& b) { return V4(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline V4 operator-(const V4& a, const V4& b) { return V4(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline V4 operator*(const V4& a, F4 s) { return V4(a.x * s, a.y * s, a.z * s); }
+inline F4 dot(const V4& a, const V4& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline V4 cross(const V4& a, const V4& b) {
+    return V4(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+inline V4 normalized(const V4& a) { return a * (F4(1.0f) / sqrt(dot(a, a))); }
+
+/** Collects objects whose boxes overlap the box of the wheel rays of a car */
+struct Nearby : public btBroadphaseAabbCallback {
+    std::vector<btCollisionObject*>& objects;
+    explicit Nearby(std::vector<btCollisionObject*>& objects) : objects(objects) {}
+    virtual bool process(const btBroadphaseProxy* proxy) {
+        objects.push_back(static_cast<btCollisionObject*>(proxy->m_clientObject));
+        return true;
+    }
+};
+
+/**
+ * Closest hit of a ray among objects, what btDefaultVehicleRaycaster gets
+ * from btCollisionWorld::rayTest when the objects are all the ray can reach
+ */
+bool cast_ray(const std::vector<btCollisionObject*>& objects, const btVector3& from,
+        const btVector3& to, btVehicleRaycaster::btVehicleRaycasterResult& result) {
+    btCollisionWorld::ClosestRayResultCallback callback(from, to);
+    const btTransform from_trans(btMatrix3x3::getIdentity(), from);
+    const btTransform to_trans(btMatrix3x3::getIdentity(), to);
+    for (btCollisionObject* obj : objects) {
+        if (callback.m_closestHitFraction == 0) break;
+        const btBroadphaseProxy* proxy = obj->getBroadphaseHandle();
+        if (!callback.needsCollision(const_cast<btBroadphaseProxy*>(proxy))) continue;
+        // the tree broadphase skips objects whose box the ray misses
+        btScalar param = 1;
+        btVector3 normal;
+        if (!btRayAabb(from, to, proxy->m_aabbMin, proxy->m_aabbMax, param, normal)) continue;
+        btCollisionWorld::rayTestSingle(from_trans, to_trans, obj, obj->getCollisionShape(),
+                obj->getWorldTransform(), callback);
+    }
+    if (!callback.hasHit()) return false;
+    // like btDefaultVehicleRaycaster, the closest hit must be a body which responds
+    const btRigidBody* body = btRigidBody::upcast(callback.m_collisionObject);
+    if (!body || !body->hasContactResponse()) return false;
+    result.m_hitPointInWorld = callback.m_hitPointWorld;
+    result.m_hitNormalInWorld = callback.m_hitNormalWorld.normalized();
+    result.m_distFraction = callback.m_closestHitFraction;
+    return true;
+}
+
+// grip drops this much per nominal load of extra load on a tire
+const float LOAD_SENSITIVITY = 0.1f;
+// slip is lateral speed over forward speed, but at least this
+const float SLIP_MIN_SPEED = 1.0f;
+
+}
+
+VehicleBatch::VehicleBatch() : wheel_count(0), curves(tire_curves()) {}
+
+void VehicleBatch::add(btRaycastVehicle* vehicle, TireType tires) {
+    Vehicle v = { vehicle, tires, 0.0f };
+    vehicles.push_back(v);
+}
+
+void VehicleBatch::set_tires(btRaycastVehicle* vehicle, TireType tires) {
+    for (Vehicle& v : vehicles) {
+        if (v.vehicle == vehicle) v.tires = tires;
+    }
+}
+
+void VehicleBatch::remove(btRaycastVehicle* vehicle) {
+    vehicles.erase(std::remove_if(vehicles.begin(), vehicles.end(),
+                [=](const Vehicle& v) { return v.vehicle == vehicle; }),
+            vehicles.end());
+}
+
+/** Wheel transforms, controls and ray casts of all vehicles into lanes */
+void VehicleBatch::gather(btCollisionWorld* world) {
+    wheel_count = 0;
+    for (const Vehicle& v : vehicles) wheel_count += v.vehicle->getNumWheels();
+    const size_t padded = (wheel_count + 3) & ~size_t(3);
+    if (lanes[0].size() < padded) {
+        // unused lanes keep whatever they had, they are never applied, but
+        // a fresh lane must not divide by zero
+        for (auto& lane : lanes) lane.resize(padded, 0.0f);
+        for (Field f : { INV_MASS, MASS, RADIUS }) {
+            std::fill(lanes[f].begin() + wheel_count, lanes[f].end(), 1.0f);
+        }
+    }
+
+    size_t w = 0;
+    for (Vehicle& v : vehicles) {
+        btRaycastVehicle* vehicle = v.vehicle;
+        const btRigidBody* chassis = vehicle->getRigidBody();
+        const btTransform& trans = chassis->getCenterOfMassTransform();
+        const btMatrix3x3& basis = trans.getBasis();
+        const btVector3& com = trans.getOrigin();
+        const btMatrix3x3& inertia = chassis->getInvInertiaTensorWorld();
+        const btVector3 forward = basis.getColumn(vehicle->getForwardAxis());
+        const btScalar inv_mass = chassis->getInvMass();
+        const btVector3& vel = chassis->getLinearVelocity();
+        v.speed = forward.dot(vel) < 0 ? -vel.length() : vel.length();
+        const TireParams& tires = tire_params(v.tires);
+        const btScalar nominal_load = std::max(btScalar(1),
+                chassis->getGravity().length() / inv_mass / vehicle->getNumWheels());
+
+        // one broadphase query for all wheels of the car
+        btVector3 rays_min(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+        btVector3 rays_max = -rays_min;
+        for (int i = 0; i < vehicle->getNumWheels(); i++) {
+            btWheelInfo& wheel = vehicle->getWheelInfo(i);
+            btWheelInfo::RaycastInfo& ray = wheel.m_raycastInfo;
+            ray.m_hardPointWS = trans(wheel.m_chassisConnectionPointCS);
+            ray.m_wheelDirectionWS = basis * wheel.m_wheelDirectionCS;
+            ray.m_wheelAxleWS = basis * wheel.m_wheelAxleCS;
+            const btScalar ray_length = wheel.getSuspensionRestLength() + wheel.m_wheelsRadius;
+            const btVector3 target = ray.m_hardPointWS + ray.m_wheelDirectionWS * ray_length;
+            rays_min.setMin(ray.m_hardPointWS);
+            rays_min.setMin(target);
+            rays_max.setMax(ray.m_hardPointWS);
+            rays_max.setMax(target);
+        }
+        nearby.clear();
+        Nearby collect(nearby);
+        world->getBroadphase()->aabbTest(rays_min, rays_max, collect);
+
+        for (int i = 0; i < vehicle->getNumWheels(); i++, w++) {
+            btWheelInfo& wheel = vehicle->getWheelInfo(i);
+            field(INV_MASS)[w] = inv_mass;
+            field(MASS)[w] = 1 / inv_mass;
+            field(I00)[w] = inertia[0][0]; field(I01)[w] = inertia[0][1]; field(I02)[w] = inertia[0][2];
+            field(I11)[w] = inertia[1][1]; field(I12)[w] = inertia[1][2]; field(I22)[w] = inertia[2][2];
+            field(FWD_X)[w] = forward.x(); field(FWD_Y)[w] = forward.y(); field(FWD_Z)[w] = forward.z();
+
+            field(RADIUS)[w] = wheel.m_wheelsRadius;
+            field(REST)[w] = wheel.getSuspensionRestLength();
+            field(TRAVEL)[w] = wheel.m_maxSuspensionTravelCm * 0.01f;
+            field(STIFFNESS)[w] = wheel.m_suspensionStiffness;
+            field(DAMP_COMPRESSION)[w] = wheel.m_wheelsDampingCompression;
+            field(DAMP_RELAXATION)[w] = wheel.m_wheelsDampingRelaxation;
+            field(MAX_FORCE)[w] = wheel.m_maxSuspensionForce;
+            field(SLIP)[w] = wheel.m_frictionSlip;
+            // only the world up component of the side impulse lever is
+            // scaled, like btRaycastVehicle does without ROLLING_INFLUENCE_FIX
+            const int up = vehicle->getUpAxis();
+            field(ROLL_X)[w] = up == 0 ? wheel.m_rollInfluence : 1.0f;
+            field(ROLL_Y)[w] = up == 1 ? wheel.m_rollInfluence : 1.0f;
+            field(ROLL_Z)[w] = up == 2 ? wheel.m_rollInfluence : 1.0f;
+            field(ENGINE)[w] = wheel.m_engineForce;
+            field(BRAKE)[w] = wheel.m_brake;
+            field(STEER_SIN)[w] = std::sin(wheel.m_steering);
+            field(STEER_COS)[w] = std::cos(wheel.m_steering);
+            field(DELTA_ROTATION)[w] = wheel.m_deltaRotation;
+            field(TIRE)[w] = v.tires == TireType::Stock ? 0.0f : 1.0f;
+            field(CURVE)[w] = int(v.tires) * TIRE_SAMPLES;
+            field(GRIP)[w] = tires.friction;
+            field(NOMINAL_LOAD)[w] = nominal_load;
+
+            btWheelInfo::RaycastInfo& ray = wheel.m_raycastInfo;
+            ray.m_isInContact = false;
+            ray.m_groundObject = nullptr;
+
+            const btScalar ray_length = wheel.getSuspensionRestLength() + wheel.m_wheelsRadius;
+            const btVector3& source = ray.m_hardPointWS;
+            ray.m_contactPointWS = source + ray.m_wheelDirectionWS * ray_length;
+            btVehicleRaycaster::btVehicleRaycasterResult result;
+            if (cast_ray(nearby, source, ray.m_contactPointWS, result)) {
+                ray.m_isInContact = true;
+                ray.m_groundObject = &getFixedBody();
+                ray.m_contactPointWS = result.m_hitPointInWorld;
+                ray.m_contactNormalWS = result.m_hitNormalInWorld;
+                field(HIT)[w] = 1.0f;
+                field(HIT_DISTANCE)[w] = result.m_distFraction * ray_length;
+            } else {
+                ray.m_contactNormalWS = -ray.m_wheelDirectionWS;
+                field(HIT)[w] = 0.0f;
+                field(HIT_DISTANCE)[w] = ray_length;
+            }
+
+            const btVector3 hard = ray.m_hardPointWS - com;
+            const btVector3 contact = ray.m_contactPointWS - com;
+            field(HARD_X)[w] = hard.x(); field(HARD_Y)[w] = hard.y(); field(HARD_Z)[w] = hard.z();
+            field(CONTACT_X)[w] = contact.x(); field(CONTACT_Y)[w] = contact.y(); field(CONTACT_Z)[w] = contact.z();
+            const btVector3& dir = ray.m_wheelDirectionWS;
+            field(DIR_X)[w] = dir.x(); field(DIR_Y)[w] = dir.y(); field(DIR_Z)[w] = dir.z();
+            const btVector3& axle = ray.m_wheelAxleWS;
+            field(AXLE_X)[w] = axle.x(); field(AXLE_Y)[w] = axle.y(); field(AXLE_Z)[w] = axle.z();
+            const btVector3& normal = ray.m_contactNormalWS;
+            field(NORMAL_X)[w] = normal.x(); field(NORMAL_Y)[w] = normal.y(); field(NORMAL_Z)[w] = normal.z();
+        }
+    }
+    gather_velocities();
+}
+
+void VehicleBatch::gather_velocities() {
+    size_t w = 0;
+    for (const Vehicle& v : vehicles) {
+        const btRigidBody* chassis = v.vehicle->getRigidBody();
+        const btVector3& lin = chassis->getLinearVelocity();
+        const btVector3& ang = chassis->getAngularVelocity();
+        for (int i = 0; i < v.vehicle->getNumWheels(); i++, w++) {
+            field(VX)[w] = lin.x(); field(VY)[w] = lin.y(); field(VZ)[w] = lin.z();
+            field(WX)[w] = ang.x(); field(WY)[w] = ang.y(); field(WZ)[w] = ang.z();
+        }
+    }
+}
+
+/**
+ * Sum impulses of the wheels of each car and apply them to the chassis
+ *
+ * Same as applying them one wheel at a time, since nothing reads the
+ * velocity in between.
+ */
+void VehicleBatch::apply_impulses() {
+    size_t w = 0;
+    for (const Vehicle& v : vehicles) {
+        btVector3 impulse(0, 0, 0), torque(0, 0, 0);
+        for (int i = 0; i < v.vehicle->getNumWheels(); i++, w++) {
+            impulse += btVector3(field(IMPULSE_X)[w], field(IMPULSE_Y)[w], field(IMPULSE_Z)[w]);
+            torque += btVector3(field(TORQUE_X)[w], field(TORQUE_Y)[w], field(TORQUE_Z)[w]);
+        }
+        btRigidBody* chassis = v.vehicle->getRigidBody();
+        chassis->applyCentralImpulse(impulse);
+        chassis->applyTorqueImpulse(torque);
+    }
+    gather_velocities();
+}
+
+void VehicleBatch::write_back() {
+    size_t w = 0;
+    for (const Vehicle& v : vehicles) {
+        for (int i = 0; i < v.vehicle->getNumWheels(); i++, w++) {
+            btWheelInfo& wheel = v.vehicle->getWheelInfo(i);
+            wheel.m_raycastInfo.m_suspensionLength = field(LENGTH)[w];
+            wheel.m_suspensionRelativeVelocity = field(REL_VEL)[w];
+            wheel.m_clippedInvContactDotSuspension = field(CLIPPED)[w];
+            wheel.m_wheelsSuspensionForce = field(FORCE)[w];
+            wheel.m_skidInfo = field(SKID)[w];
+            wheel.m_rotation += field(SPIN)[w];
+            wheel.m_deltaRotation = field(DELTA_ROTATION)[w];
+        }
+    }
+}
+
+void VehicleBatch::update(btCollisionWorld* world, float dt) {
+    gather(world);
+    const size_t padded = (wheel_count + 3) & ~size_t(3);
+    const F4 step(dt);
+    const F4 zero(0.0f), one(1.0f);
+
+#define LOAD(f) F4::load(field(f) + i)
+#define LOAD3(f) V4(LOAD(f##_X), LOAD(f##_Y), LOAD(f##_Z))
+#define STORE3(f, value) do { const V4 v_ = (value); \
+        v_.x.store(field(f##_X) + i); v_.y.store(field(f##_Y) + i); v_.z.store(field(f##_Z) + i); } while (0)
+
+    // inverse world inertia times a, the tensor is symmetric
+    auto inertia_times = [&](size_t i, const V4& a) {
+        const F4 i00 = LOAD(I00), i01 = LOAD(I01), i02 = LOAD(I02);
+        const F4 i11 = LOAD(I11), i12 = LOAD(I12), i22 = LOAD(I22);
+        return V4(i00 * a.x + i01 * a.y + i02 * a.z,
+                i01 * a.x + i11 * a.y + i12 * a.z,
+                i02 * a.x + i12 * a.y + i22 * a.z);
+    };
+    auto velocity_at = [&](size_t i, const V4& rel) {
+        return V4(LOAD(VX), LOAD(VY), LOAD(VZ)) + cross(V4(LOAD(WX), LOAD(WY), LOAD(WZ)), rel);
+    };
+    // tire curve of each lane at slip, interpolated
+    auto curve_at = [&](size_t i, F4 slip) {
+        float x[4], out[4];
+        min(slip * F4(TIRE_SLIP_SCALE), F4(float(TIRE_SAMPLES - 1))).store(x);
+        for (int k = 0; k < 4; k++) {
+            const int j = std::min(int(x[k]), TIRE_SAMPLES - 2);
+            const float* c = curves + int(field(CURVE)[i + k]) + j;
+            out[k] = c[0] + (c[1] - c[0]) * (x[k] - j);
+        }
+        return F4::load(out);
+    };
+    auto denominator = [&](size_t i, const V4& rel, const V4& dir) {
+        const V4 c = cross(rel, dir);
+        return LOAD(INV_MASS) + dot(c, inertia_times(i, c));
+    };
+
+    // suspension, see rayCast and updateSuspension of btRaycastVehicle
+    for (size_t i = 0; i < padded; i += 4) {
+        const F4 hit = LOAD(HIT) != zero;
+        const F4 rest = LOAD(REST), travel = LOAD(TRAVEL);
+        const F4 length = select(hit,
+                min(max(LOAD(HIT_DISTANCE) - LOAD(RADIUS), rest - travel), rest + travel),
+                rest);
+
+        const V4 normal = LOAD3(NORMAL);
+        const V4 contact = LOAD3(CONTACT);
+        const F4 denom = dot(normal, LOAD3(DIR));
+        const F4 proj_vel = dot(normal, velocity_at(i, contact));
+        const F4 steep = denom >= F4(-0.1f);
+        const F4 inv = F4(-1.0f) / denom;
+        const F4 rel_vel = select(hit, select(steep, zero, proj_vel * inv), zero);
+        const F4 clipped = select(hit, select(steep, F4(10.0f), inv), one);
+
+        F4 force = LOAD(STIFFNESS) * (rest - length) * clipped;
+        force = force - select(rel_vel < zero, LOAD(DAMP_COMPRESSION), LOAD(DAMP_RELAXATION)) * rel_vel;
+        force = select(hit, max(force * LOAD(MASS), zero), zero);
+
+        const V4 impulse = normal * (min(force, LOAD(MAX_FORCE)) * step);
+        length.store(field(LENGTH) + i);
+        rel_vel.store(field(REL_VEL) + i);
+        clipped.store(field(CLIPPED) + i);
+        force.store(field(FORCE) + i);
+        STORE3(IMPULSE, impulse);
+        STORE3(TORQUE, cross(contact, impulse));
+    }
+    apply_impulses();
+
+    // friction, see updateFriction of btRaycastVehicle
+    for (size_t i = 0; i < padded; i += 4) {
+        const F4 hit = LOAD(HIT) != zero;
+        const V4 normal = LOAD3(NORMAL);
+        const V4 contact = LOAD3(CONTACT);
+
+        // axle of the steered wheel, flattened to the ground
+        const V4 up = LOAD3(DIR) * F4(-1.0f);
+        const V4 axle0 = LOAD3(AXLE);
+        const F4 s = LOAD(STEER_SIN), c = LOAD(STEER_COS);
+        const V4 steered = axle0 * c + cross(up, axle0) * s + up * (dot(up, axle0) * (one - c));
+        const V4 axle = normalized(steered - normal * dot(steered, normal));
+        const V4 forward = normalized(cross(normal, axle));
+
+        const V4 vel = velocity_at(i, contact);
+        const F4 lateral = dot(axle, vel);
+        const F4 side_denom = denominator(i, contact, axle);
+        const F4 stock_side = select(hit, F4(-0.2f) * lateral / side_denom, zero);
+
+        const F4 brake = LOAD(BRAKE), engine = LOAD(ENGINE);
+        const F4 braking = min(max(zero - dot(forward, vel) / denominator(i, contact, forward),
+                    zero - brake), brake);
+        const F4 rolling = select(hit, select(engine != zero, engine * step, braking), zero);
+
+        // stock: the wheel slides when the impulses exceed frictionSlip
+        const F4 load = LOAD(FORCE);
+        const F4 max_impulse = load * step * LOAD(SLIP);
+        const F4 x = rolling * F4(0.5f);
+        const F4 squared = x * x + stock_side * stock_side;
+        const F4 stock_skid = select(hit & (squared > max_impulse * max_impulse),
+                max_impulse / sqrt(squared), one);
+        const F4 scaled = (stock_side != zero) & (stock_skid < one);
+
+        // tires: side grip from the curve at the current slip, never more
+        // than stops the sideways motion, and everything within the grip
+        const F4 load_factor = max(one - F4(LOAD_SENSITIVITY) * (load / LOAD(NOMINAL_LOAD) - one), F4(0.5f));
+        const F4 grip = LOAD(GRIP) * load_factor * load * step;
+        const F4 slip = abs(lateral) / max(abs(dot(forward, vel)), F4(SLIP_MIN_SPEED));
+        const F4 stop = abs(lateral) / side_denom;
+        const F4 tire_grip = min(grip * curve_at(i, slip), stop);
+        const F4 tire_side = select(hit, select(lateral > zero, zero - tire_grip, tire_grip), zero);
+        const F4 tire_squared = rolling * rolling + tire_side * tire_side;
+        const F4 tire_scale = select(tire_squared > grip * grip, grip / sqrt(tire_squared), one);
+        // sliding when stopping the wheel would take more than the grip
+        const F4 wanted = rolling * rolling + stop * stop;
+        const F4 tire_skid = select(hit & (wanted > grip * grip), grip / sqrt(wanted), one);
+
+        const F4 tire = LOAD(TIRE) != zero;
+        const F4 skid = select(tire, tire_skid, stock_skid);
+        const F4 factor = select(tire, tire_scale, select(scaled, stock_skid, one));
+        const F4 side = select(tire, tire_side, stock_side) * factor;
+        const F4 forward_rolling = rolling * factor;
+
+        const V4 forward_impulse = forward * forward_rolling;
+        const V4 side_impulse = axle * side;
+        const V4 lever(contact.x * LOAD(ROLL_X), contact.y * LOAD(ROLL_Y), contact.z * LOAD(ROLL_Z));
+        skid.store(field(SKID) + i);
+        STORE3(IMPULSE, forward_impulse + side_impulse);
+        STORE3(TORQUE, cross(contact, forward_impulse) + cross(lever, side_impulse));
+    }
+    apply_impulses();
+
+    // wheel spin, see the end of updateVehicle
+    for (size_t i = 0; i < padded; i += 4) {
+        const F4 hit = LOAD(HIT) != zero;
+        const V4 normal = LOAD3(NORMAL);
+        V4 forward = LOAD3(FWD);
+        forward = forward - normal * dot(forward, normal);
+        const F4 rolled = dot(forward, velocity_at(i, LOAD3(HARD))) * step / LOAD(RADIUS);
+        const F4 spin = select(hit, rolled, LOAD(DELTA_ROTATION));
+        spin.store(field(SPIN) + i);
+        // damping of rotation when not in contact
+        (spin * F4(0.99f)).store(field(DELTA_ROTATION) + i);
+    }
+
+#undef LOAD
+#undef LOAD3
+#undef STORE3
+    write_back();
+}
+
+float VehicleBatch::speed(const btRaycastVehicle* vehicle) const {
+    for (const Vehicle& v : vehicles) {
+        if (v.vehicle == vehicle) return v.speed;
+    }
+    return 0.0f;
+}
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../common.hpp"
+#include "tires.hpp"
+#include <BulletDynamics/Dynamics/btActionInterface.h>
+#include <vector>
+
+class btRaycastVehicle;
+class btCollisionObject;
+class btCollisionWorld;
+
+namespace physics {
+
+    /**
+     * Updates all raycast vehicles of a world as one action
+     *
+     * Does the same as btRaycastVehicle::updateVehicle for every car, but
+     * wheel state of all cars is gathered into structure of arrays and the
+     * suspension, friction and wheel spin are solved four wheels at a time
+     * with SSE. The broadphase is asked once per car for what its wheel
+     * rays can reach, then each ray is tested against those objects only,
+     * with the same hits btDefaultVehicleRaycaster would give. Chassis
+     * impulses stay per car.
+     *
+     * Cars with tires other than stock get side grip from the baked curve of
+     * their tire type instead of Bullet's side impulse, and side and forward
+     * impulses together are limited by the grip of the tire under its load.
+     *
+     * Vehicles keep their btRaycastVehicle for wheel setup and control, the
+     * batch reads inputs from its wheel infos and writes results back there,
+     * so the vehicle itself must not be added to the world as an action.
+     */
+    class VehicleBatch : public btActionInterface, NoCopy {
+        enum Field {
+            // chassis of the wheel
+            VX, VY, VZ, WX, WY, WZ, INV_MASS, MASS,
+            I00, I01, I02, I11, I12, I22, // inverse world inertia, symmetric
+            FWD_X, FWD_Y, FWD_Z, // chassis forward axis
+            // wheel setup and controls
+            RADIUS, REST, TRAVEL, STIFFNESS, DAMP_COMPRESSION, DAMP_RELAXATION,
+            MAX_FORCE, SLIP, ROLL_X, ROLL_Y, ROLL_Z, ENGINE, BRAKE, STEER_SIN, STEER_COS,
+            TIRE, CURVE, GRIP, NOMINAL_LOAD, // tire model, TIRE is 0 for stock
+            // ray cast, positions are relative to chassis center of mass
+            HARD_X, HARD_Y, HARD_Z, DIR_X, DIR_Y, DIR_Z, AXLE_X, AXLE_Y, AXLE_Z,
+            CONTACT_X, CONTACT_Y, CONTACT_Z, NORMAL_X, NORMAL_Y, NORMAL_Z,
+            HIT, HIT_DISTANCE,
+            // results
+            LENGTH, REL_VEL, CLIPPED, FORCE, SKID, SPIN, DELTA_ROTATION,
+            IMPULSE_X, IMPULSE_Y, IMPULSE_Z, TORQUE_X, TORQUE_Y, TORQUE_Z,
+            FIELDS
+        };
+
+        struct Vehicle {
+            btRaycastVehicle* vehicle;
+            TireType tires;
+            float speed;
+        };
+
+        std::vector<Vehicle> vehicles;
+        // per wheel in order of vehicles, padded to a multiple of 4
+        std::vector<float> lanes[FIELDS];
+        size_t wheel_count;
+        const float* curves;
+        std::vector<btCollisionObject*> nearby; // what the rays of a car can hit
+
+        float* field(Field f) { return lanes[f].data(); }
+        void gather(btCollisionWorld* world);
+        void gather_velocities();
+        void apply_impulses();
+        void write_back();
+
+    public:
+        VehicleBatch();
+
+        void add(btRaycastVehicle* vehicle, TireType tires = TireType::Stock);
+        void remove(btRaycastVehicle* vehicle);
+        void set_tires(btRaycastVehicle* vehicle, TireType tires);
+        size_t size() const { return vehicles.size(); }
+
+        /**
+         * Signed chassis speed in m/s at the start of the last update, what
+         * getCurrentSpeedKmHour of the vehicle would say
+         */
+        float speed(const btRaycastVehicle* vehicle) const;
+
+        /** Step all vehicles of world, same as updateVehicle of each */
+        void update(btCollisionWorld* world, float dt);
+
+        virtual void updateAction(btCollisionWorld* world, btScalar dt) { update(world, dt); }
+        virtual void debugDraw(btIDebugDraw*) {}
+    };
+}
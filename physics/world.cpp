@@ -1,107 +1,2089 @@
 #include "world.hpp"
 
 #include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <LinearMath/btPoolAllocator.h>
+#include <BulletDynamics/Featherstone/btMultiBody.h>
+#include <BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h>
+#include <BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h>
+#include <BulletDynamics/Featherstone/btMultiBodyLinkCollider.h>
+#include <LinearMath/btTransformUtil.h>
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cmath>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <algorithm>
+#include <iterator>
 
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
 
 #include "../util/task_list.hpp"
+#include "box_box.hpp"
+#include "debris.hpp"
+#include "hull.hpp"
+#include "fracture.hpp"
+#include "governor.hpp"
+#include "hash_grid.hpp"
+#include "recorder.hpp"
+#include "rollback.hpp"
+#include "simd.hpp"
+#include "vehicles.hpp"
 
 namespace physics {
 
+// ids of bodies created from debris, far above ids given by the game
+const ObjectId DEBRIS_ID_BASE = ObjectId(1) << 62;
+// ids of piles, between game ids and debris ids
+const ObjectId PILE_ID_BASE = ObjectId(1) << 61;
+
+inline bool is_pile_id(ObjectId id) {
+    return id >= PILE_ID_BASE && id < DEBRIS_ID_BASE;
+}
+
 enum Status_ {
     Idle, Running, Stopping
 };
 typedef std::atomic<Status_> Status;
 
-inline glm::mat4 transform_to_matrix(btTransform transform) {
-    glm::mat4 res;
-    transform.getOpenGLMatrix(glm::value_ptr(res));
-    return res;
+inline void set_object_id(btCollisionObject* obj, ObjectId id) {
+    obj->setUserPointer(reinterpret_cast<void*>(uintptr_t(id)));
+}
+inline ObjectId get_object_id(const btCollisionObject* obj) {
+    return ObjectId(reinterpret_cast<uintptr_t>(obj->getUserPointer()));
+}
+
+inline btVector3 to_bt(const glm::vec3& v) {
+    return btVector3(v.x, v.y, v.z);
 }
 
-struct MotionState : public btMotionState {
-    MotionState(btTransform t, ObjectId id, World* w) : transform(t), object_id(id), world(w) {}
-    virtual ~MotionState() {}
+/**
+ * Convert a Bullet transform into a column-major glm matrix
+ *
+ * Same result as btTransform::getOpenGLMatrix: basis rows are transposed
+ * into the first three columns and origin goes to the last one.
+ */
+inline void transform_to_matrix(const btTransform& transform, glm::mat4& out) {
+#ifdef PHYSICS_USE_SSE
+    const btMatrix3x3& basis = transform.getBasis();
+    __m128 c0 = _mm_loadu_ps(basis[0].m_floats);
+    __m128 c1 = _mm_loadu_ps(basis[1].m_floats);
+    __m128 c2 = _mm_loadu_ps(basis[2].m_floats);
+    __m128 c3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    // c3 now holds the unused w lanes of the basis rows, replace it with origin
+    const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    c3 = _mm_or_ps(
+            _mm_and_ps(_mm_loadu_ps(transform.getOrigin().m_floats), xyz_mask),
+            _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+    float* dst = glm::value_ptr(out);
+    _mm_storeu_ps(dst, c0);
+    _mm_storeu_ps(dst + 4, c1);
+    _mm_storeu_ps(dst + 8, c2);
+    _mm_storeu_ps(dst + 12, c3);
+#else
+    transform.getOpenGLMatrix(glm::value_ptr(out));
+#endif
+}
 
-    btTransform transform;
-    ObjectId object_id;
-    World* world;
+/** Move a pose matrix by -offset */
+inline void shift_matrix(glm::mat4& m, const glm::vec3& offset) {
+    m[3] -= glm::vec4(offset, 0.0f);
+}
+
+/**
+ * Poses of the bodies which moved during the last step
+ *
+ * Storage only grows, so exporting a step does not allocate.
+ */
+struct PoseBuffer {
+    std::vector<ObjectId> ids;
+    std::vector<glm::mat4> transforms;
+    size_t count;
+
+    PoseBuffer() : count(0) {}
+
+    void reserve(size_t n) {
+        if (ids.size() < n) {
+            ids.resize(n);
+            transforms.resize(n);
+        }
+    }
+};
+
+/**
+ * Dynamics world with access to its array of non-static bodies
+ *
+ * Also simulates Featherstone multibodies, their links are collision
+ * objects but not rigid bodies.
+ */
+struct DynamicsWorld : public btMultiBodyDynamicsWorld {
+    DynamicsWorld(btDispatcher* dispatcher, btBroadphaseInterface* broadphase,
+            btMultiBodyConstraintSolver* solver, btCollisionConfiguration* config)
+        : btMultiBodyDynamicsWorld(dispatcher, broadphase, solver, config) {}
 
-    virtual void getWorldTransform(btTransform& worldTrans) const {
-        worldTrans = transform;
+    btAlignedObjectArray<btRigidBody*>& bodies() {
+        return m_nonStaticRigidBodies;
     }
-    virtual void setWorldTransform(const btTransform& worldTrans) {
-        transform = worldTrans;
-        world->update_change(object_id, transform_to_matrix(transform));
+
+    btAlignedObjectArray<btMultiBody*>& multi_bodies() {
+        return m_multiBodies;
+    }
+
+    // allocations are counted by the phase of the step
+    virtual void performDiscreteCollisionDetection() {
+        AllocScope scope(AllocCategory::Collision);
+        btMultiBodyDynamicsWorld::performDiscreteCollisionDetection();
+    }
+
+    virtual void solveConstraints(btContactSolverInfo& info) {
+        AllocScope scope(AllocCategory::Solver);
+        btMultiBodyDynamicsWorld::solveConstraints(info);
+    }
+
+    /**
+     * Write poses of all active bodies to out, or of all bodies including
+     * sleeping and frozen ones, replaces the old contents
+     */
+    void export_poses(PoseBuffer& out, bool all = false) {
+        size_t total = m_nonStaticRigidBodies.size();
+        for (int i = 0; i < m_multiBodies.size(); i++) {
+            total += m_multiBodies[i]->getNumLinks() + 1;
+        }
+        out.reserve(total);
+        size_t n = 0;
+        for (int i = 0; i < m_nonStaticRigidBodies.size(); i++) {
+            export_pose(m_nonStaticRigidBodies[i], out, n, all);
+        }
+        for (int i = 0; i < m_multiBodies.size(); i++) {
+            btMultiBody* multi_body = m_multiBodies[i];
+            export_pose(multi_body->getBaseCollider(), out, n, all);
+            for (int link = 0; link < multi_body->getNumLinks(); link++) {
+                export_pose(multi_body->getLink(link).m_collider, out, n, all);
+            }
+        }
+        out.count = n;
+    }
+
+    static void export_pose(const btCollisionObject* obj, PoseBuffer& out, size_t& n, bool all) {
+        if (!obj || !(all || obj->isActive())) return;
+        out.ids[n] = get_object_id(obj);
+        transform_to_matrix(obj->getWorldTransform(), out.transforms[n]);
+        n++;
     }
 };
 
+// collision filter groups, the first ones are Bullet defaults
+const short GROUP_DEFAULT = btBroadphaseProxy::DefaultFilter;
+const short GROUP_DEBRIS = btBroadphaseProxy::DebrisFilter;
+const short GROUP_CARGO = 64;
+const short GROUP_VEHICLE = 128;
+
+inline short category_group(Category category) {
+    switch (category) {
+        case Category::Debris: return GROUP_DEBRIS;
+        case Category::Cargo: return GROUP_CARGO;
+        case Category::Vehicle: return GROUP_VEHICLE;
+        default: return GROUP_DEFAULT;
+    }
+}
+
+inline short category_mask(Category category) {
+    const short all = btBroadphaseProxy::AllFilter;
+    switch (category) {
+        case Category::Debris: return all & ~GROUP_DEBRIS;
+        case Category::Cargo: return all & ~GROUP_CARGO;
+        default: return all;
+    }
+}
+
+// rigid body state for rolling back: basis, origin, velocities, activation
+const size_t BODY_STATE = 20;
+
+inline void save_transform(const btTransform& trans, std::vector<btScalar>& out) {
+    const btMatrix3x3& basis = trans.getBasis();
+    for (int r = 0; r < 3; r++) {
+        out.insert(out.end(), basis[r].m_floats, basis[r].m_floats + 3);
+    }
+    out.insert(out.end(), trans.getOrigin().m_floats, trans.getOrigin().m_floats + 3);
+}
+
+inline btTransform load_transform(const btScalar* in) {
+    return btTransform(btMatrix3x3(in[0], in[1], in[2], in[3], in[4], in[5], in[6], in[7], in[8]),
+            btVector3(in[9], in[10], in[11]));
+}
+
+inline void save_body(const btRigidBody* body, std::vector<btScalar>& out) {
+    save_transform(body->getWorldTransform(), out);
+    const btVector3& lin = body->getLinearVelocity();
+    const btVector3& ang = body->getAngularVelocity();
+    out.insert(out.end(), lin.m_floats, lin.m_floats + 3);
+    out.insert(out.end(), ang.m_floats, ang.m_floats + 3);
+    out.push_back(btScalar(body->getActivationState()));
+    out.push_back(body->getDeactivationTime());
+}
+
+inline const btScalar* load_body(btRigidBody* body, const btScalar* in) {
+    const btTransform trans = load_transform(in);
+    const btVector3 lin(in[12], in[13], in[14]), ang(in[15], in[16], in[17]);
+    body->setWorldTransform(trans);
+    body->setInterpolationWorldTransform(trans);
+    body->setLinearVelocity(lin);
+    body->setAngularVelocity(ang);
+    body->setInterpolationLinearVelocity(lin);
+    body->setInterpolationAngularVelocity(ang);
+    body->updateInertiaTensor();
+    body->clearForces();
+    body->forceActivationState(int(in[18]));
+    body->setDeactivationTime(in[19]);
+    return in + BODY_STATE;
+}
+
 struct PObj {
     virtual ~PObj() {};
     virtual void remove_from_world(btDiscreteDynamicsWorld* world) = 0;
+    /** Take object out of simulation (or back) without removing it */
+    virtual void set_frozen(btDiscreteDynamicsWorld*, bool) {}
+    /** Append state for rolling back to out, nothing for objects which never move */
+    virtual void save_state(std::vector<btScalar>&) const {}
+    /** Put back a state written by save_state, contacts and AABBs are left stale */
+    virtual void load_state(const btScalar*) {}
 };
 
-struct Cube : public PObj {
-    unique_ptr<btBoxShape> shape;
-    unique_ptr<MotionState> state;
+/** Single rigid body, shape is owned by the ShapeCache */
+struct Body : public PObj {
+    btCollisionShape* shape;
     unique_ptr<btRigidBody> body;
+    ObjectId pile; // pile the body is merged into, 0 when simulated on its own
+    int sleep_checks; // pile checks passed asleep in a row
 
-    virtual ~Cube() {}
+    Body() : pile(0), sleep_checks(0) {}
+    virtual ~Body() {}
     virtual void remove_from_world(btDiscreteDynamicsWorld* world) {
         world->removeRigidBody(body.get());
     }
+    virtual void set_frozen(btDiscreteDynamicsWorld*, bool frozen) {
+        if (frozen) {
+            body->forceActivationState(DISABLE_SIMULATION);
+        } else {
+            body->forceActivationState(ACTIVE_TAG);
+            body->activate();
+        }
+    }
+    virtual void save_state(std::vector<btScalar>& out) const {
+        // members of a pile are out of the world, the pile has the state
+        if (!pile) save_body(body.get(), out);
+    }
+    virtual void load_state(const btScalar* in) {
+        load_body(body.get(), in);
+    }
+};
+/**
+ * Settled bodies fused into one compound body
+ *
+ * Members stay in the object map but are out of the world, their poses
+ * follow the pile. Splitting puts them back where the pile has moved them.
+ * Destructibles are piles too, built from prefractured fragments which
+ * break off when hit harder than strength.
+ */
+struct Pile : public Body {
+    unique_ptr<btCompoundShape> compound;
+    std::vector<ObjectId> members; // same order as compound children
+    short group, mask;
+    btScalar member_mass; // average
+    btScalar strength; // impulse which breaks a destructible, 0 for piles
+    btScalar fragment_size; // typical half extent of a fragment
+
+    Pile() : strength(0), fragment_size(0) {}
+    virtual ~Pile() {}
+};
+
+/** What a pile was made of before a split, for putting it back together */
+struct PileLayout {
+    std::vector<ObjectId> members;
+    std::vector<btTransform> children; // of the compound, same order as members
+    short group, mask;
+    btScalar strength, fragment_size;
 };
+
 struct Car : public PObj {
     btRaycastVehicle::btVehicleTuning tuning;
-    unique_ptr<MotionState> state;
     unique_ptr<btCollisionShape> chassis_shape;
     unique_ptr<btCompoundShape> compound;
     unique_ptr<btRigidBody> chassis;
-    unique_ptr<btVehicleRaycaster> ray_caster;
+    unique_ptr<btVehicleRaycaster> ray_caster; // the vehicle wants one, the batch casts its rays
     unique_ptr<btRaycastVehicle> vehicle;
+    VehicleBatch* batch; // updates the vehicle instead of the world
+    TireType tires;
+    btScalar wheel_width;
 
     virtual ~Car() {}
     virtual void remove_from_world(btDiscreteDynamicsWorld* world) {
-        world->removeVehicle(vehicle.get());
+        batch->remove(vehicle.get());
         world->removeRigidBody(chassis.get());
     }
+    virtual void set_frozen(btDiscreteDynamicsWorld*, bool frozen) {
+        // the batch would keep pushing impulses into a frozen chassis
+        if (frozen) {
+            batch->remove(vehicle.get());
+            chassis->forceActivationState(DISABLE_SIMULATION);
+        } else {
+            chassis->forceActivationState(DISABLE_DEACTIVATION);
+            batch->add(vehicle.get(), tires);
+        }
+    }
+    virtual void save_state(std::vector<btScalar>& out) const {
+        save_body(chassis.get(), out);
+        for (int i = 0; i < vehicle->getNumWheels(); i++) {
+            const btWheelInfo& w = vehicle->getWheelInfo(i);
+            out.insert(out.end(), { w.m_rotation, w.m_deltaRotation, w.m_engineForce, w.m_brake,
+                    w.m_steering, w.m_raycastInfo.m_suspensionLength, w.m_skidInfo });
+        }
+    }
+    virtual void load_state(const btScalar* in) {
+        in = load_body(chassis.get(), in);
+        for (int i = 0; i < vehicle->getNumWheels(); i++, in += 7) {
+            btWheelInfo& w = vehicle->getWheelInfo(i);
+            w.m_rotation = in[0];
+            w.m_deltaRotation = in[1];
+            w.m_engineForce = in[2];
+            w.m_brake = in[3];
+            w.m_steering = in[4];
+            w.m_raycastInfo.m_suspensionLength = in[5];
+            w.m_skidInfo = in[6];
+        }
+    }
+
+    /**
+     * Write wheel transforms scaled to wheel size to out
+     *
+     * Same pose as btRaycastVehicle::updateWheelTransform but from the
+     * current chassis transform, and without resetting the contact state
+     * of the wheels.
+     */
+    void export_wheels(ObjectId id, PoseBuffer& out, size_t& n) const {
+        const btTransform& chassis_trans = chassis->getWorldTransform();
+        const btMatrix3x3& basis = chassis_trans.getBasis();
+        for (int i = 0; i < vehicle->getNumWheels(); i++) {
+            const btWheelInfo& info = vehicle->getWheelInfo(i);
+            const btVector3 down = basis * info.m_wheelDirectionCS;
+            const btVector3 right = basis * info.m_wheelAxleCS;
+            const btVector3 forward = (-down).cross(right).normalized();
+            const btMatrix3x3 wheel_basis(
+                    right.x(), forward.x(), -down.x(),
+                    right.y(), forward.y(), -down.y(),
+                    right.z(), forward.z(), -down.z());
+            const btMatrix3x3 steering(btQuaternion(-down, info.m_steering));
+            const btMatrix3x3 rotation(btQuaternion(right, -info.m_rotation));
+            const btVector3 origin = chassis_trans(info.m_chassisConnectionPointCS)
+                + down * info.m_raycastInfo.m_suspensionLength;
+            const btScalar r = info.m_wheelsRadius;
+            btTransform trans((steering * rotation * wheel_basis).scaled(btVector3(wheel_width / 2, r, r)), origin);
+            out.ids[n] = id;
+            transform_to_matrix(trans, out.transforms[n]);
+            n++;
+        }
+    }
 };
 
+/**
+ * Box moved along a keyframed path by the physics thread
+ *
+ * Bullet does not integrate kinematic bodies. Before each substep the box
+ * is put where the path is at the start of the substep, with the velocity
+ * that takes it to the next point, so contacts see the real motion.
+ */
+struct Kinematic : public PObj {
+    unique_ptr<btRigidBody> body;
+    std::vector<Keyframe> keys;
+    std::vector<btQuaternion> rotations; // of keys
+    bool loop;
+    btScalar time; // on the path, at the start of the next substep
+
+    Kinematic() : loop(false), time(0) {}
+    virtual ~Kinematic() {}
+    virtual void remove_from_world(btDiscreteDynamicsWorld* world) {
+        world->removeRigidBody(body.get());
+    }
+    virtual void save_state(std::vector<btScalar>& out) const {
+        save_body(body.get(), out);
+        out.push_back(time);
+    }
+    virtual void load_state(const btScalar* in) {
+        time = load_body(body.get(), in)[0];
+    }
+
+    btScalar duration() const {
+        return keys.back().time;
+    }
+
+    /** Key i with time and position continued past the ends of a loop */
+    void key(int i, btScalar& t, btVector3& pos) const {
+        const int last = int(keys.size()) - 1;
+        btScalar offset = 0;
+        if (loop && last > 0) {
+            // first and last keys are the same point of a loop
+            while (i < 0) { i += last; offset -= duration(); }
+            while (i > last) { i -= last; offset += duration(); }
+        }
+        i = std::max(0, std::min(i, last));
+        t = keys[i].time + offset;
+        pos = to_bt(keys[i].position);
+    }
+
+    btTransform pose_at(btScalar at) const {
+        if (keys.size() == 1 || at <= keys.front().time) {
+            return btTransform(rotations.front(), to_bt(keys.front().position));
+        }
+        if (loop && duration() > 0) {
+            at = btFmod(at, duration());
+        } else if (at >= duration()) {
+            return btTransform(rotations.back(), to_bt(keys.back().position));
+        }
+        int i = 0;
+        while (i + 2 < int(keys.size()) && keys[i + 1].time <= at) i++;
+
+        // cubic Hermite with Catmull-Rom tangents, scaled for uneven spacing
+        btScalar t0, t1, t2, t3;
+        btVector3 p0, p1, p2, p3;
+        key(i - 1, t0, p0);
+        key(i, t1, p1);
+        key(i + 1, t2, p2);
+        key(i + 2, t3, p3);
+        const btScalar span = t2 - t1;
+        const btScalar u = span > 0 ? (at - t1) / span : 1;
+        const btVector3 m1 = t2 > t0 ? (p2 - p0) * (span / (t2 - t0)) : btVector3(0, 0, 0);
+        const btVector3 m2 = t3 > t1 ? (p3 - p1) * (span / (t3 - t1)) : btVector3(0, 0, 0);
+        const btScalar u2 = u * u, u3 = u2 * u;
+        const btVector3 pos = p1 * (2 * u3 - 3 * u2 + 1) + m1 * (u3 - 2 * u2 + u)
+            + p2 * (-2 * u3 + 3 * u2) + m2 * (u3 - u2);
+        return btTransform(slerp(rotations[i], rotations[i + 1], u), pos);
+    }
+
+    /** Place the box for a substep of dt and move the clock past it */
+    void advance(btScalar dt) {
+        const btTransform from = pose_at(time);
+        const btTransform to = pose_at(time + dt);
+        btVector3 linear, angular;
+        btTransformUtil::calculateVelocity(from, to, dt, linear, angular);
+        body->setWorldTransform(from);
+        body->setInterpolationWorldTransform(from);
+        body->setLinearVelocity(linear);
+        body->setAngularVelocity(angular);
+        body->setInterpolationLinearVelocity(linear);
+        body->setInterpolationAngularVelocity(angular);
+        time += dt;
+        if (loop && duration() > 0 && time > duration()) time -= duration();
+    }
+};
+
+/** Closest hit of a wheel ray, skipping the truck itself and triggers */
+struct WheelRay : public btCollisionWorld::ClosestRayResultCallback {
+    const btMultiBody* truck;
+
+    WheelRay(const btVector3& from, const btVector3& to, const btMultiBody* truck)
+        : ClosestRayResultCallback(from, to), truck(truck) {}
+
+    virtual bool needsCollision(btBroadphaseProxy* proxy) const {
+        auto obj = static_cast<const btCollisionObject*>(proxy->m_clientObject);
+        if (!obj->hasContactResponse()) return false;
+        auto link = btMultiBodyLinkCollider::upcast(obj);
+        if (link && link->m_multiBody == truck) return false;
+        return ClosestRayResultCallback::needsCollision(proxy);
+    }
+};
+
+/**
+ * Tractor and trailers as one Featherstone multibody
+ *
+ * The tractor is the base and each trailer is a link with a revolute hitch,
+ * so hitches cannot drift apart however long the chain is. Segments ride on
+ * raycast wheels. A wheel which touches the ground pushes its segment up
+ * with a spring and a damper, and grips sideways and drives forward within
+ * the friction of that load. Wheel impulses go through the articulated
+ * body like contact impulses, so they move the whole chain. Wheels in the
+ * air push nothing: an airborne or overturned truck neither drives nor
+ * steers, it falls and slides on its boxes.
+ */
+struct Truck : public PObj {
+    static constexpr btScalar TRACTOR_MASS = 6000;
+    static constexpr btScalar TRAILER_MASS = 8000;
+    static constexpr btScalar ENGINE_FORCE = 60000; // N at full throttle, shared by driven wheels
+    static constexpr btScalar MAX_SPEED = 25;
+    static constexpr btScalar MAX_STEER = 0.6; // radians
+    static constexpr btScalar WHEEL_RADIUS = 0.5;
+    static constexpr btScalar WHEEL_WIDTH = 0.4;
+    static constexpr btScalar SUSPENSION_REST = 0.4; // length without load
+    static constexpr btScalar STIFFNESS = 230000; // N/m
+    static constexpr btScalar DAMPING = 20000; // N per m/s
+    static constexpr btScalar MAX_FORCE = 150000; // N per wheel
+    static constexpr btScalar ROLLING_RESISTANCE = 0.02; // of the load
+    // share of the sideways velocity at a wheel cancelled in one substep,
+    // the other wheels of the segment do the rest
+    static constexpr btScalar SIDE_GRIP = 0.5;
+
+    struct Wheel {
+        int link; // segment, -1 for the tractor
+        btVector3 mount; // top of the suspension, in segment coordinates
+        bool driven, steered;
+        // from the latest substep
+        bool in_contact;
+        btVector3 contact, normal;
+        const btCollisionObject* ground;
+        btScalar length; // of the suspension
+        btScalar load; // suspension force, N
+        btScalar rotation, delta_rotation;
+        btScalar slip; // 0 is full grip, 1 is sliding
+
+        Wheel(int link, const btVector3& mount, bool driven, bool steered)
+            : link(link), mount(mount), driven(driven), steered(steered), in_contact(false),
+            ground(nullptr), length(SUSPENSION_REST), load(0), rotation(0), delta_rotation(0), slip(0) {}
+    };
+
+    unique_ptr<btMultiBody> body;
+    std::vector<unique_ptr<btMultiBodyLinkCollider>> colliders; // base first
+    std::vector<Wheel> wheels; // tractor wheels first
+    btScalar throttle;
+    btScalar steering;
+    // the mass matrix for wheel impulses comes from the first solver pass
+    bool primed;
+    bool backwards; // order of the wheels in the last friction pass
+    btAlignedObjectArray<btScalar> jacobian, delta_vee, scratch_r;
+    btAlignedObjectArray<btVector3> scratch_v;
+    btAlignedObjectArray<btMatrix3x3> scratch_m;
+
+    Truck() : throttle(0), steering(0), primed(false), backwards(false) {}
+    virtual ~Truck() {}
+    virtual void remove_from_world(btDiscreteDynamicsWorld* world) {
+        for (auto& collider : colliders) {
+            world->removeCollisionObject(collider.get());
+        }
+        static_cast<btMultiBodyDynamicsWorld*>(world)->removeMultiBody(body.get());
+    }
+    virtual void save_state(std::vector<btScalar>& out) const {
+        const btVector3& pos = body->getBasePos();
+        const btQuaternion& rot = body->getWorldToBaseRot();
+        const btVector3 vel = body->getBaseVel(), omega = body->getBaseOmega();
+        out.insert(out.end(), pos.m_floats, pos.m_floats + 3);
+        out.insert(out.end(), { rot.x(), rot.y(), rot.z(), rot.w() });
+        out.insert(out.end(), vel.m_floats, vel.m_floats + 3);
+        out.insert(out.end(), omega.m_floats, omega.m_floats + 3);
+        for (int i = 0; i < body->getNumLinks(); i++) {
+            out.push_back(body->getJointPos(i));
+            out.push_back(body->getJointVel(i));
+        }
+        out.push_back(throttle);
+        out.push_back(steering);
+        for (const Wheel& w : wheels) {
+            out.insert(out.end(), { w.length, w.rotation, w.delta_rotation });
+        }
+        // colliders follow the body only after the next step
+        for (const auto& collider : colliders) {
+            save_transform(collider->getWorldTransform(), out);
+        }
+    }
+    virtual void load_state(const btScalar* in) {
+        body->setBasePos(btVector3(in[0], in[1], in[2]));
+        body->setWorldToBaseRot(btQuaternion(in[3], in[4], in[5], in[6]));
+        body->setBaseVel(btVector3(in[7], in[8], in[9]));
+        body->setBaseOmega(btVector3(in[10], in[11], in[12]));
+        in += 13;
+        for (int i = 0; i < body->getNumLinks(); i++, in += 2) {
+            body->setJointPos(i, in[0]);
+            body->setJointVel(i, in[1]);
+        }
+        throttle = in[0];
+        steering = in[1];
+        in += 2;
+        for (Wheel& w : wheels) {
+            w.length = in[0];
+            w.rotation = in[1];
+            w.delta_rotation = in[2];
+            in += 3;
+        }
+        for (auto& collider : colliders) {
+            collider->setWorldTransform(load_transform(in));
+            collider->setInterpolationWorldTransform(collider->getWorldTransform());
+            in += 12;
+        }
+    }
+
+    const btTransform& segment_transform(int link) const {
+        return colliders[link + 1]->getWorldTransform();
+    }
+
+    btScalar forward_speed() const {
+        const btVector3 forward = quatRotate(body->getWorldToBaseRot().inverse(), btVector3(0, 0, 1));
+        return body->getBaseVel().dot(forward);
+    }
+
+    /**
+     * Prepare an impulse along dir at point of segment link, returns the
+     * velocity change per unit impulse. velocity is the current velocity
+     * of the point along dir.
+     */
+    btScalar prepare_impulse(int link, const btVector3& point, const btVector3& dir,
+            btScalar& velocity) {
+        const int n = 6 + body->getNumLinks();
+        jacobian.resize(n);
+        delta_vee.resize(n);
+        body->fillContactJacobian(link, point, dir, &jacobian[0], scratch_r, scratch_v, scratch_m);
+        body->calcAccelerationDeltas(&jacobian[0], &delta_vee[0], scratch_r, scratch_v);
+        const btScalar* vel = body->getVelocityVector();
+        velocity = 0;
+        btScalar response = 0;
+        for (int i = 0; i < n; i++) {
+            velocity += jacobian[i] * vel[i];
+            response += jacobian[i] * delta_vee[i];
+        }
+        return response;
+    }
+
+    /** Apply the impulse prepared last */
+    void apply_impulse(btScalar impulse) {
+        for (int i = 0; i < delta_vee.size(); i++) delta_vee[i] *= impulse;
+        body->applyDeltaVee(&delta_vee[0]);
+    }
+
+    /** Cast the wheel rays, then push the chain with the wheels on the ground */
+    void drive(btCollisionWorld* world, btScalar dt) {
+        int driven_contacts = 0;
+        for (Wheel& w : wheels) {
+            const btTransform& trans = segment_transform(w.link);
+            const btVector3 down = trans.getBasis().getColumn(1) * -1;
+            const btVector3 from = trans * w.mount;
+            const btVector3 to = from + down * (SUSPENSION_REST + WHEEL_RADIUS);
+            WheelRay ray(from, to, body.get());
+            world->rayTest(from, to, ray);
+            // the ground has to face the wheel, not a wall it runs into
+            w.in_contact = ray.hasHit() && ray.m_hitNormalWorld.dot(down) < -0.5f;
+            w.slip = 0;
+            if (!w.in_contact) {
+                w.ground = nullptr;
+                w.length = SUSPENSION_REST;
+                w.delta_rotation *= 0.99f; // spins freely
+                w.rotation += w.delta_rotation;
+                continue;
+            }
+            w.contact = ray.m_hitPointWorld;
+            w.normal = ray.m_hitNormalWorld;
+            w.ground = ray.m_collisionObject;
+            w.length = btMax(ray.m_closestHitFraction * (SUSPENSION_REST + WHEEL_RADIUS) - WHEEL_RADIUS,
+                    btScalar(0));
+            if (w.driven) driven_contacts++;
+        }
+        if (!primed) {
+            primed = true;
+            return;
+        }
+
+        // springs push together, from the velocities before any of them
+        for (Wheel& w : wheels) {
+            if (!w.in_contact) continue;
+            btScalar velocity;
+            prepare_impulse(w.link, w.contact, w.normal, velocity);
+            w.load = btMax(btMin(STIFFNESS * (SUSPENSION_REST - w.length) - DAMPING * velocity,
+                        MAX_FORCE), btScalar(0));
+        }
+        for (Wheel& w : wheels) {
+            if (!w.in_contact) continue;
+            btScalar velocity;
+            prepare_impulse(w.link, w.contact, w.normal, velocity);
+            apply_impulse(w.load * dt);
+        }
+
+        // friction goes wheel by wheel, every other substep backwards so
+        // that neither side gets more grip
+        const bool engine = btFabs(forward_speed()) < MAX_SPEED;
+        const btScalar mu = tire_params(TireType::Dry).friction;
+        backwards = !backwards;
+        for (size_t n = 0; n < wheels.size(); n++) {
+            Wheel& w = wheels[backwards ? wheels.size() - 1 - n : n];
+            if (!w.in_contact) continue;
+            const btMatrix3x3& basis = segment_transform(w.link).getBasis();
+            btVector3 heading = basis.getColumn(2);
+            if (w.steered) {
+                heading = heading.rotate(basis.getColumn(1), btMax(btMin(steering, MAX_STEER), -MAX_STEER));
+            }
+            const btVector3 side = w.normal.cross(heading).normalized();
+            const btVector3 forward = side.cross(w.normal);
+            const btScalar limit = mu * w.load * dt;
+
+            btScalar velocity;
+            btScalar response = prepare_impulse(w.link, w.contact, side, velocity);
+            const btScalar side_wanted = response > 0 ? -velocity / response * SIDE_GRIP : 0;
+            const btScalar side_impulse = btMax(btMin(side_wanted, limit), -limit);
+            apply_impulse(side_impulse);
+
+            response = prepare_impulse(w.link, w.contact, forward, velocity);
+            btScalar wanted = 0;
+            if (w.driven && engine) wanted += throttle * ENGINE_FORCE / driven_contacts * dt;
+            const btScalar stop = response > 0 ? btFabs(velocity) / response : 0;
+            wanted -= btMin(ROLLING_RESISTANCE * w.load * dt, stop) * (velocity > 0 ? 1 : -1);
+            const btScalar left = btSqrt(btMax(limit * limit - side_impulse * side_impulse, btScalar(0)));
+            const btScalar impulse = btMax(btMin(wanted, left), -left);
+            apply_impulse(impulse);
+
+            const btScalar demand = btSqrt(side_wanted * side_wanted + wanted * wanted);
+            w.slip = demand > limit ? 1 - limit / demand : 0;
+            w.delta_rotation = (velocity + impulse * response) * dt / WHEEL_RADIUS;
+            w.rotation += w.delta_rotation;
+        }
+    }
+
+    /** Write wheel transforms scaled to wheel size to out, like Car::export_wheels */
+    void export_wheels(ObjectId id, PoseBuffer& out, size_t& n) const {
+        for (const Wheel& w : wheels) {
+            const btTransform& trans = segment_transform(w.link);
+            const btMatrix3x3& basis = trans.getBasis();
+            const btVector3 down = basis.getColumn(1) * -1;
+            const btVector3 right = basis.getColumn(0) * -1;
+            const btVector3 forward = (-down).cross(right);
+            const btMatrix3x3 wheel_basis(
+                    right.x(), forward.x(), -down.x(),
+                    right.y(), forward.y(), -down.y(),
+                    right.z(), forward.z(), -down.z());
+            const btScalar angle = w.steered ? btMax(btMin(steering, MAX_STEER), -MAX_STEER) : 0;
+            const btMatrix3x3 steer(btQuaternion(-down, angle));
+            const btMatrix3x3 rotation(btQuaternion(right, -w.rotation));
+            const btVector3 origin = trans * w.mount + down * w.length;
+            btTransform wheel((steer * rotation * wheel_basis).scaled(
+                        btVector3(WHEEL_WIDTH / 2, WHEEL_RADIUS, WHEEL_RADIUS)), origin);
+            out.ids[n] = id;
+            transform_to_matrix(wheel, out.transforms[n]);
+            n++;
+        }
+    }
+};
+
+/**
+ * Trigger volume. The broadphase keeps the ghost's list of overlapping
+ * objects, WorldRes::update_triggers turns it into events once per step.
+ */
+struct Trigger : public PObj {
+    unique_ptr<btPairCachingGhostObject> ghost;
+    std::vector<ObjectId> inside; // sorted, overlapping after the last step
+
+    virtual ~Trigger() {}
+    virtual void remove_from_world(btDiscreteDynamicsWorld* world) {
+        world->removeCollisionObject(ghost.get());
+    }
+};
+
+/** Dispatcher which skips the narrowphase for trigger volumes */
+struct Dispatcher : public btCollisionDispatcher {
+    Dispatcher(btCollisionConfiguration* config) : btCollisionDispatcher(config) {}
+
+    virtual bool needsCollision(const btCollisionObject* body0, const btCollisionObject* body1) {
+        if (btGhostObject::upcast(body0) || btGhostObject::upcast(body1)) {
+            return false;
+        }
+        return btCollisionDispatcher::needsCollision(body0, body1);
+    }
+};
+
+struct StaticBatch;
+
+/** Static box merged into the StaticBatch compound */
+struct StaticPiece : public PObj {
+    unique_ptr<btBoxShape> shape;
+    btTransform transform;
+    StaticBatch* batch;
+    int child_index;
+
+    virtual ~StaticPiece() {}
+    virtual void remove_from_world(btDiscreteDynamicsWorld* world);
+};
+
+/**
+ * All static boxes of the world in a single compound body
+ *
+ * Children are kept in the dynamic AABB tree of btCompoundShape, so adding
+ * and removing pieces is incremental and the broadphase sees only one proxy.
+ * The body and its AABB are refreshed once per step in flush().
+ */
+struct StaticBatch {
+    unique_ptr<btCompoundShape> compound;
+    unique_ptr<btRigidBody> body;
+    std::vector<StaticPiece*> pieces; // same order as compound children
+    bool in_world;
+    bool dirty;
+
+    StaticBatch() : compound(new btCompoundShape(true)), in_world(false), dirty(false) {
+        btRigidBody::btRigidBodyConstructionInfo info(0, nullptr, compound.get());
+        body.reset(new btRigidBody(info));
+    }
+
+    void add(StaticPiece* piece) {
+        piece->batch = this;
+        piece->child_index = compound->getNumChildShapes();
+        compound->addChildShape(piece->transform, piece->shape.get());
+        pieces.push_back(piece);
+        dirty = true;
+    }
+
+    void remove(StaticPiece* piece) {
+        // btCompoundShape moves the last child into the removed slot
+        int index = piece->child_index;
+        compound->removeChildShapeByIndex(index);
+        pieces[index] = pieces.back();
+        pieces[index]->child_index = index;
+        pieces.pop_back();
+        dirty = true;
+    }
+
+    /** Update the body after changes, returns false if nothing changed */
+    bool flush(btDiscreteDynamicsWorld* world) {
+        if (!dirty) return false;
+        dirty = false;
+        if (pieces.empty()) {
+            if (in_world) world->removeRigidBody(body.get());
+            in_world = false;
+            return true;
+        }
+        compound->recalculateLocalAabb();
+        if (in_world) {
+            world->updateSingleAabb(body.get());
+        } else {
+            world->addRigidBody(body.get());
+            in_world = true;
+        }
+        return true;
+    }
+
+    /** Move all pieces by -offset, the body itself stays at the origin */
+    void shift(const btVector3& offset) {
+        for (size_t i = 0; i < pieces.size(); i++) {
+            pieces[i]->transform.getOrigin() -= offset;
+            compound->updateChildTransform(int(i), pieces[i]->transform, false);
+        }
+        compound->recalculateLocalAabb();
+    }
+
+    std::vector<GroundBox> ground_boxes() const {
+        std::vector<GroundBox> boxes(pieces.size());
+        for (size_t i = 0; i < pieces.size(); i++) {
+            btVector3 mn, mx;
+            pieces[i]->shape->getAabb(pieces[i]->transform, mn, mx);
+            boxes[i].min = glm::vec3(mn.x(), mn.y(), mn.z());
+            boxes[i].max = glm::vec3(mx.x(), mx.y(), mx.z());
+        }
+        return boxes;
+    }
+};
+
+void StaticPiece::remove_from_world(btDiscreteDynamicsWorld*) {
+    batch->remove(this);
+}
+
+/**
+ * Lateness of step starts on the background thread
+ *
+ * Steps are scheduled at a fixed rate, so a late start means the thread was
+ * not running when it should have been, or the previous step overran.
+ */
+struct Jitter {
+    static constexpr float LATE_MS = 1.0f;
+    static const int WINDOW = 120;
+
+    float last_ms, average_ms;
+    float window_max_ms, previous_max_ms;
+    int window_steps;
+    unsigned late_starts;
+
+    Jitter() : last_ms(0), average_ms(0), window_max_ms(0), previous_max_ms(0),
+        window_steps(0), late_starts(0) {}
+
+    void record(float lateness_ms) {
+        last_ms = lateness_ms;
+        average_ms = average_ms * 0.9f + lateness_ms * 0.1f;
+        if (lateness_ms > LATE_MS) late_starts++;
+        window_max_ms = std::max(window_max_ms, lateness_ms);
+        if (++window_steps == WINDOW) {
+            previous_max_ms = window_max_ms;
+            window_max_ms = 0;
+            window_steps = 0;
+        }
+    }
+
+    /** Worst lateness of at least the last WINDOW steps */
+    float max_ms() const {
+        return std::max(window_max_ms, previous_max_ms);
+    }
+};
+
+/**
+ * Simulation level of detail
+ *
+ * Dynamic bodies further than radius from every focus point stop
+ * simulating, and start again when a focus point comes close again. Frozen
+ * bodies stay in the broadphase, so moving bodies still collide with them
+ * as if they were static. Bodies are checked in round-robin slices so that
+ * a full sweep takes SWEEP_STEPS steps regardless of the body count.
+ */
+struct Lod {
+    static const int SWEEP_STEPS = 15;
+    // frozen bodies are woken at radius and frozen again at radius * HYSTERESIS
+    static constexpr float HYSTERESIS = 1.2f;
+
+    std::vector<btVector3> focus_points;
+    std::vector<bool> focus_used;
+    std::unordered_set<ObjectId> frozen;
+    std::vector<std::pair<ObjectId, bool>> flips; // of the last update, true froze
+    float radius;
+    int cursor;
+
+    Lod() : radius(150.0f), cursor(0) {}
+
+    void set_focus(int slot, const btVector3& pos) {
+        if (slot < 0) return;
+        if (size_t(slot) >= focus_points.size()) {
+            focus_points.resize(slot + 1);
+            focus_used.resize(slot + 1, false);
+        }
+        focus_points[slot] = pos;
+        focus_used[slot] = true;
+    }
+
+    void remove_focus(int slot) {
+        if (slot >= 0 && size_t(slot) < focus_used.size()) {
+            focus_used[slot] = false;
+        }
+    }
+
+    /** Squared distance to the closest focus point, or 0 with no focus */
+    btScalar focus_distance2(const btVector3& pos) const {
+        btScalar best = BT_LARGE_FLOAT;
+        bool any = false;
+        for (size_t i = 0; i < focus_points.size(); i++) {
+            if (!focus_used[i]) continue;
+            any = true;
+            best = std::min(best, focus_points[i].distance2(pos));
+        }
+        return any ? best : 0;
+    }
+
+    /** Freeze and wake a slice of bodies, true if any was flipped */
+    template <typename Objects>
+    bool update(btAlignedObjectArray<btRigidBody*>& bodies, Objects& objects,
+            btDiscreteDynamicsWorld* world) {
+        const int count = bodies.size();
+        flips.clear();
+        if (count == 0) return false;
+        const int slice = count / SWEEP_STEPS + 1;
+        const btScalar wake2 = radius * radius;
+        const btScalar freeze2 = wake2 * HYSTERESIS * HYSTERESIS;
+        // freezing and waking change the body array, collect first
+        for (int n = 0; n < slice && n < count; n++) {
+            if (cursor >= count) cursor = 0;
+            btRigidBody* body = bodies[cursor++];
+            if (body->isStaticOrKinematicObject()) continue;
+            ObjectId id = get_object_id(body);
+            bool is_frozen = frozen.count(id) > 0;
+            btScalar d2 = focus_distance2(body->getWorldTransform().getOrigin());
+            if (!is_frozen && d2 > freeze2) {
+                flips.push_back(std::make_pair(id, true));
+            } else if (is_frozen && d2 < wake2) {
+                flips.push_back(std::make_pair(id, false));
+            }
+        }
+        for (const auto& flip : flips) {
+            auto it = objects.find(flip.first);
+            if (it == objects.end()) continue;
+            it->second->set_frozen(world, flip.second);
+            if (flip.second) {
+                frozen.insert(flip.first);
+            } else {
+                frozen.erase(flip.first);
+            }
+        }
+        return !flips.empty();
+    }
+};
+
+/**
+ * Collision shapes shared between bodies
+ *
+ * Shapes are never modified after creation, so all bodies with the same box
+ * size or the same hull use a single shape. Shapes live as long as the world.
+ */
+struct ShapeCache {
+    std::map<std::array<btScalar, 3>, unique_ptr<btBoxShape>> boxes;
+    std::unordered_map<uint64_t, unique_ptr<btConvexHullShape>> hulls;
+
+    btCollisionShape* box(const btVector3& half_extents) {
+        std::array<btScalar, 3> key = {{ half_extents.x(), half_extents.y(), half_extents.z() }};
+        auto& shape = boxes[key];
+        if (!shape) shape.reset(new btBoxShape(half_extents));
+        return shape.get();
+    }
+
+    /** Hull from simplified_hull, key is its hull_key */
+    btCollisionShape* hull(uint64_t key, const std::vector<glm::vec3>& points) {
+        auto& shape = hulls[key];
+        if (!shape) {
+            shape.reset(new btConvexHullShape());
+            for (const auto& p : points) {
+                shape->addPoint(btVector3(p.x, p.y, p.z), false);
+            }
+            shape->recalcLocalAabb();
+        }
+        return shape.get();
+    }
+};
+
+// pile merging, see WorldRes::merge_piles
+const int PILE_CHECK_INTERVAL = 30; // steps
+const int PILE_SLEEP_CHECKS = 4;
+const size_t PILE_MIN_BODIES = 4;
+// contact impulse which would change velocity of an average member this
+// much splits a pile, and so does moving faster than PILE_SPLIT_SPEED
+const btScalar PILE_SPLIT_DELTA_V = 2;
+const btScalar PILE_SPLIT_SPEED = 1;
+
+// spatial sorting, see WorldRes::sort_spatially
+const btScalar SORT_CELL = 1; // meters per step of the Z-order curve
+const uint64_t SORT_CELL_LIMIT = (uint64_t(1) << 21) - 1;
+
+/** Spread the low 21 bits of v apart, with two zero bits between each */
+static uint64_t spread_bits(uint64_t v) {
+    v &= SORT_CELL_LIMIT;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+/**
+ * Move every node and proxy of a tree broadphase by -offset. The tree keeps
+ * its shape, which is much cheaper than moving the proxies one by one.
+ */
+static void shift_tree(btDbvtBroadphase* tree, const btVector3& offset) {
+    std::vector<btDbvtNode*> stack;
+    for (btDbvt& set : tree->m_sets) {
+        if (set.m_root) stack.push_back(set.m_root);
+        while (!stack.empty()) {
+            btDbvtNode* node = stack.back();
+            stack.pop_back();
+            node->volume.tMins() -= offset;
+            node->volume.tMaxs() -= offset;
+            if (node->isinternal()) {
+                stack.push_back(node->childs[0]);
+                stack.push_back(node->childs[1]);
+            } else {
+                auto proxy = static_cast<btDbvtProxy*>(node->data);
+                proxy->m_aabbMin -= offset;
+                proxy->m_aabbMax -= offset;
+            }
+        }
+    }
+}
+
 struct WorldRes {
     std::unordered_map<ObjectId, unique_ptr<PObj>> objects;
+    ShapeCache shapes;
+    StaticBatch static_batch;
 
     unique_ptr<btBroadphaseInterface> broadphase;
+    btGhostPairCallback ghost_pairs; // keeps overlaps of triggers
+    BoxBoxAlgorithm::CreateFunc box_box; // cubes and chassis are boxes
     unique_ptr<btCollisionDispatcher> dispatcher;
     unique_ptr<btDefaultCollisionConfiguration> collision_config;
-    unique_ptr<btSequentialImpulseConstraintSolver> solver;
-    unique_ptr<btDiscreteDynamicsWorld> world;
+    unique_ptr<btMultiBodyConstraintSolver> solver;
+    unique_ptr<DynamicsWorld> world;
+    VehicleBatch vehicle_batch; // all cars, as one action of world
 
     std::mutex changes_mutex;
     std::thread thread;
     Status thread_status;
     util::TaskList tasks;
-    std::vector<std::pair<ObjectId, glm::mat4>> step_changes;
+    PoseBuffer poses;
+    PoseBuffer wheel_poses; // one entry per wheel, id is the vehicle
+    Governor governor;
+    Lod lod;
+    Debris debris;
+    std::vector<glm::vec4> debris_instances;
+    bool debris_published; // the latest published debris was not empty
+    ObjectId next_debris_id;
+    bool pile_merging;
+    int pile_steps;
+    ObjectId next_pile_id;
+    std::unordered_set<ObjectId> piles;
+    uint64_t step_count;
+    std::vector<ObjectId> vehicles;
+    std::vector<ObjectId> kinematics;
+    std::vector<ObjectId> triggers;
+    std::vector<TriggerEvent> trigger_events; // since the last publish
+    std::vector<std::shared_ptr<TelemetryStream>> telemetry_streams;
+    WorldStats stats; // guarded by stats_mutex
+    std::mutex stats_mutex;
+    std::vector<char> island_seen;
+    uint64_t step_allocations_base[ALLOC_CATEGORIES];
+    Jitter jitter; // only touched by the background thread
+    util::ThreadConfig thread_config;
+    bool thread_config_changed;
+    // pose recording, only touched by the physics thread
+    std::shared_ptr<PoseRecorder> recorder;
+    // stopped recorders, closing the file waits for the writer so they are
+    // destroyed by the game thread in take_snapshot. Guarded by changes_mutex
+    std::vector<std::shared_ptr<PoseRecorder>> closing_recorders;
+    std::shared_ptr<PoseRecorder> game_recorder; // only touched by the game thread
+    bool record_all; // next frame carries every body, not only moved ones
+    PoseBuffer record_poses;
+    std::unordered_set<ObjectId> recorded; // bodies whose shape is recorded
+    std::vector<ObjectId> record_removed; // since the last recorded frame
+    // rollback window, null when disabled. Objects added or removed and
+    // rebases bump structure and start the window over. Freezing by distance
+    // and pile merges and splits are logged as undos instead.
+    unique_ptr<RollbackRing> rollback;
+    uint64_t structure, rollback_structure;
+    bool rollback_logging; // between opening the record of a step and capturing it
+    std::vector<ObjectId> rollback_restored; // objects put back by undos
+    std::vector<ObjectId> rollback_awake, rollback_next_awake; // moving after the step
+    std::vector<btScalar> rollback_state;
+    glm::dvec3 origin; // sum of rebase offsets
+    int sort_interval; // steps between spatial sorts, 0 never
+    int sort_steps;
+    std::vector<std::pair<uint64_t, int>> sort_keys; // Z-order key and array index
+    std::vector<btCollisionObject*> sort_scratch;
 
-    WorldRes() {
-        broadphase.reset(new btDbvtBroadphase());
+    explicit WorldRes(Broadphase kind) {
+        if (kind == Broadphase::HashGrid) broadphase.reset(new HashGridBroadphase());
+        else broadphase.reset(new btDbvtBroadphase());
+        broadphase->getOverlappingPairCache()->setInternalGhostPairCallback(&ghost_pairs);
         collision_config.reset(new btDefaultCollisionConfiguration());
-        dispatcher.reset(new btCollisionDispatcher(collision_config.get()));
-        solver.reset(new btSequentialImpulseConstraintSolver());
-        world.reset(new btDiscreteDynamicsWorld(
+        dispatcher.reset(new Dispatcher(collision_config.get()));
+        dispatcher->registerCollisionCreateFunc(BOX_SHAPE_PROXYTYPE, BOX_SHAPE_PROXYTYPE, &box_box);
+        solver.reset(new btMultiBodyConstraintSolver());
+        world.reset(new DynamicsWorld(
                     dispatcher.get(), broadphase.get(), solver.get(),
                     collision_config.get()));
+        world->setInternalTickCallback(&WorldRes::pre_tick, this, true);
+        world->addAction(&vehicle_batch);
         thread_status = Idle;
+        debris_published = false;
+        next_debris_id = DEBRIS_ID_BASE;
+        pile_merging = true;
+        pile_steps = 0;
+        next_pile_id = PILE_ID_BASE;
+        step_count = 0;
+        stats = WorldStats();
+        thread_config = util::ThreadConfig("physics");
+        thread_config_changed = false;
+        record_all = false;
+        structure = 0;
+        rollback_structure = 0;
+        rollback_logging = false;
+        origin = glm::dvec3(0.0);
+        sort_interval = 0;
+        sort_steps = 0;
+        std::fill_n(step_allocations_base, ALLOC_CATEGORIES, 0);
+        apply_quality();
+    }
+
+    /** Add body to the world using the current quality settings */
+    void add_body(btRigidBody* body, Category category) {
+        add_body(body, category_group(category), category_mask(category));
+    }
+
+    void add_body(btRigidBody* body, short group, short mask) {
+        structure++;
+        insert_body(body, group, mask);
+    }
+
+    /** Add body without starting the rollback window over, for pile changes */
+    void insert_body(btRigidBody* body, short group, short mask) {
+        body->setContactProcessingThreshold(governor.quality().contact_threshold);
+        world->addRigidBody(body, group, mask);
+    }
+
+    void add_single_body(ObjectId id, const btTransform& trans, float mass, btCollisionShape* shape,
+            Category category, const btVector3& velocity = btVector3(0, 0, 0)) {
+        unique_ptr<Body> obj{new Body};
+        obj->shape = shape;
+        btVector3 inertia(0,0,0);
+        shape->calculateLocalInertia(mass, inertia);
+
+        btRigidBody::btRigidBodyConstructionInfo info(mass, nullptr, shape, inertia);
+        info.m_startWorldTransform = trans;
+        obj->body.reset(new btRigidBody(info));
+        obj->body->setLinearVelocity(velocity);
+        set_object_id(obj->body.get(), id);
+
+        add_body(obj->body.get(), category);
+        objects[id] = move(obj);
+    }
+
+    void add_cube(ObjectId id, const btTransform& trans, float mass, const btVector3& size,
+            Category category, const btVector3& velocity = btVector3(0, 0, 0)) {
+        add_single_body(id, trans, mass, shapes.box(size), category, velocity);
+    }
+
+    /**
+     * Fuse islands which have slept for PILE_SLEEP_CHECKS checks into piles.
+     * Checks run every PILE_CHECK_INTERVAL steps, a sleeping island does
+     * not move so merging it late costs nothing.
+     */
+    void merge_piles() {
+        if (!pile_merging || ++pile_steps < PILE_CHECK_INTERVAL) return;
+        pile_steps = 0;
+        std::unordered_map<int, std::vector<Body*>> islands;
+        for (auto& obj : objects) {
+            auto body = dynamic_cast<Body*>(obj.second.get());
+            if (!body || body->pile || is_pile_id(obj.first)) continue;
+            btRigidBody* rb = body->body.get();
+            if (rb->isStaticOrKinematicObject()) continue;
+            if (rb->getActivationState() != ISLAND_SLEEPING) {
+                body->sleep_checks = 0;
+            } else if (++body->sleep_checks >= PILE_SLEEP_CHECKS) {
+                islands[rb->getIslandTag()].push_back(body);
+            }
+        }
+        for (auto& island : islands) {
+            if (island.second.size() >= PILE_MIN_BODIES) {
+                merge_pile(island.second);
+            }
+        }
+    }
+
+    void merge_pile(const std::vector<Body*>& members) {
+        // a pile has a single collision filter, so all members must agree
+        const btBroadphaseProxy* first = members[0]->body->getBroadphaseHandle();
+        const short group = first->m_collisionFilterGroup;
+        const short mask = first->m_collisionFilterMask;
+        btVector3 center(0, 0, 0);
+        btScalar mass = 0;
+        for (Body* member : members) {
+            const btBroadphaseProxy* proxy = member->body->getBroadphaseHandle();
+            if (proxy->m_collisionFilterGroup != group || proxy->m_collisionFilterMask != mask) {
+                return;
+            }
+            const btScalar member_mass = 1 / member->body->getInvMass();
+            center += member->body->getWorldTransform().getOrigin() * member_mass;
+            mass += member_mass;
+        }
+        center /= mass;
+
+        const ObjectId id = next_pile_id++;
+        unique_ptr<Pile> pile{new Pile};
+        pile->compound.reset(new btCompoundShape(true));
+        pile->shape = pile->compound.get();
+        pile->group = group;
+        pile->mask = mask;
+        pile->member_mass = mass / members.size();
+        const btTransform to_pile(btQuaternion::getIdentity(), -center);
+        for (Body* member : members) {
+            pile->compound->addChildShape(to_pile * member->body->getWorldTransform(), member->shape);
+            pile->members.push_back(get_object_id(member->body.get()));
+            world->removeRigidBody(member->body.get());
+            member->pile = id;
+            member->sleep_checks = 0;
+        }
+
+        btVector3 inertia(0, 0, 0);
+        pile->compound->calculateLocalInertia(mass, inertia);
+        btRigidBody::btRigidBodyConstructionInfo info(mass, nullptr, pile->compound.get(), inertia);
+        info.m_startWorldTransform = btTransform(btQuaternion::getIdentity(), center);
+        pile->body.reset(new btRigidBody(info));
+        set_object_id(pile->body.get(), id);
+        insert_body(pile->body.get(), group, mask);
+        pile->body->setActivationState(ISLAND_SLEEPING);
+        piles.insert(id);
+        objects[id] = move(pile);
+        if (rollback_logging) {
+            rollback_appear(id);
+            rollback->log_undo([=]() { dissolve_pile(id); });
+        }
+    }
+
+    /** Undo a merge, members go back to the states they had before it */
+    void dissolve_pile(ObjectId id) {
+        auto it = objects.find(id);
+        if (it == objects.end()) return;
+        const std::vector<ObjectId> members = static_cast<Pile*>(it->second.get())->members;
+        split_pile(id);
+        for (ObjectId member : members) {
+            if (const btScalar* state = rollback->state(member)) {
+                objects[member]->load_state(state);
+            }
+            rollback_restored.push_back(member);
+        }
+    }
+
+    /**
+     * Log how a pile is made before members leave it, going back past the
+     * split puts them in again
+     */
+    void log_pile_split(ObjectId id) {
+        if (!rollback_logging) return;
+        auto pile = static_cast<Pile*>(objects[id].get());
+        rollback_touch(id);
+        PileLayout layout;
+        layout.members = pile->members;
+        for (size_t i = 0; i < pile->members.size(); i++) {
+            layout.children.push_back(pile->compound->getChildTransform(int(i)));
+        }
+        layout.group = pile->group;
+        layout.mask = pile->mask;
+        layout.strength = pile->strength;
+        layout.fragment_size = pile->fragment_size;
+        rollback->log_undo([=]() { restore_pile(id, layout); });
+    }
+
+    /** Undo a split, the pile state itself is restored by the rollback window */
+    void restore_pile(ObjectId id, const PileLayout& layout) {
+        Pile* pile;
+        auto it = objects.find(id);
+        if (it == objects.end()) {
+            unique_ptr<Pile> created{new Pile};
+            created->compound.reset(new btCompoundShape(true));
+            created->shape = created->compound.get();
+            created->group = layout.group;
+            created->mask = layout.mask;
+            created->strength = layout.strength;
+            created->fragment_size = layout.fragment_size;
+            btRigidBody::btRigidBodyConstructionInfo info(1, nullptr, created->compound.get());
+            created->body.reset(new btRigidBody(info));
+            set_object_id(created->body.get(), id);
+            pile = created.get();
+            piles.insert(id);
+            objects[id] = move(created);
+        } else {
+            pile = static_cast<Pile*>(it->second.get());
+            world->removeRigidBody(pile->body.get());
+            for (int i = pile->compound->getNumChildShapes(); i-- > 0;) {
+                pile->compound->removeChildShapeByIndex(i);
+            }
+        }
+        btScalar mass = 0;
+        for (size_t i = 0; i < layout.members.size(); i++) {
+            auto member = static_cast<Body*>(objects[layout.members[i]].get());
+            if (!member->pile) world->removeRigidBody(member->body.get());
+            member->pile = id;
+            member->sleep_checks = 0;
+            pile->compound->addChildShape(layout.children[i], member->shape);
+            mass += 1 / member->body->getInvMass();
+        }
+        pile->members = layout.members;
+        pile->member_mass = mass / layout.members.size();
+        btVector3 inertia(0, 0, 0);
+        pile->compound->calculateLocalInertia(mass, inertia);
+        pile->body->setMassProps(mass, inertia);
+        pile->body->updateInertiaTensor();
+        insert_body(pile->body.get(), layout.group, layout.mask);
+        rollback_restored.push_back(id);
+    }
+
+    /** Put the members of a pile back into the world where the pile is now */
+    void split_pile(ObjectId id) {
+        log_pile_split(id);
+        auto it = objects.find(id);
+        auto pile = static_cast<Pile*>(it->second.get());
+        world->removeRigidBody(pile->body.get());
+        for (size_t i = 0; i < pile->members.size(); i++) {
+            release_member(pile, i);
+        }
+        lod.frozen.erase(id);
+        piles.erase(id);
+        objects.erase(it);
+    }
+
+    /**
+     * Put some members of a pile back into the world, the rest stays
+     * merged. Indices must be in ascending order.
+     */
+    void split_pile(ObjectId id, const std::vector<size_t>& indices) {
+        auto pile = static_cast<Pile*>(objects[id].get());
+        if (pile->members.size() - indices.size() < 2) {
+            split_pile(id);
+            return;
+        }
+        log_pile_split(id);
+        // btCompoundShape moves the last child into the removed slot, going
+        // backwards keeps the remaining indices valid
+        for (size_t n = indices.size(); n-- > 0;) {
+            const size_t i = indices[n];
+            release_member(pile, i);
+            pile->compound->removeChildShapeByIndex(int(i));
+            pile->members[i] = pile->members.back();
+            pile->members.pop_back();
+        }
+        recenter_pile(pile);
+    }
+
+    void release_member(Pile* pile, size_t index) {
+        const btTransform& trans = pile->body->getWorldTransform();
+        const btVector3 vel = pile->body->getLinearVelocity();
+        const btVector3 omega = pile->body->getAngularVelocity();
+        auto member = static_cast<Body*>(objects[pile->members[index]].get());
+        btRigidBody* body = member->body.get();
+        const btTransform member_trans = trans * pile->compound->getChildTransform(int(index));
+        body->setWorldTransform(member_trans);
+        body->setInterpolationWorldTransform(member_trans);
+        body->setLinearVelocity(vel + omega.cross(member_trans.getOrigin() - trans.getOrigin()));
+        body->setAngularVelocity(omega);
+        body->forceActivationState(ACTIVE_TAG);
+        body->setDeactivationTime(0);
+        member->pile = 0;
+        insert_body(body, pile->group, pile->mask);
+        // fragments of destructibles were never on their own before
+        if (rollback_logging) rollback_appear(pile->members[index]);
+    }
+
+    /** Move the pile body to the center of mass of its remaining members */
+    void recenter_pile(Pile* pile) {
+        btCompoundShape* compound = pile->compound.get();
+        btVector3 center(0, 0, 0);
+        btScalar mass = 0;
+        for (size_t i = 0; i < pile->members.size(); i++) {
+            auto member = static_cast<Body*>(objects[pile->members[i]].get());
+            const btScalar member_mass = 1 / member->body->getInvMass();
+            center += compound->getChildTransform(int(i)).getOrigin() * member_mass;
+            mass += member_mass;
+        }
+        center /= mass;
+        for (int i = 0; i < compound->getNumChildShapes(); i++) {
+            btTransform child = compound->getChildTransform(i);
+            child.getOrigin() -= center;
+            compound->updateChildTransform(i, child, false);
+        }
+        compound->recalculateLocalAabb();
+
+        btRigidBody* body = pile->body.get();
+        btTransform trans = body->getWorldTransform();
+        trans.getOrigin() += trans.getBasis() * center;
+        body->setWorldTransform(trans);
+        body->setInterpolationWorldTransform(trans);
+        btVector3 inertia(0, 0, 0);
+        compound->calculateLocalInertia(mass, inertia);
+        body->setMassProps(mass, inertia);
+        body->updateInertiaTensor();
+        pile->member_mass = mass / pile->members.size();
+        world->updateSingleAabb(body);
+        body->activate();
+    }
+
+    /** Break the fragments around point off a destructible */
+    void break_pile(ObjectId id, const btVector3& point, btScalar impulse) {
+        auto pile = static_cast<Pile*>(objects[id].get());
+        const btTransform& trans = pile->body->getWorldTransform();
+        const btScalar radius = pile->fragment_size * btMin(1 + impulse / pile->strength, btScalar(4));
+        std::vector<size_t> broken;
+        size_t nearest = 0;
+        btScalar nearest2 = BT_LARGE_FLOAT;
+        for (size_t i = 0; i < pile->members.size(); i++) {
+            const btVector3 center = trans * pile->compound->getChildTransform(int(i)).getOrigin();
+            const btScalar d2 = center.distance2(point);
+            if (d2 < radius * radius) broken.push_back(i);
+            if (d2 < nearest2) {
+                nearest2 = d2;
+                nearest = i;
+            }
+        }
+        // a large fragment can have its center far from the surface
+        if (broken.empty()) broken.push_back(nearest);
+        split_pile(id, broken);
+    }
+
+    /** Split piles which got hit hard or started moving, break destructibles */
+    void split_impacted_piles() {
+        if (piles.empty()) return;
+        std::unordered_set<ObjectId> split;
+        // strongest impact on each destructible
+        std::unordered_map<ObjectId, std::pair<btVector3, btScalar>> breaks;
+        bool awake = false;
+        for (ObjectId id : piles) {
+            auto pile = static_cast<Pile*>(objects[id].get());
+            const btRigidBody* body = pile->body.get();
+            if (!body->isActive()) continue;
+            awake = true;
+            if (pile->strength == 0
+                    && body->getLinearVelocity().length2() > PILE_SPLIT_SPEED * PILE_SPLIT_SPEED) {
+                split.insert(id);
+            }
+        }
+        if (awake) {
+            const int count = dispatcher->getNumManifolds();
+            for (int i = 0; i < count; i++) {
+                const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+                const btCollisionObject* obj0 = manifold->getBody0();
+                const btCollisionObject* obj1 = manifold->getBody1();
+                const bool swapped = !is_pile_id(get_object_id(obj0));
+                if (swapped) std::swap(obj0, obj1);
+                const ObjectId id = get_object_id(obj0);
+                // resting on static ground is no impact, kinematic bodies
+                // have the static flag but they move
+                const bool ground = obj1->isStaticObject() && !obj1->isKinematicObject();
+                if (!is_pile_id(id) || ground || !obj0->isActive()) continue;
+                btScalar impulse = 0;
+                btVector3 point(0, 0, 0);
+                for (int p = 0; p < manifold->getNumContacts(); p++) {
+                    const btManifoldPoint& contact = manifold->getContactPoint(p);
+                    if (contact.getAppliedImpulse() > impulse) {
+                        impulse = contact.getAppliedImpulse();
+                        point = swapped ? contact.getPositionWorldOnB() : contact.getPositionWorldOnA();
+                    }
+                }
+                auto pile = static_cast<Pile*>(objects[id].get());
+                if (pile->strength > 0) {
+                    auto& strongest = breaks[id];
+                    if (impulse > pile->strength && impulse > strongest.second) {
+                        strongest = std::make_pair(point, impulse);
+                    }
+                } else if (impulse > PILE_SPLIT_DELTA_V * pile->member_mass) {
+                    split.insert(id);
+                }
+            }
+        }
+        for (ObjectId id : split) {
+            split_pile(id);
+        }
+        for (const auto& b : breaks) {
+            if (b.second.second > 0) {
+                break_pile(b.first, b.second.first, b.second.second);
+            }
+        }
+    }
+
+    /** Replace poses of piles in poses with the poses of their members */
+    void expand_pile_poses(PoseBuffer& poses) {
+        if (piles.empty()) return;
+        const size_t count = poses.count;
+        for (size_t i = 0; i < count; i++) {
+            if (!is_pile_id(poses.ids[i])) continue;
+            auto pile = static_cast<Pile*>(objects[poses.ids[i]].get());
+            const btTransform& trans = pile->body->getWorldTransform();
+            poses.reserve(poses.count + pile->members.size());
+            // the pile itself is not drawn, its slot goes to the first member
+            for (size_t m = 0; m < pile->members.size(); m++) {
+                const size_t slot = m == 0 ? i : poses.count++;
+                poses.ids[slot] = pile->members[m];
+                transform_to_matrix(trans * pile->compound->getChildTransform(m), poses.transforms[slot]);
+            }
+        }
+    }
+
+    /** Push telemetry of all vehicles to open streams, dt is the substep length */
+    void publish_telemetry(btScalar dt) {
+        // streams with no other reference left are closed
+        telemetry_streams.erase(std::remove_if(telemetry_streams.begin(), telemetry_streams.end(),
+                    [](const std::shared_ptr<TelemetryStream>& s) { return s.use_count() == 1; }),
+                telemetry_streams.end());
+        if (telemetry_streams.empty()) return;
+
+        for (ObjectId id : vehicles) {
+            auto it = objects.find(id);
+            if (it == objects.end()) continue;
+            VehicleTelemetry t = VehicleTelemetry();
+            t.vehicle = id;
+            t.step = step_count;
+            if (auto car = dynamic_cast<Car*>(it->second.get())) {
+                const btRaycastVehicle* vehicle = car->vehicle.get();
+                t.speed = vehicle_batch.speed(vehicle);
+                t.wheel_count = std::min(vehicle->getNumWheels(), TELEMETRY_WHEELS);
+                for (int i = 0; i < t.wheel_count; i++) {
+                    const btWheelInfo& info = vehicle->getWheelInfo(i);
+                    WheelTelemetry& wheel = t.wheels[i];
+                    // delta rotation is per substep
+                    wheel.rpm = info.m_deltaRotation / dt * 60 / SIMD_2_PI;
+                    wheel.slip = 1 - info.m_skidInfo;
+                    wheel.compression = info.getSuspensionRestLength()
+                        - info.m_raycastInfo.m_suspensionLength;
+                    wheel.in_contact = info.m_raycastInfo.m_isInContact;
+                    if (wheel.in_contact && info.m_raycastInfo.m_groundObject) {
+                        wheel.contact = get_object_id(
+                                static_cast<const btCollisionObject*>(info.m_raycastInfo.m_groundObject));
+                    }
+                }
+            } else if (auto truck = dynamic_cast<Truck*>(it->second.get())) {
+                t.speed = truck->forward_speed();
+                // the tractor wheels come first
+                t.wheel_count = std::min(int(truck->wheels.size()), TELEMETRY_WHEELS);
+                for (int i = 0; i < t.wheel_count; i++) {
+                    const Truck::Wheel& w = truck->wheels[i];
+                    WheelTelemetry& wheel = t.wheels[i];
+                    wheel.rpm = w.delta_rotation / dt * 60 / SIMD_2_PI;
+                    wheel.slip = w.slip;
+                    wheel.compression = Truck::SUSPENSION_REST - w.length;
+                    wheel.in_contact = w.in_contact;
+                    if (w.in_contact && w.ground) wheel.contact = get_object_id(w.ground);
+                }
+            }
+            for (auto& stream : telemetry_streams) {
+                stream->push(t);
+            }
+        }
+    }
+
+    /**
+     * Append poses of kinematic bodies, they are not in the non-static body
+     * array. The clock is already at the end of the step, the body only
+     * gets there before the next substep.
+     */
+    void export_kinematic_poses(PoseBuffer& poses) {
+        poses.reserve(poses.count + kinematics.size());
+        for (ObjectId id : kinematics) {
+            auto it = objects.find(id);
+            if (it == objects.end()) continue;
+            const auto k = static_cast<const Kinematic*>(it->second.get());
+            poses.ids[poses.count] = id;
+            transform_to_matrix(k->pose_at(k->time), poses.transforms[poses.count]);
+            poses.count++;
+        }
+    }
+
+    /**
+     * Compare what overlaps each trigger after this step with the previous
+     * step and log enter and exit events. The tree broadphase drops stale
+     * pairs only a few at a time, so every listed pair is checked against
+     * the current boxes.
+     */
+    void update_triggers() {
+        std::vector<ObjectId> now, changed;
+        for (ObjectId id : triggers) {
+            auto trigger = static_cast<Trigger*>(objects[id].get());
+            const btPairCachingGhostObject* ghost = trigger->ghost.get();
+            btVector3 min, max;
+            ghost->getCollisionShape()->getAabb(ghost->getWorldTransform(), min, max);
+            now.clear();
+            for (int i = 0; i < ghost->getNumOverlappingObjects(); i++) {
+                const btCollisionObject* obj = ghost->getOverlappingObject(i);
+                btVector3 obj_min, obj_max;
+                obj->getCollisionShape()->getAabb(obj->getWorldTransform(), obj_min, obj_max);
+                if (TestAabbAgainstAabb2(min, max, obj_min, obj_max)) {
+                    now.push_back(get_object_id(obj));
+                }
+            }
+            std::sort(now.begin(), now.end());
+            now.erase(std::unique(now.begin(), now.end()), now.end());
+
+            auto log = [&](bool enter) {
+                for (ObjectId object : changed) {
+                    TriggerEvent e;
+                    e.trigger = id;
+                    e.object = object;
+                    e.enter = enter;
+                    trigger_events.push_back(e);
+                }
+            };
+            changed.clear();
+            std::set_difference(trigger->inside.begin(), trigger->inside.end(),
+                    now.begin(), now.end(), std::back_inserter(changed));
+            log(false);
+            changed.clear();
+            std::set_difference(now.begin(), now.end(),
+                    trigger->inside.begin(), trigger->inside.end(), std::back_inserter(changed));
+            log(true);
+            trigger->inside.swap(now);
+        }
+    }
+
+    /** Write wheel transforms of all moving cars and trucks to wheel_poses */
+    void export_wheels() {
+        size_t total = 0;
+        for (ObjectId id : vehicles) {
+            auto it = objects.find(id);
+            if (it == objects.end()) continue;
+            if (auto car = dynamic_cast<Car*>(it->second.get())) {
+                total += car->vehicle->getNumWheels();
+            } else if (auto truck = dynamic_cast<Truck*>(it->second.get())) {
+                total += truck->wheels.size();
+            }
+        }
+        wheel_poses.reserve(total);
+        size_t n = 0;
+        for (ObjectId id : vehicles) {
+            auto it = objects.find(id);
+            if (it == objects.end()) continue;
+            auto car = dynamic_cast<Car*>(it->second.get());
+            if (car && car->chassis->isActive()) {
+                car->export_wheels(id, wheel_poses, n);
+            } else if (auto truck = dynamic_cast<Truck*>(it->second.get())) {
+                truck->export_wheels(id, wheel_poses, n);
+            }
+        }
+        wheel_poses.count = n;
+    }
+
+    /** Append shape of a collision object to out, as a box around it */
+    static void add_recorded_shape(ObjectId id, const btCollisionShape* shape,
+            std::vector<RecordedShape>& out) {
+        btVector3 min, max;
+        shape->getAabb(btTransform::getIdentity(), min, max);
+        const btVector3 center = (min + max) / 2, size = (max - min) / 2;
+        out.push_back(RecordedShape {
+                id, glm::vec3(center.x(), center.y(), center.z()), glm::vec3(size.x(), size.y(), size.z()) });
+    }
+
+    /** Shapes of a body seen by the recorder for the first time */
+    void record_shape(ObjectId id, std::vector<RecordedShape>& out) {
+        auto it = objects.find(id);
+        // truck trailers are not in the object map, they come with the tractor
+        if (it == objects.end()) return;
+        const PObj* obj = it->second.get();
+        if (auto body = dynamic_cast<const Body*>(obj)) {
+            add_recorded_shape(id, body->body->getCollisionShape(), out);
+        } else if (auto car = dynamic_cast<const Car*>(obj)) {
+            add_recorded_shape(id, car->chassis->getCollisionShape(), out);
+        } else if (auto kinematic = dynamic_cast<const Kinematic*>(obj)) {
+            add_recorded_shape(id, kinematic->body->getCollisionShape(), out);
+        } else if (auto truck = dynamic_cast<const Truck*>(obj)) {
+            for (const auto& collider : truck->colliders) {
+                const ObjectId segment = get_object_id(collider.get());
+                recorded.insert(segment);
+                add_recorded_shape(segment, collider->getCollisionShape(), out);
+            }
+        }
+    }
+
+    /** Stop the recorder and pass it to the game thread to close */
+    void retire_recorder() {
+        if (!recorder) return;
+        recorder->stop();
+        std::lock_guard<std::mutex> lock(changes_mutex);
+        closing_recorders.push_back(std::move(recorder));
+        recorder.reset();
+    }
+
+    /**
+     * Hand poses of the step to the recorder. Never waits: when the writer
+     * is behind the step is dropped, and the next one carries every body.
+     */
+    void record_step() {
+        if (!recorder) return;
+        RecorderFrame* frame = recorder->begin_frame();
+        if (!frame) {
+            record_all = true;
+            return;
+        }
+        const PoseBuffer* src = &poses;
+        if (record_all) {
+            world->export_poses(record_poses, true);
+            expand_pile_poses(record_poses);
+            export_kinematic_poses(record_poses);
+            src = &record_poses;
+            record_all = false;
+        }
+        frame->step = step_count;
+        frame->origin = origin;
+        frame->ids.assign(src->ids.begin(), src->ids.begin() + src->count);
+        frame->transforms.assign(src->transforms.begin(), src->transforms.begin() + src->count);
+        for (size_t i = 0; i < src->count; i++) {
+            const ObjectId id = src->ids[i];
+            if (recorded.insert(id).second) record_shape(id, frame->shapes);
+        }
+        frame->removed.swap(record_removed);
+        recorder->submit(frame);
+    }
+
+    /**
+     * Drop contacts of objects moved by hand, cached contact points and
+     * impulses are from where they were before. One pass over the pairs.
+     */
+    void forget_contacts(const std::unordered_set<const btCollisionObject*>& moved) {
+        struct Forget : public btOverlapCallback {
+            const std::unordered_set<const btCollisionObject*>& moved;
+            btOverlappingPairCache* pairs;
+            btDispatcher* dispatcher;
+            Forget(const std::unordered_set<const btCollisionObject*>& moved,
+                    btOverlappingPairCache* pairs, btDispatcher* dispatcher)
+                : moved(moved), pairs(pairs), dispatcher(dispatcher) {}
+            virtual bool processOverlap(btBroadphasePair& pair) {
+                if (moved.count(static_cast<btCollisionObject*>(pair.m_pProxy0->m_clientObject))
+                        || moved.count(static_cast<btCollisionObject*>(pair.m_pProxy1->m_clientObject))) {
+                    pairs->cleanOverlappingPair(pair, dispatcher);
+                }
+                return false; // keep the pair
+            }
+        };
+        if (moved.empty()) return;
+        btOverlappingPairCache* pairs = broadphase->getOverlappingPairCache();
+        Forget forget(moved, pairs, dispatcher.get());
+        pairs->processAllOverlappingPairs(&forget, dispatcher.get());
+    }
+
+    /**
+     * Move everything by -offset. Objects, the broadphase and contacts
+     * are shifted as they are, nothing is removed or added again, so
+     * pairs, contacts and sleeping islands carry on as if nothing happened.
+     */
+    void rebase(const btVector3& offset) {
+        btCollisionObjectArray& arr = world->getCollisionObjectArray();
+        for (int i = 0; i < arr.size(); i++) {
+            btCollisionObject* obj = arr[i];
+            if (obj == static_batch.body.get()) continue; // its pieces move instead
+            btTransform trans = obj->getWorldTransform();
+            trans.getOrigin() -= offset;
+            obj->setWorldTransform(trans);
+            trans = obj->getInterpolationWorldTransform();
+            trans.getOrigin() -= offset;
+            obj->setInterpolationWorldTransform(trans);
+        }
+        static_batch.shift(offset);
+        // multibody links follow the base, their colliders were moved above
+        auto& multi_bodies = world->multi_bodies();
+        for (int i = 0; i < multi_bodies.size(); i++) {
+            multi_bodies[i]->setBasePos(multi_bodies[i]->getBasePos() - offset);
+        }
+        const glm::vec3 glm_offset(offset.x(), offset.y(), offset.z());
+        for (ObjectId id : kinematics) {
+            auto it = objects.find(id);
+            if (it == objects.end()) continue;
+            for (Keyframe& key : static_cast<Kinematic*>(it->second.get())->keys) {
+                key.position -= glm_offset;
+            }
+        }
+        for (btVector3& focus : lod.focus_points) focus -= offset;
+        debris.shift(glm_offset);
+
+        for (int i = 0; i < dispatcher->getNumManifolds(); i++) {
+            btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+            for (int p = 0; p < manifold->getNumContacts(); p++) {
+                btManifoldPoint& contact = manifold->getContactPoint(p);
+                contact.m_positionWorldOnA -= offset;
+                contact.m_positionWorldOnB -= offset;
+            }
+        }
+        if (auto grid = dynamic_cast<HashGridBroadphase*>(broadphase.get())) {
+            grid->shift(offset);
+        } else {
+            shift_tree(static_cast<btDbvtBroadphase*>(broadphase.get()), offset);
+        }
+
+        origin += glm::dvec3(glm_offset);
+        structure++;
+    }
+
+    /** Put the objects of arr in the order of their cells on a Z-order curve */
+    template <typename T>
+    void sort_by_position(btAlignedObjectArray<T*>& arr, const btVector3& min) {
+        const int count = arr.size();
+        sort_keys.resize(count);
+        sort_scratch.resize(count);
+        for (int i = 0; i < count; i++) {
+            const btVector3 cell = (arr[i]->getWorldTransform().getOrigin() - min) / SORT_CELL;
+            uint64_t key = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                const btScalar c = btMin(btMax(cell[axis], btScalar(0)), btScalar(SORT_CELL_LIMIT));
+                key |= spread_bits(uint64_t(c)) << axis;
+            }
+            // the index breaks ties, so the order does not depend on addresses
+            sort_keys[i] = std::make_pair(key, i);
+            sort_scratch[i] = arr[i];
+        }
+        std::sort(sort_keys.begin(), sort_keys.end());
+        for (int i = 0; i < count; i++) {
+            arr[i] = static_cast<T*>(sort_scratch[sort_keys[i].second]);
+        }
+    }
+
+    /**
+     * Sort the collision object array and the array of moving bodies along
+     * a Z-order curve of positions, every sort_interval steps.
+     *
+     * Objects stay in the order they were added, and removing one swaps the
+     * last one into its slot, so after a while neighbours are all over the
+     * arrays. Bullet gathers islands and solver bodies in array order, with
+     * sorted arrays the bodies of an island are visited close together.
+     * Island tags are indices to the collision object array, they are given
+     * again at the start of every step.
+     */
+    void sort_spatially() {
+        if (sort_interval <= 0 || ++sort_steps < sort_interval) return;
+        sort_steps = 0;
+        btCollisionObjectArray& arr = world->getCollisionObjectArray();
+        if (arr.size() < 2) return;
+        btVector3 min = arr[0]->getWorldTransform().getOrigin();
+        for (int i = 1; i < arr.size(); i++) {
+            min.setMin(arr[i]->getWorldTransform().getOrigin());
+        }
+        sort_by_position(arr, min);
+        sort_by_position(world->bodies(), min);
+    }
+
+    /** Start the rollback window over from the current state of everything */
+    void reset_rollback() {
+        rollback->reset(step_count);
+        rollback_structure = structure;
+        rollback_awake.clear();
+        for (const auto& kv : objects) {
+            rollback_state.clear();
+            kv.second->save_state(rollback_state);
+            if (rollback_state.empty()) continue;
+            rollback->add(kv.first, rollback_state.data(), rollback_state.size());
+            rollback_awake.push_back(kv.first);
+        }
+    }
+
+    bool capture_object(ObjectId id) {
+        auto it = objects.find(id);
+        if (it == objects.end()) return false;
+        rollback_state.clear();
+        it->second->save_state(rollback_state);
+        // members of piles have no state of their own
+        if (rollback_state.empty()) return true;
+        rollback_next_awake.push_back(id);
+        return rollback->change(id, rollback_state.data(), rollback_state.size());
+    }
+
+    /** Log the state of an object before a structural change in the step */
+    void rollback_touch(ObjectId id) {
+        if (!capture_object(id)) structure++;
+    }
+
+    /** Let the rollback window know an object it has not seen yet */
+    void rollback_appear(ObjectId id) {
+        if (rollback->state(id)) return;
+        rollback_state.clear();
+        objects[id]->save_state(rollback_state);
+        rollback->appear(id, rollback_state.data(), rollback_state.size());
+    }
+
+    /** Going back past a freeze or a wake by distance flips the object back */
+    void log_lod_flips() {
+        if (!rollback_logging) return;
+        for (const auto& flip : lod.flips) {
+            const ObjectId id = flip.first;
+            const bool froze = flip.second;
+            if (!objects.count(id)) continue;
+            rollback_touch(id);
+            rollback->log_undo([=]() {
+                auto it = objects.find(id);
+                if (it == objects.end()) return;
+                it->second->set_frozen(world.get(), !froze);
+                if (froze) lod.frozen.erase(id);
+                else lod.frozen.insert(id);
+            });
+        }
+    }
+
+    /**
+     * Log states of the objects which moved during the step, and of those
+     * which moved the step before, they may have just fallen asleep
+     */
+    void capture_rollback() {
+        rollback_logging = false;
+        if (!rollback) return;
+        if (structure != rollback_structure) {
+            reset_rollback();
+            return;
+        }
+        rollback_next_awake.clear();
+        bool ok = true;
+        auto& bodies = world->bodies();
+        for (int i = 0; i < bodies.size(); i++) {
+            if (bodies[i]->isActive()) ok = capture_object(get_object_id(bodies[i])) && ok;
+        }
+        auto& multi_bodies = world->multi_bodies();
+        for (int i = 0; i < multi_bodies.size(); i++) {
+            ok = capture_object(get_object_id(multi_bodies[i]->getBaseCollider())) && ok;
+        }
+        for (ObjectId id : kinematics) ok = capture_object(id) && ok;
+        for (ObjectId id : rollback_awake) {
+            if (!rollback->changed(id)) ok = capture_object(id) && ok;
+        }
+        rollback_awake.swap(rollback_next_awake);
+        if (!ok) reset_rollback();
+    }
+
+    /** Count bodies, islands and contacts after a step and publish them */
+    void update_stats() {
+        WorldStats s = WorldStats();
+        s.step = step_count;
+        const btCollisionObjectArray& arr = world->getCollisionObjectArray();
+        // island tags are indices to the object array, bit 1 marks a seen
+        // island and bit 2 an island with an active body
+        island_seen.assign(arr.size(), 0);
+        for (int i = 0; i < arr.size(); i++) {
+            const btCollisionObject* obj = arr[i];
+            // kinematic bodies have the static flag too
+            if ((obj->isStaticObject() && !obj->isKinematicObject())
+                    || obj->getInternalType() == btCollisionObject::CO_GHOST_OBJECT) {
+                continue;
+            }
+            s.bodies++;
+            const int state = obj->getActivationState();
+            const bool active = obj->isActive();
+            if (state == ISLAND_SLEEPING) s.sleeping_bodies++;
+            else if (state == DISABLE_SIMULATION) s.frozen_bodies++;
+            else s.active_bodies++;
+            const int tag = obj->getIslandTag();
+            if (tag >= 0 && tag < arr.size()) {
+                char& seen = island_seen[tag];
+                if (!(seen & 1)) s.islands++;
+                if (active && !(seen & 2)) s.active_islands++;
+                seen |= active ? 3 : 1;
+            }
+        }
+        s.overlapping_pairs = broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+        s.manifolds = dispatcher->getNumManifolds();
+        for (int i = 0; i < s.manifolds; i++) {
+            s.contact_points += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+        }
+        s.vehicles = int(vehicles.size());
+        const btPoolAllocator* manifold_pool = collision_config->getPersistentManifoldPool();
+        const btPoolAllocator* algorithm_pool = collision_config->getCollisionAlgorithmPool();
+        s.manifold_pool_used = manifold_pool->getUsedCount();
+        s.manifold_pool_size = manifold_pool->getMaxCount();
+        s.algorithm_pool_used = algorithm_pool->getUsedCount();
+        s.algorithm_pool_size = algorithm_pool->getMaxCount();
+        s.pool_bytes = size_t(manifold_pool->getMaxCount()) * manifold_pool->getElementSize()
+            + size_t(algorithm_pool->getMaxCount()) * algorithm_pool->getElementSize();
+        s.start_lateness_ms = jitter.last_ms;
+        s.average_lateness_ms = jitter.average_ms;
+        s.max_lateness_ms = jitter.max_ms();
+        s.late_starts = jitter.late_starts;
+        s.recorder_dropped = recorder ? recorder->dropped() : 0;
+        if (rollback) {
+            s.rollback_first = rollback->first_step();
+            s.rollback_last = rollback->last_step();
+            s.rollback_bytes = rollback->stored_scalars() * sizeof(btScalar);
+        }
+        s.memory = allocator_stats();
+        for (int i = 0; i < ALLOC_CATEGORIES; i++) {
+            s.step_allocations[i] = unsigned(s.memory.allocations[i] - step_allocations_base[i]);
+        }
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats = s;
+    }
+
+    /** Called by Bullet before every substep */
+    static void pre_tick(btDynamicsWorld* world, btScalar dt) {
+        auto self = static_cast<WorldRes*>(world->getWorldUserInfo());
+        auto& multi_bodies = self->world->multi_bodies();
+        for (int i = 0; i < multi_bodies.size(); i++) {
+            auto it = self->objects.find(get_object_id(multi_bodies[i]->getBaseCollider()));
+            if (it == self->objects.end()) continue;
+            if (auto truck = dynamic_cast<Truck*>(it->second.get())) {
+                truck->drive(self->world.get(), dt);
+            }
+        }
+        for (ObjectId id : self->kinematics) {
+            auto it = self->objects.find(id);
+            if (it != self->objects.end()) {
+                static_cast<Kinematic*>(it->second.get())->advance(dt);
+            }
+        }
+    }
+
+    void apply_quality() {
+        const QualityLevel& q = governor.quality();
+        world->getSolverInfo().m_numIterations = q.solver_iterations;
+        btCollisionObjectArray& arr = world->getCollisionObjectArray();
+        for (int i = 0; i < arr.size(); i++) {
+            arr[i]->setContactProcessingThreshold(q.contact_threshold);
+        }
     }
 };
 
-World::World() {
-    this->res = new WorldRes;
+World::World(Broadphase broadphase) {
+    this->res = new WorldRes(broadphase);
 
     res->world->setGravity(btVector3(0, -10, 0));
 }
@@ -111,28 +2093,177 @@ World::~World() {
     delete res;
 }
 
-void World::add_cube(ObjectId id, glm::mat4 transform, float mass, float x, float y, float z) {
+void World::add_cube(ObjectId id, glm::mat4 transform, float mass, float x, float y, float z,
+        Category category) {
     res->tasks.add([=]() {
-        unique_ptr<Cube> cube{new Cube};
         btTransform trans;
         trans.setFromOpenGLMatrix(glm::value_ptr(transform));
+        res->add_cube(id, trans, mass, btVector3(x, y, z), category);
+    });
+}
 
-        cube->state.reset(new MotionState(trans, id, this));
+void World::add_convex(ObjectId id, glm::mat4 transform, float mass,
+        const std::vector<glm::vec3>& points, Category category) {
+    // simplification is slow the first time, keep it out of the physics thread
+    const uint64_t key = hull_key(points, HULL_MAX_VERTICES);
+    auto hull = simplified_hull(points, HULL_MAX_VERTICES);
+    res->tasks.add([=]() {
+        btTransform trans;
+        trans.setFromOpenGLMatrix(glm::value_ptr(transform));
+        res->add_single_body(id, trans, mass, res->shapes.hull(key, hull), category);
+    });
+}
 
-        cube->shape.reset(new btBoxShape(btVector3(x, y, z)));
-        btVector3 inertia(0,0,0);
-        cube->shape->calculateLocalInertia(mass, inertia);
+void World::add_debris(glm::vec3 pos, glm::vec3 vel, float size) {
+    res->tasks.add([=]() {
+        res->debris.add(pos, vel, size);
+    });
+}
 
-        cube->body.reset(new btRigidBody(
-                    btRigidBody::btRigidBodyConstructionInfo(
-                        mass, cube->state.get(), cube->shape.get(), inertia)));
+void World::promote_debris(glm::vec3 center, float radius) {
+    res->tasks.add([=]() {
+        std::vector<glm::vec4> pos_size;
+        std::vector<glm::vec3> vel;
+        res->debris.take(center, radius, pos_size, vel);
+
+        std::vector<NewCube> created(pos_size.size());
+        for (size_t i = 0; i < pos_size.size(); i++) {
+            const glm::vec4& p = pos_size[i];
+            const float s = p.w;
+            btTransform trans(btQuaternion::getIdentity(), btVector3(p.x, p.y, p.z));
+            ObjectId id = res->next_debris_id++;
+            res->add_cube(id, trans, s*s*s, btVector3(s, s, s), Category::Debris,
+                    btVector3(vel[i].x, vel[i].y, vel[i].z));
+            created[i].id = id;
+            transform_to_matrix(trans, created[i].transform);
+            created[i].size = glm::vec3(s, s, s);
+        }
 
-        res->world->addRigidBody(cube->body.get());
-        res->objects[id] = move(cube);
+        std::lock_guard<std::mutex> lock(res->changes_mutex);
+        auto& out = published.new_cubes;
+        out.insert(out.end(), created.begin(), created.end());
     });
 }
 
-void World::add_car(ObjectId id, glm::mat4 transform) {
+void World::add_destructible(ObjectId id, glm::mat4 transform, float mass,
+        float x, float y, float z, int pieces, float strength, Category category) {
+    // fracturing is done once per shape and kept out of the physics thread
+    auto fragments = prefracture(glm::vec3(x, y, z), pieces);
+    res->tasks.add([=]() {
+        btTransform trans;
+        trans.setFromOpenGLMatrix(glm::value_ptr(transform));
+
+        const ObjectId pile_id = res->next_pile_id++;
+        unique_ptr<Pile> pile{new Pile};
+        pile->compound.reset(new btCompoundShape(true));
+        pile->shape = pile->compound.get();
+        pile->group = category_group(category);
+        pile->mask = category_mask(category);
+        pile->member_mass = mass / fragments.size();
+        pile->strength = strength;
+        pile->fragment_size = std::cbrt(x * y * z / fragments.size());
+
+        // fragment bodies are made here and parked out of the world until
+        // they break off, so breaking allocates nothing
+        std::vector<NewCube> created(fragments.size());
+        const btScalar volume = x * y * z;
+        for (size_t i = 0; i < fragments.size(); i++) {
+            const Fragment& f = fragments[i];
+            const ObjectId fragment_id = id + i;
+            const btTransform local(btQuaternion::getIdentity(), to_bt(f.center));
+            btCollisionShape* shape = res->shapes.box(to_bt(f.size));
+            const btScalar fragment_mass = mass * f.size.x * f.size.y * f.size.z / volume;
+            btVector3 inertia(0, 0, 0);
+            shape->calculateLocalInertia(fragment_mass, inertia);
+
+            unique_ptr<Body> fragment{new Body};
+            fragment->shape = shape;
+            btRigidBody::btRigidBodyConstructionInfo info(fragment_mass, nullptr, shape, inertia);
+            fragment->body.reset(new btRigidBody(info));
+            set_object_id(fragment->body.get(), fragment_id);
+            fragment->pile = pile_id;
+            res->objects[fragment_id] = move(fragment);
+
+            pile->compound->addChildShape(local, shape);
+            pile->members.push_back(fragment_id);
+            created[i].id = fragment_id;
+            transform_to_matrix(trans * local, created[i].transform);
+            created[i].size = f.size;
+        }
+
+        btVector3 inertia(0, 0, 0);
+        pile->compound->calculateLocalInertia(mass, inertia);
+        btRigidBody::btRigidBodyConstructionInfo info(mass, nullptr, pile->compound.get(), inertia);
+        info.m_startWorldTransform = trans;
+        pile->body.reset(new btRigidBody(info));
+        set_object_id(pile->body.get(), pile_id);
+        res->add_body(pile->body.get(), pile->group, pile->mask);
+        res->piles.insert(pile_id);
+        res->objects[pile_id] = move(pile);
+
+        std::lock_guard<std::mutex> lock(res->changes_mutex);
+        auto& out = published.new_cubes;
+        out.insert(out.end(), created.begin(), created.end());
+    });
+}
+
+void World::add_static_cube(ObjectId id, glm::mat4 transform, float x, float y, float z) {
+    res->tasks.add([=]() {
+        unique_ptr<StaticPiece> piece{new StaticPiece};
+        piece->transform.setFromOpenGLMatrix(glm::value_ptr(transform));
+        piece->shape.reset(new btBoxShape(btVector3(x, y, z)));
+        res->static_batch.add(piece.get());
+        res->objects[id] = move(piece);
+    });
+}
+
+void World::add_trigger(ObjectId id, glm::mat4 transform, float x, float y, float z) {
+    res->tasks.add([=]() {
+        unique_ptr<Trigger> trigger{new Trigger};
+        btTransform trans;
+        trans.setFromOpenGLMatrix(glm::value_ptr(transform));
+
+        auto& ghost = trigger->ghost;
+        ghost.reset(new btPairCachingGhostObject());
+        ghost->setCollisionShape(res->shapes.box(btVector3(x, y, z)));
+        ghost->setWorldTransform(trans);
+        ghost->setCollisionFlags(btCollisionObject::CF_STATIC_OBJECT
+                | btCollisionObject::CF_NO_CONTACT_RESPONSE);
+        set_object_id(ghost.get(), id);
+
+        const short mask = btBroadphaseProxy::AllFilter
+            & ~(btBroadphaseProxy::StaticFilter | btBroadphaseProxy::SensorTrigger);
+        res->world->addCollisionObject(ghost.get(), btBroadphaseProxy::SensorTrigger, mask);
+        res->objects[id] = move(trigger);
+        res->triggers.push_back(id);
+    });
+}
+
+void World::add_kinematic(ObjectId id, const std::vector<Keyframe>& keys, bool loop,
+        float x, float y, float z) {
+    if (keys.empty()) return;
+    res->tasks.add([=]() {
+        unique_ptr<Kinematic> k{new Kinematic};
+        k->keys = keys;
+        k->loop = loop;
+        for (const Keyframe& key : keys) {
+            k->rotations.push_back(btQuaternion(key.yaw, key.pitch, key.roll));
+        }
+        btRigidBody::btRigidBodyConstructionInfo info(0, nullptr, res->shapes.box(btVector3(x, y, z)));
+        info.m_startWorldTransform = k->pose_at(0);
+        k->body.reset(new btRigidBody(info));
+        k->body->setCollisionFlags(k->body->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+        k->body->setActivationState(DISABLE_DEACTIVATION);
+        set_object_id(k->body.get(), id);
+        // filtered like static bodies, so no pairs with them
+        res->add_body(k->body.get(), btBroadphaseProxy::StaticFilter,
+                btBroadphaseProxy::AllFilter & ~btBroadphaseProxy::StaticFilter);
+        res->objects[id] = move(k);
+        res->kinematics.push_back(id);
+    });
+}
+
+void World::add_car(ObjectId id, glm::mat4 transform, Category category) {
     res->tasks.add([=]() {
         const double mass = 800.0;
         const double wheel_width = 0.4;
@@ -147,7 +2278,6 @@ void World::add_car(ObjectId id, glm::mat4 transform) {
 
         unique_ptr<Car> car{new Car};
 
-        car->state.reset(new MotionState(trans, id, this));
         car->chassis_shape.reset(new btBoxShape(btVector3(1.f,0.5f, 2.0f)));
         car->compound.reset(new btCompoundShape());
         btTransform local_trans;
@@ -156,15 +2286,20 @@ void World::add_car(ObjectId id, glm::mat4 transform) {
         car->compound->addChildShape(local_trans, car->chassis_shape.get());
         btVector3 inertia(0,0,0);
         car->compound->calculateLocalInertia(mass,inertia);
-        car->chassis.reset(new btRigidBody(
-                btRigidBody::btRigidBodyConstructionInfo(
-                    mass, car->state.get(), car->compound.get(), inertia)));
-        res->world->addRigidBody(car->chassis.get());
+        btRigidBody::btRigidBodyConstructionInfo info(
+                mass, nullptr, car->compound.get(), inertia);
+        info.m_startWorldTransform = trans;
+        car->chassis.reset(new btRigidBody(info));
+        set_object_id(car->chassis.get(), id);
+        res->add_body(car->chassis.get(), category);
 
         car->ray_caster.reset(new btDefaultVehicleRaycaster(res->world.get()));
         car->vehicle.reset(new btRaycastVehicle(car->tuning, car->chassis.get(), car->ray_caster.get()));
+        car->wheel_width = wheel_width;
 		car->chassis->setActivationState(DISABLE_DEACTIVATION);
-        res->world->addVehicle(car->vehicle.get());
+        car->batch = &res->vehicle_batch;
+        car->tires = TireType::Dry;
+        res->vehicle_batch.add(car->vehicle.get(), car->tires);
 
         car->vehicle->addWheel(btVector3(1-(0.3*wheel_width), connection_height, 2-wheel_radius), wheel_direction, wheel_axle, suspension_rest_len, wheel_radius, car->tuning, true);
         car->vehicle->addWheel(btVector3(-1+(0.3*wheel_width), connection_height, 2-wheel_radius), wheel_direction, wheel_axle, suspension_rest_len, wheel_radius, car->tuning, true);
@@ -186,6 +2321,96 @@ void World::add_car(ObjectId id, glm::mat4 transform) {
             wheel.m_rollInfluence = rollInfluence;
         }
         res->objects[id] = move(car);
+        res->vehicles.push_back(id);
+    });
+}
+
+void World::add_truck(ObjectId id, glm::mat4 transform, int trailers, Category category) {
+    trailers = std::max(0, std::min(trailers, TRUCK_MAX_TRAILERS));
+    res->tasks.add([=]() {
+        btTransform trans;
+        trans.setFromOpenGLMatrix(glm::value_ptr(transform));
+
+        unique_ptr<Truck> truck{new Truck};
+        btCollisionShape* tractor_shape = res->shapes.box(to_bt(TRUCK_TRACTOR_SIZE));
+        btCollisionShape* trailer_shape = res->shapes.box(to_bt(TRUCK_TRAILER_SIZE));
+        btVector3 tractor_inertia, trailer_inertia;
+        tractor_shape->calculateLocalInertia(Truck::TRACTOR_MASS, tractor_inertia);
+        trailer_shape->calculateLocalInertia(Truck::TRAILER_MASS, trailer_inertia);
+
+        truck->body.reset(new btMultiBody(trailers, Truck::TRACTOR_MASS, tractor_inertia, false, false));
+        btMultiBody* body = truck->body.get();
+        body->setBasePos(trans.getOrigin());
+        body->setWorldToBaseRot(trans.getRotation().inverse());
+        body->setHasSelfCollision(false);
+        // Bullet damps multibodies quadratically, rolling resistance of the
+        // wheels slows trucks down instead
+        body->setLinearDamping(0);
+        for (int i = 0; i < trailers; i++) {
+            const glm::vec3 hitch = i == 0 ? TRUCK_FIFTH_WHEEL : TRUCK_TRAILER_REAR;
+            body->setupRevolute(i, Truck::TRAILER_MASS, trailer_inertia, i - 1,
+                    btQuaternion::getIdentity(), btVector3(0, 1, 0),
+                    to_bt(hitch), -to_bt(TRUCK_TRAILER_FRONT), true);
+        }
+
+        // link colliders follow the multibody from the first step on, place
+        // them here already for the first poses
+        std::vector<NewCube> created(trailers + 1);
+        btVector3 offset(0, 0, 0);
+        for (int link = -1; link < trailers; link++) {
+            btCollisionShape* shape = link < 0 ? tractor_shape : trailer_shape;
+            if (link >= 0) {
+                const glm::vec3 hitch = link == 0 ? TRUCK_FIFTH_WHEEL : TRUCK_TRAILER_REAR;
+                offset += to_bt(hitch) - to_bt(TRUCK_TRAILER_FRONT);
+            }
+            const ObjectId segment_id = id + link + 1;
+            btTransform segment_trans = trans * btTransform(btQuaternion::getIdentity(), offset);
+
+            unique_ptr<btMultiBodyLinkCollider> collider{new btMultiBodyLinkCollider(body, link)};
+            collider->setCollisionShape(shape);
+            collider->setWorldTransform(segment_trans);
+            collider->setActivationState(DISABLE_DEACTIVATION);
+            if (link < 0) {
+                body->setBaseCollider(collider.get());
+            } else {
+                body->getLink(link).m_collider = collider.get();
+            }
+            set_object_id(collider.get(), segment_id);
+            collider->setContactProcessingThreshold(res->governor.quality().contact_threshold);
+            res->world->addCollisionObject(collider.get(),
+                    category_group(category), category_mask(category));
+
+            // wheels sit under the bottom of the segment, the tractor steers
+            // with the front axle and drives the rear one, trailers roll on
+            // one axle at the rear and hang from the hitch at the front
+            const glm::vec3 size = link < 0 ? TRUCK_TRACTOR_SIZE : TRUCK_TRAILER_SIZE;
+            const btScalar x = size.x - Truck::WHEEL_WIDTH / 2;
+            if (link < 0) {
+                for (btScalar z : { size.z - 0.9f, -size.z + 0.9f }) {
+                    for (btScalar side : { -x, x }) {
+                        truck->wheels.push_back(Truck::Wheel(link, btVector3(side, -size.y, z), z < 0, z > 0));
+                    }
+                }
+            } else {
+                for (btScalar side : { -x, x }) {
+                    truck->wheels.push_back(Truck::Wheel(link, btVector3(side, -size.y, -size.z + 1), false, false));
+                }
+            }
+
+            NewCube& cube = created[link + 1];
+            cube.id = segment_id;
+            transform_to_matrix(segment_trans, cube.transform);
+            cube.size = link < 0 ? TRUCK_TRACTOR_SIZE : TRUCK_TRAILER_SIZE;
+            truck->colliders.push_back(move(collider));
+        }
+        res->world->addMultiBody(body);
+        res->structure++;
+        res->objects[id] = move(truck);
+        res->vehicles.push_back(id);
+
+        std::lock_guard<std::mutex> lock(res->changes_mutex);
+        auto& out = published.new_cubes;
+        out.insert(out.end(), created.begin(), created.end());
     });
 }
 
@@ -195,6 +2420,10 @@ void World::engine(ObjectId cid, bool run) {
         auto it = res->objects.find(cid);
         if (it != res->objects.end()) {
             cout << "engine set to " << run << " for " << cid << endl;
+            if (auto truck = dynamic_cast<Truck*>(it->second.get())) {
+                truck->throttle = run ? 1 : 0;
+                return;
+            }
             auto car = dynamic_cast<Car*>(it->second.get());
             auto veh = car->vehicle.get();
             veh->applyEngineForce(force, 2);
@@ -207,6 +2436,10 @@ void World::steer(ObjectId cid, float val) {
         auto it = res->objects.find(cid);
         if (it != res->objects.end()) {
             cout << "seer set to " << val << " for " << cid << endl;
+            if (auto truck = dynamic_cast<Truck*>(it->second.get())) {
+                truck->steering = val;
+                return;
+            }
             auto car = dynamic_cast<Car*>(it->second.get());
             auto veh = car->vehicle.get();
             veh->setSteeringValue(val, 0);
@@ -215,28 +2448,71 @@ void World::steer(ObjectId cid, float val) {
     });
 }
 
+void World::set_tires(ObjectId id, TireType tires) {
+    res->tasks.add([=]() {
+        auto it = res->objects.find(id);
+        if (it == res->objects.end()) return;
+        if (auto car = dynamic_cast<Car*>(it->second.get())) {
+            car->tires = tires;
+            car->batch->set_tires(car->vehicle.get(), tires);
+        }
+    });
+}
+
 void World::remove(ObjectId id) {
     res->tasks.add([=]() {
         auto it = res->objects.find(id);
         if (it != res->objects.end()) {
             auto obj = it->second.get();
+            auto body = dynamic_cast<Body*>(obj);
+            if (body && body->pile) {
+                auto pile = static_cast<Pile*>(res->objects[body->pile].get());
+                auto index = std::find(pile->members.begin(), pile->members.end(), id)
+                    - pile->members.begin();
+                res->split_pile(body->pile, std::vector<size_t>(1, index));
+            }
+            if (res->lod.frozen.erase(id)) {
+                obj->set_frozen(res->world.get(), false);
+            }
+            res->structure++;
+            if (res->recorder) {
+                res->record_removed.push_back(id);
+                res->recorded.erase(id);
+                if (auto truck = dynamic_cast<Truck*>(obj)) {
+                    for (const auto& collider : truck->colliders) {
+                        const ObjectId segment = get_object_id(collider.get());
+                        if (segment == id) continue;
+                        res->record_removed.push_back(segment);
+                        res->recorded.erase(segment);
+                    }
+                }
+            }
             obj->remove_from_world(res->world.get());
             res->objects.erase(it);
+            auto& vehicles = res->vehicles;
+            vehicles.erase(std::remove(vehicles.begin(), vehicles.end(), id), vehicles.end());
+            auto& kinematics = res->kinematics;
+            kinematics.erase(std::remove(kinematics.begin(), kinematics.end(), id), kinematics.end());
+            auto& triggers = res->triggers;
+            triggers.erase(std::remove(triggers.begin(), triggers.end(), id), triggers.end());
         }
     });
 }
 
-std::unordered_map<ObjectId, glm::mat4> World::get_and_reset_changes() {
-    std::unordered_map<ObjectId, glm::mat4> result;
-    std::lock_guard<std::mutex> lock(res->changes_mutex);
-    this->changes.swap(result);
+Snapshot World::take_snapshot() {
+    Snapshot result;
+    std::vector<std::shared_ptr<PoseRecorder>> closing;
+    {
+        std::lock_guard<std::mutex> lock(res->changes_mutex);
+        std::swap(result, this->published);
+        published.origin = result.origin;
+        closing.swap(res->closing_recorders);
+    }
+    // waits for the writers to finish, outside the lock
+    closing.clear();
     return result;
 }
 
-void World::update_change(ObjectId id, const glm::mat4& change) {
-    res->step_changes.push_back(std::make_pair(id, change));
-}
-
 void World::single_step() {
     // only allow calling this when the thread is not running
     assert(res->thread_status == Idle);
@@ -244,16 +2520,247 @@ void World::single_step() {
 }
 
 void World::single_step_() {
+    const AllocatorStats memory = allocator_stats();
+    std::copy_n(memory.allocations, ALLOC_CATEGORIES, res->step_allocations_base);
     res->tasks.run();
-    // step single fixed time
-    this->res->world->stepSimulation(1.0/60.0, 0);
+    if (res->static_batch.flush(res->world.get())) {
+        res->debris.set_ground(res->static_batch.ground_boxes());
+    }
+    // the record is opened after the tasks, a rollback among them rewinds
+    // the records before it and removals start the window over anyway
+    if (res->rollback) {
+        res->rollback->begin(res->step_count + 1);
+        res->rollback_logging = true;
+    }
+    if (res->lod.update(res->world->bodies(), res->objects, res->world.get())) {
+        res->log_lod_flips();
+    }
+    // step single fixed time, split to substeps by the quality level. One
+    // substep is a plain variable step like before the governor existed
+    const btScalar step_time = 1.0/60.0;
+    const int substeps = res->governor.quality().substeps;
+    res->sort_spatially();
+    this->res->world->stepSimulation(step_time, substeps > 1 ? substeps : 0, step_time / substeps);
+    res->split_impacted_piles();
+    res->merge_piles();
+    res->update_triggers();
+    res->world->export_poses(res->poses);
+    res->expand_pile_poses(res->poses);
+    res->export_kinematic_poses(res->poses);
+    res->step_count++;
+    res->record_step();
+    res->capture_rollback();
+    res->publish_telemetry(step_time / substeps);
+    res->export_wheels();
+    res->update_stats();
+
+    const btVector3 g = res->world->getGravity();
+    res->debris.step(step_time, glm::vec3(g.x(), g.y(), g.z()));
+    res->debris.export_instances(res->debris_instances);
     {
         std::lock_guard<std::mutex> lock(res->changes_mutex);
-        for (auto change : res->step_changes) {
-            this->changes[change.first] = change.second;
+        const PoseBuffer& poses = res->poses;
+        for (size_t i = 0; i < poses.count; i++) {
+            published.changes[poses.ids[i]] = poses.transforms[i];
+        }
+        const PoseBuffer& wheels = res->wheel_poses;
+        for (size_t i = 0; i < wheels.count;) {
+            size_t end = i + 1;
+            while (end < wheels.count && wheels.ids[end] == wheels.ids[i]) end++;
+            published.wheels[wheels.ids[i]].assign(
+                    wheels.transforms.begin() + i, wheels.transforms.begin() + end);
+            i = end;
+        }
+        auto& events = res->trigger_events;
+        published.trigger_events.insert(published.trigger_events.end(), events.begin(), events.end());
+        events.clear();
+        // the swap leaves stale instances in debris_instances, so remember
+        // whether there is something to clear on the game side
+        if (res->debris_published || !res->debris_instances.empty()) {
+            res->debris_published = !res->debris_instances.empty();
+            published.debris.swap(res->debris_instances);
+            published.debris_updated = true;
         }
     }
-    res->step_changes.clear();
+}
+
+void World::set_focus(int slot, glm::vec3 pos) {
+    res->tasks.add([=]() {
+        res->lod.set_focus(slot, btVector3(pos.x, pos.y, pos.z));
+    });
+}
+
+void World::rebase(glm::vec3 offset) {
+    res->tasks.add([=]() {
+        res->rebase(to_bt(offset));
+        // poses published before are relative to the old origin
+        std::lock_guard<std::mutex> lock(res->changes_mutex);
+        for (auto& change : published.changes) shift_matrix(change.second, offset);
+        for (NewCube& cube : published.new_cubes) shift_matrix(cube.transform, offset);
+        for (auto& wheels : published.wheels) {
+            for (glm::mat4& m : wheels.second) shift_matrix(m, offset);
+        }
+        for (glm::vec4& d : published.debris) d -= glm::vec4(offset, 0.0f);
+        published.origin = res->origin;
+    });
+}
+
+void World::remove_focus(int slot) {
+    res->tasks.add([=]() {
+        res->lod.remove_focus(slot);
+    });
+}
+
+void World::set_spatial_sort(float interval) {
+    res->tasks.add([=]() {
+        // steps are 1/60 s
+        res->sort_interval = interval > 0 ? std::max(1, int(std::lround(interval * 60))) : 0;
+        // the first sort is on the next step
+        res->sort_steps = res->sort_interval - 1;
+    });
+}
+
+void World::set_lod_radius(float radius) {
+    res->tasks.add([=]() {
+        res->lod.radius = radius;
+    });
+}
+
+GovernorMetrics World::governor_metrics() {
+    return res->governor.read_metrics();
+}
+
+std::shared_ptr<TelemetryStream> World::open_telemetry(size_t capacity) {
+    auto stream = std::make_shared<TelemetryStream>(capacity);
+    res->tasks.add([=]() {
+        res->telemetry_streams.push_back(stream);
+    });
+    return stream;
+}
+
+void World::set_pile_merging(bool enabled) {
+    res->tasks.add([=]() {
+        res->pile_merging = enabled;
+        if (!enabled) {
+            std::vector<ObjectId> piles(res->piles.begin(), res->piles.end());
+            for (ObjectId id : piles) {
+                res->split_pile(id);
+            }
+        }
+    });
+}
+
+void World::start_recording(const string& path, int chunk_steps) {
+    // the file is created here so that failures throw to the caller
+    std::shared_ptr<PoseRecorder> recorder(new PoseRecorder(path, chunk_steps));
+    res->game_recorder = recorder;
+    // mutable so that the task does not keep a reference of its own
+    res->tasks.add([=]() mutable {
+        res->retire_recorder();
+        res->recorder = std::move(recorder);
+        res->recorded.clear();
+        res->record_removed.clear();
+        res->record_all = true;
+    });
+}
+
+void World::set_rollback_window(int steps) {
+    res->tasks.add([=]() {
+        if (steps <= 0) {
+            res->rollback.reset();
+            return;
+        }
+        res->rollback.reset(new RollbackRing(steps));
+        res->reset_rollback();
+    });
+}
+
+void World::rollback(uint64_t step) {
+    res->tasks.add([=]() {
+        if (!res->rollback) return;
+        std::vector<ObjectId>& restored = res->rollback_restored;
+        restored.clear();
+        const bool ok = res->rollback->rewind(step, [&](ObjectId id, const btScalar* state, size_t) {
+            // piles dissolved by undoing their merge are gone
+            auto it = res->objects.find(id);
+            if (it == res->objects.end()) return;
+            it->second->load_state(state);
+            restored.push_back(id);
+        });
+        if (!ok) {
+            cerr << "Step " << step << " is not in the rollback window" << endl;
+            return;
+        }
+        std::sort(restored.begin(), restored.end());
+        restored.erase(std::unique(restored.begin(), restored.end()), restored.end());
+        // a pile restored before an undo dissolved it, members inside piles
+        // have no body in the world
+        restored.erase(std::remove_if(restored.begin(), restored.end(), [&](ObjectId id) {
+            auto it = res->objects.find(id);
+            if (it == res->objects.end()) return true;
+            auto body = dynamic_cast<Body*>(it->second.get());
+            return body && body->pile;
+        }), restored.end());
+        auto& awake = res->rollback_awake;
+        awake.erase(std::remove_if(awake.begin(), awake.end(),
+                    [&](ObjectId id) { return !res->objects.count(id); }), awake.end());
+        awake.insert(awake.end(), restored.begin(), restored.end());
+        res->record_all = true;
+
+        std::unordered_set<const btCollisionObject*> moved;
+        for (ObjectId id : restored) {
+            PObj* obj = res->objects[id].get();
+            if (auto body = dynamic_cast<Body*>(obj)) moved.insert(body->body.get());
+            else if (auto car = dynamic_cast<Car*>(obj)) moved.insert(car->chassis.get());
+            else if (auto k = dynamic_cast<Kinematic*>(obj)) moved.insert(k->body.get());
+            else if (auto truck = dynamic_cast<Truck*>(obj)) {
+                for (const auto& collider : truck->colliders) moved.insert(collider.get());
+            }
+        }
+        for (const btCollisionObject* obj : moved) {
+            res->world->updateSingleAabb(const_cast<btCollisionObject*>(obj));
+        }
+        res->forget_contacts(moved);
+
+        // restored bodies may be asleep now, publish where they went
+        PoseBuffer poses;
+        poses.reserve(moved.size());
+        for (const btCollisionObject* obj : moved) {
+            if (!obj->isStaticOrKinematicObject()) {
+                DynamicsWorld::export_pose(obj, poses, poses.count, true);
+            }
+        }
+        res->expand_pile_poses(poses);
+        res->export_kinematic_poses(poses);
+        std::lock_guard<std::mutex> lock(res->changes_mutex);
+        for (size_t i = 0; i < poses.count; i++) {
+            published.changes[poses.ids[i]] = poses.transforms[i];
+        }
+    });
+}
+
+void World::stop_recording() {
+    res->game_recorder.reset();
+    res->tasks.add([=]() {
+        res->retire_recorder();
+    });
+}
+
+void World::drain_recording() {
+    if (res->game_recorder) res->game_recorder->drain();
+}
+
+void World::set_thread_config(const util::ThreadConfig& config) {
+    res->tasks.add([=]() {
+        res->thread_config = config;
+        res->thread_config_changed = true;
+    });
+}
+
+void World::set_governor(bool enabled) {
+    res->tasks.add([=]() {
+        res->governor.enabled = enabled;
+    });
 }
 
 void World::run() {
@@ -275,11 +2782,26 @@ void World::run() {
         // if the simulation is too slow, then tough luck
         // excessive time is spent in sleep
         const auto step_time = std::chrono::milliseconds(1000/60);
+        util::configure_thread(res->thread_config);
+        auto scheduled = std::chrono::steady_clock::now();
         while (res->thread_status == Running) {
             auto start_time = std::chrono::steady_clock::now();
+            std::chrono::duration<float, std::milli> lateness = start_time - scheduled;
+            res->jitter.record(lateness.count());
             single_step_();
+            if (res->thread_config_changed) {
+                res->thread_config_changed = false;
+                util::configure_thread(res->thread_config);
+            }
+
+            std::chrono::duration<float, std::milli> took =
+                std::chrono::steady_clock::now() - start_time;
+            if (res->governor.update(took.count())) {
+                res->apply_quality();
+            }
 
-            std::this_thread::sleep_until(start_time + step_time);
+            scheduled = start_time + step_time;
+            std::this_thread::sleep_until(scheduled);
         }
 
         auto expected = Stopping;
@@ -297,13 +2819,18 @@ void World::stop() {
     }
 }
 
+WorldStats World::stats() {
+    std::lock_guard<std::mutex> lock(res->stats_mutex);
+    return res->stats;
+}
+
 void World::printworld() {
     cout << "//printworld\n";
     const btCollisionObjectArray& arr = res->world->getCollisionObjectArray();
     for (int i = 0; i < arr.size(); i++) {
-        const auto& body = dynamic_cast<btRigidBody*>(arr[i]);
-        btTransform trans;
-        body->getMotionState()->getWorldTransform(trans);
+        const auto& body = btRigidBody::upcast(arr[i]);
+        if (!body) continue;
+        const btTransform& trans = body->getWorldTransform();
         cout << " " << (body->isStaticObject() ? string("static obj") : string("obj")) << endl;
         auto o = trans.getOrigin();
         cout << "  loc: " << o.getX() << ' ' << o.getY() << ' ' << o.getZ() << endl;
@@ -1,30 +1,263 @@
 #pragma once
 
 #include <unordered_map>
+#include <vector>
 #include "../common.hpp"
+#include "../util/spsc_ring.hpp"
+#include "../util/thread.hpp"
+#include "allocator.hpp"
+#include "governor.hpp"
+#include "tires.hpp"
 
 namespace physics {
 
+    /**
+     * Collision categories of bodies, filtered in the broadphase:
+     * Debris does not collide with other debris and Cargo not with other
+     * cargo, everything else collides with everything.
+     */
+    enum class Category {
+        Default, Debris, Cargo, Vehicle
+    };
+
+    /**
+     * Broadphase of a world: Tree is Bullet's dynamic AABB tree, good for
+     * anything. HashGrid suits scenes of many small bodies of similar size,
+     * like debris and cargo piles, see HashGridBroadphase.
+     */
+    enum class Broadphase {
+        Tree, HashGrid
+    };
+
+    /** Counters of the world after the latest step, see World::stats */
+    struct WorldStats {
+        uint64_t step;
+        // dynamic and kinematic bodies, triggers and static pieces excluded,
+        // frozen ones are far from every focus point
+        int bodies, active_bodies, sleeping_bodies, frozen_bodies;
+        int islands, active_islands;
+        int overlapping_pairs, manifolds, contact_points;
+        int vehicles;
+        // manifolds and collision algorithms come from fixed pools, Bullet
+        // falls back to the heap when a pool runs out
+        int manifold_pool_used, manifold_pool_size;
+        int algorithm_pool_used, algorithm_pool_size;
+        size_t pool_bytes; // reserved by both pools
+        // how late steps of the background thread start, the scheduling
+        // jitter: last, smoothed and worst of the last few seconds
+        float start_lateness_ms, average_lateness_ms, max_lateness_ms;
+        unsigned late_starts; // started more than a millisecond late
+        uint64_t recorder_dropped; // steps the pose recorder had no room for
+        // steps which World::rollback can go back to, and memory it takes
+        uint64_t rollback_first, rollback_last;
+        size_t rollback_bytes;
+        AllocatorStats memory;
+        unsigned step_allocations[ALLOC_CATEGORIES]; // during the latest step
+    };
+
+    /** Vertex budget of convex hulls, GJK cost grows with the vertex count */
+    const int HULL_MAX_VERTICES = 32;
+
+    /**
+     * Truck layout, all in half extents or offsets from the segment center.
+     * Trailers hang from the fifth wheel of the tractor or from the rear
+     * hitch of the previous trailer, hitches turn around the up axis.
+     */
+    const int TRUCK_MAX_TRAILERS = 8;
+    const glm::vec3 TRUCK_TRACTOR_SIZE(1.2f, 1.0f, 2.5f);
+    const glm::vec3 TRUCK_TRAILER_SIZE(1.2f, 1.5f, 5.0f);
+    const glm::vec3 TRUCK_FIFTH_WHEEL(0.0f, 0.5f, -2.0f);
+    const glm::vec3 TRUCK_TRAILER_FRONT(0.0f, 0.0f, 4.5f);
+    const glm::vec3 TRUCK_TRAILER_REAR(0.0f, 0.0f, -6.5f);
+
+    /** Pose of a kinematic body at a moment on its path */
+    struct Keyframe {
+        float time; // seconds from the start of the path, increasing
+        glm::vec3 position;
+        float yaw, pitch, roll; // radians around y, x and z
+    };
+
+    /** Wheels reported per vehicle in VehicleTelemetry */
+    const int TELEMETRY_WHEELS = 4;
+
+    struct WheelTelemetry {
+        float rpm;
+        float slip; // 0 is full grip, 1 is sliding
+        float compression; // suspension compression in meters
+        bool in_contact;
+        ObjectId contact; // object under the wheel when in contact
+    };
+
+    /** State of a vehicle after a simulation step */
+    struct VehicleTelemetry {
+        ObjectId vehicle;
+        uint64_t step;
+        float speed; // forward speed in m/s
+        int wheel_count; // of a truck, the tractor wheels
+        WheelTelemetry wheels[TELEMETRY_WHEELS];
+    };
+
+    typedef util::SpscRing<VehicleTelemetry> TelemetryStream;
+
+    /** Box created by the simulation itself, for example from debris */
+    struct NewCube {
+        ObjectId id;
+        glm::mat4 transform;
+        glm::vec3 size; // half extents
+    };
+
+    /** Object entered or left a trigger volume */
+    struct TriggerEvent {
+        ObjectId trigger;
+        ObjectId object;
+        bool enter; // false when leaving
+    };
+
+    /** Everything published by the simulation since the previous snapshot */
+    struct Snapshot {
+        std::unordered_map<ObjectId, glm::mat4> changes;
+        std::vector<NewCube> new_cubes;
+        /** Trigger enter and exit events in the order they happened */
+        std::vector<TriggerEvent> trigger_events;
+        /** Debris particles, xyz is position and w is half size */
+        std::vector<glm::vec4> debris;
+        bool debris_updated;
+        /**
+         * Wheel transforms of moved vehicles by vehicle id, scaled so that a
+         * cylinder of radius 1 from -1 to 1 along x fills the wheel
+         */
+        std::unordered_map<ObjectId, std::vector<glm::mat4>> wheels;
+        /** Where the world origin is after World::rebase, poses are relative to it */
+        glm::dvec3 origin;
+
+        Snapshot() : debris_updated(false), origin(0.0) {}
+    };
+
     struct WorldRes;
     class World {
         WorldRes* res;
-        std::unordered_map<ObjectId, glm::mat4> changes;
+        Snapshot published;
         void single_step_();
 
     public:
-        World();
+        explicit World(Broadphase broadphase = Broadphase::Tree);
         ~World();
 
         /** Add a box to the world, can be called from other threads*/
-        void add_cube(ObjectId id, glm::mat4 transform, float mass, float x, float y, float z);
-        void add_car(ObjectId id, glm::mat4 transform);
+        void add_cube(ObjectId id, glm::mat4 transform, float mass, float x, float y, float z,
+                Category category = Category::Default);
+        /**
+         * Add a convex body, the hull of points is simplified to at most
+         * HULL_MAX_VERTICES vertices
+         */
+        void add_convex(ObjectId id, glm::mat4 transform, float mass,
+                const std::vector<glm::vec3>& points, Category category = Category::Default);
+        /**
+         * Add a destructible box, prefractured into about pieces fragments.
+         * It is simulated as one body until a contact impulse exceeds
+         * strength, then the fragments around the contact break off.
+         * Fragment n gets id + n, all fragments are reported in
+         * Snapshot::new_cubes. Settled fragments merge again like piles.
+         */
+        void add_destructible(ObjectId id, glm::mat4 transform, float mass,
+                float x, float y, float z, int pieces, float strength,
+                Category category = Category::Default);
+        /** Add a static box, merged with the other static boxes into one body */
+        void add_static_cube(ObjectId id, glm::mat4 transform, float x, float y, float z);
+        /**
+         * Add a box shaped trigger volume. Enter and exit events of bodies
+         * are reported in Snapshot::trigger_events, based on AABB overlap
+         * at the end of each step. A removed body exits.
+         */
+        void add_trigger(ObjectId id, glm::mat4 transform, float x, float y, float z);
+        /**
+         * Add a kinematic box which follows a path through keyframes, for
+         * gates, lifts and ferries. Positions move along a Catmull-Rom
+         * spline and rotations are interpolated spherically. A looping path
+         * should end where it starts, it starts over after the last
+         * keyframe. Otherwise the box stays at the last keyframe. Bodies in contact are pushed and carried along, but nothing
+         * pushes back and it costs about as much as a static box.
+         */
+        void add_kinematic(ObjectId id, const std::vector<Keyframe>& keys, bool loop,
+                float x, float y, float z);
+        void add_car(ObjectId id, glm::mat4 transform, Category category = Category::Vehicle);
+        /**
+         * Add a truck with trailers as one articulated body on raycast
+         * wheels. The tractor gets id and trailer n gets id + n, all segments
+         * are reported in Snapshot::new_cubes and the wheels of all segments
+         * in Snapshot::wheels under id. engine, steer and remove take the
+         * tractor id. At rest the tractor center is about 1.8 above ground.
+         */
+        void add_truck(ObjectId id, glm::mat4 transform, int trailers,
+                Category category = Category::Vehicle);
         void engine(ObjectId id, bool run);
+        /**
+         * Open a telemetry stream. After each step the physics thread pushes
+         * one VehicleTelemetry per vehicle into every stream without locking,
+         * one other thread may pop them. Samples are dropped while a stream
+         * is full, and a stream closes when its last reference goes away.
+         */
+        std::shared_ptr<TelemetryStream> open_telemetry(size_t capacity);
         void steer(ObjectId id, float val);
+        /** Change tires of a car, cars start with TireType::Dry */
+        void set_tires(ObjectId id, TireType tires);
 
         void remove(ObjectId id);
 
-        /** Get the changes to objects, can be called from other threads */
-        std::unordered_map<ObjectId, glm::mat4> get_and_reset_changes();
+        /**
+         * Add a debris particle, a tiny cube which is not a real body. Debris
+         * only collides with static boxes and costs next to nothing.
+         */
+        void add_debris(glm::vec3 pos, glm::vec3 vel, float size);
+        /**
+         * Turn debris within radius of center into real cubes, they are
+         * reported in Snapshot::new_cubes
+         */
+        void promote_debris(glm::vec3 center, float radius);
+
+        /**
+         * Set simulation focus point in given slot (for example camera or
+         * player). Dynamic bodies far from all focus points stop simulating
+         * and publishing poses until a focus point gets close again, other
+         * bodies still collide with them as if they were static. Without
+         * any focus points everything is simulated.
+         */
+        void set_focus(int slot, glm::vec3 pos);
+        void remove_focus(int slot);
+        /** Distance from focus points where bodies are still simulated */
+        void set_lod_radius(float radius);
+
+        /**
+         * Move the origin of the world to offset, for maps too big for float
+         * precision. Everything in the world, focus points and debris
+         * included, is shifted by -offset in one pass, and the broadphase is
+         * shifted in place instead of being rebuilt. Positions given after
+         * this call are relative to the new origin, Snapshot::origin tells
+         * which origin published poses are relative to. The recorder keeps
+         * positions relative to the first origin. Starts the rollback window
+         * over.
+         */
+        void rebase(glm::vec3 offset);
+
+        /**
+         * Enable or disable merging of settled piles (enabled by default).
+         * Islands of bodies which have slept for a few seconds are fused
+         * into one compound body, which splits back into the original
+         * bodies when hit hard or moved. Disabling splits all piles.
+         */
+        void set_pile_merging(bool enabled);
+
+        /**
+         * Sort bodies in Bullet's object arrays by position along a Z-order
+         * curve every interval seconds of simulation, 0 never (default).
+         * The first sort is on the next step.
+         * Islands and solver bodies are gathered in array order, which
+         * otherwise scatters over time as bodies come and go.
+         */
+        void set_spatial_sort(float interval);
+
+        /** Get the changes since last call, can be called from other threads */
+        Snapshot take_snapshot();
 
         /** Perform single simulation step */
         void single_step();
@@ -34,10 +267,53 @@ namespace physics {
 
         /** Stop and wait for background simulation to die, callable from other threads */
         void stop();
+        /**
+         * Name, CPU and priority of the background thread, applied when it
+         * starts or on the next step when it is running
+         */
+        void set_thread_config(const util::ThreadConfig& config);
+
+        /**
+         * Enable or disable the frame-time governor of the background thread.
+         * When enabled, solver quality is lowered when steps take too long.
+         */
+        void set_governor(bool enabled);
+        /** Latest governor state, can be called from other threads */
+        GovernorMetrics governor_metrics();
+
+        /**
+         * Record poses of all bodies after every step to a file, see
+         * PoseRecorder, until stop_recording. Replaces a recording in
+         * progress. Throws std::runtime_error if the file cannot be created.
+         */
+        void start_recording(const string& path, int chunk_steps = 64);
+        /**
+         * Close the recording. The writer finishes the file in the
+         * background, it is complete once the next step has run and
+         * take_snapshot has been called after it.
+         */
+        void stop_recording();
+        /** Wait until the writer has caught up with the recorded steps */
+        void drain_recording();
+
+        /**
+         * Keep states of moving bodies, vehicles, kinematic bodies and
+         * trucks for the last steps in memory, 0 stops. Only what changed
+         * in a step is kept, bodies asleep cost nothing. The window starts
+         * over when objects are added or removed and on rebase. Freezing
+         * and waking by distance and pile merges and splits are undone when
+         * going back past them.
+         */
+        void set_rollback_window(int steps);
+        /**
+         * Put everything back as it was after step, see WorldStats for the
+         * window. The step counter keeps running. Debris is not rolled back.
+         */
+        void rollback(uint64_t step);
 
+        /** Counters from the latest step, can be called from other threads */
+        WorldStats stats();
 
-        /** For internal logic (set change for an object) */
-        void update_change(ObjectId id, const glm::mat4& change);
         /** Non thread-safe and overall retarded debug printer */
         void printworld();
     };
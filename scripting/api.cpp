@@ -28,6 +28,41 @@ inline string read_console_line(const char* prompt) {
 
 #endif
 
+static physics::Category category_arg(scripting::Lua& l, int i, physics::Category fallback) {
+    if (l.argc() < i) return fallback;
+    auto name = l.str(i);
+    if (name == "default") return physics::Category::Default;
+    if (name == "debris") return physics::Category::Debris;
+    if (name == "cargo") return physics::Category::Cargo;
+    if (name == "vehicle") return physics::Category::Vehicle;
+    l.error("Unknown collision category " + name);
+    return fallback;
+}
+
+static util::ThreadPriority priority_arg(scripting::Lua& l, int i) {
+    if (l.argc() < i) return util::ThreadPriority::Normal;
+    auto name = l.str(i);
+    if (name == "background") return util::ThreadPriority::Background;
+    if (name == "normal") return util::ThreadPriority::Normal;
+    if (name == "realtime") return util::ThreadPriority::Realtime;
+    l.error("Unknown thread priority " + name);
+    return util::ThreadPriority::Normal;
+}
+
+// Flat telemetry sample: step, speed, then rpm, slip, compression and contact
+// for each of TELEMETRY_WHEELS wheels, contact is -1 when in the air
+static void push_telemetry(std::vector<double>& flat, const physics::VehicleTelemetry& t) {
+    flat.push_back(t.step);
+    flat.push_back(t.speed);
+    for (int i = 0; i < physics::TELEMETRY_WHEELS; i++) {
+        const auto& w = t.wheels[i];
+        flat.push_back(w.rpm);
+        flat.push_back(w.slip);
+        flat.push_back(w.compression);
+        flat.push_back(w.in_contact ? double(w.contact) : -1.0);
+    }
+}
+
 // YES, C preprocessor is the greatest!
 
 #define defun(name) l.register_function(#name, [&] {
@@ -39,14 +74,174 @@ void scripting::register_game_functions(Game& game, Lua& l) {
     simplefun(run, game.physics.run());
     simplefun(stop, game.physics.stop());
 
+    defun(set_governor)
+        game.physics.set_governor(l.boolean(1));
+    endfun
+    defun(set_pile_merging)
+        game.physics.set_pile_merging(l.boolean(1));
+    endfun
+    defun(set_spatial_sort)
+        game.physics.set_spatial_sort(l.num(1));
+    endfun
+    defun(physics_governor)
+        auto m = game.physics.governor_metrics();
+        l.ret(m.level, m.solver_iterations, m.substeps, m.step_ms, m.average_ms,
+                m.downgrades, m.upgrades);
+    endfun
+
+    defun(physics_stats)
+        auto s = game.physics.stats();
+        l.ret(s.bodies, s.active_bodies, s.sleeping_bodies, s.frozen_bodies,
+                s.islands, s.active_islands, s.overlapping_pairs, s.manifolds,
+                s.contact_points, s.vehicles, s.pool_bytes,
+                s.average_lateness_ms, s.max_lateness_ms, s.late_starts, s.recorder_dropped);
+    endfun
+    defun(physics_memory)
+        auto m = game.physics.stats();
+        std::vector<double> flat;
+        for (int i = 0; i < physics::ALLOC_CATEGORIES; i++) {
+            flat.push_back(m.memory.live_bytes[i]);
+            flat.push_back(m.step_allocations[i]);
+        }
+        flat.push_back(m.memory.pooled_bytes);
+        flat.push_back(m.memory.heap_bytes);
+        l.ret(flat);
+    endfun
+    defun(set_stats_overlay)
+        game.stats_overlay = l.boolean(1);
+    endfun
+
+    defun(record_poses)
+        try {
+            game.physics.start_recording(l.str(1));
+        } catch (const std::runtime_error& e) {
+            l.error(e.what());
+        }
+    endfun
+    simplefun(stop_recording, game.physics.stop_recording());
+    defun(set_rollback_window)
+        game.physics.set_rollback_window(int(l.num(1)));
+    endfun
+    defun(rollback)
+        game.physics.rollback(uint64_t(l.num(1)));
+    endfun
+    defun(rollback_window)
+        auto s = game.physics.stats();
+        l.ret(double(s.rollback_first), double(s.rollback_last), double(s.step), s.rollback_bytes);
+    endfun
+    defun(open_replay)
+        try {
+            game.open_replay(l.str(1));
+        } catch (const std::runtime_error& e) {
+            l.error(e.what());
+        }
+        l.ret(double(game.replay->first_step()), double(game.replay->last_step()));
+    endfun
+    defun(show_replay)
+        if (!game.show_replay(uint64_t(l.num(1)))) l.error("Step is not in the replay");
+    endfun
+    simplefun(close_replay, game.close_replay());
+
+    defun(set_thread)
+        auto which = l.str(1);
+        util::ThreadConfig config(which, l.argc() > 1 ? int(l.num(2)) : -1, priority_arg(l, 3));
+        if (which == "physics") {
+            game.physics.set_thread_config(config);
+        } else if (which == "render") {
+            game.set_render_thread_config(config);
+        } else {
+            l.error("Unknown thread " + which);
+        }
+    endfun
+
     defun(add_cube)
-        ObjectId id = game.add_cube(l.num(1), l.num(2), l.num(3), l.argc() > 3 ? l.num(4) : 0.5);
+        ObjectId id = game.add_cube(l.num(1), l.num(2), l.num(3), l.argc() > 3 ? l.num(4) : 0.5,
+                category_arg(l, 5, physics::Category::Default));
         l.ret(id);
     endfun
+    defun(add_convex)
+        auto coords = l.numbers(5);
+        std::vector<glm::vec3> points;
+        for (size_t i = 0; i + 2 < coords.size(); i += 3) {
+            points.push_back(glm::vec3(coords[i], coords[i+1], coords[i+2]));
+        }
+        ObjectId id = game.add_convex(l.num(1), l.num(2), l.num(3), l.num(4), points,
+                category_arg(l, 6, physics::Category::Default));
+        l.ret(id);
+    endfun
+    defun(add_destructible)
+        ObjectId id = game.add_destructible(l.num(1), l.num(2), l.num(3),
+                l.num(4), l.num(5), l.num(6), l.num(7), l.num(8));
+        l.ret(id);
+    endfun
+    defun(add_static_cube)
+        ObjectId id = game.add_static_cube(l.num(1), l.num(2), l.num(3), l.num(4), l.num(5), l.num(6));
+        l.ret(id);
+    endfun
+    defun(add_kinematic)
+        auto values = l.numbers(5);
+        std::vector<physics::Keyframe> keys;
+        for (size_t i = 0; i + 6 < values.size(); i += 7) {
+            physics::Keyframe key;
+            key.time = values[i];
+            key.position = game.local(values[i+1], values[i+2], values[i+3]);
+            key.yaw = values[i+4];
+            key.pitch = values[i+5];
+            key.roll = values[i+6];
+            if (!keys.empty() && key.time <= keys.back().time) {
+                l.error("Keyframe times must increase");
+            }
+            keys.push_back(key);
+        }
+        if (keys.empty()) l.error("add_kinematic needs keyframes");
+        ObjectId id = game.add_kinematic(l.num(1), l.num(2), l.num(3), l.boolean(4), keys);
+        l.ret(id);
+    endfun
+    defun(add_trigger)
+        ObjectId id = game.add_trigger(l.num(1), l.num(2), l.num(3), l.num(4), l.num(5), l.num(6));
+        l.ret(id);
+    endfun
+    defun(poll_triggers)
+        std::vector<double> flat;
+        for (const auto& e : game.take_trigger_events()) {
+            flat.push_back(e.trigger);
+            flat.push_back(e.object);
+            flat.push_back(e.enter ? 1 : 0);
+        }
+        l.ret(flat);
+    endfun
     defun(add_car)
-        ObjectId id = game.add_car(l.num(1), l.num(2), l.num(3));
+        ObjectId id = game.add_car(l.num(1), l.num(2), l.num(3),
+                category_arg(l, 4, physics::Category::Vehicle));
         l.ret(id);
     endfun
+    defun(add_truck)
+        ObjectId id = game.add_truck(l.num(1), l.num(2), l.num(3), l.argc() > 3 ? l.num(4) : 1,
+                category_arg(l, 5, physics::Category::Vehicle));
+        l.ret(id);
+    endfun
+    defun(telemetry)
+        std::vector<double> flat;
+        for (const auto& t : game.vehicle_telemetry(l.num(1), 1)) {
+            push_telemetry(flat, t);
+        }
+        l.ret(flat);
+    endfun
+    defun(telemetry_history)
+        std::vector<double> flat;
+        for (const auto& t : game.vehicle_telemetry(l.num(1), l.num(2))) {
+            push_telemetry(flat, t);
+        }
+        l.ret(flat);
+    endfun
+    defun(add_debris)
+        glm::vec3 vel(0.0f);
+        if (l.argc() > 4) vel = glm::vec3(l.num(5), l.num(6), l.num(7));
+        game.add_debris(l.num(1), l.num(2), l.num(3), l.argc() > 3 ? l.num(4) : 0.1, vel);
+    endfun
+    defun(promote_debris)
+        game.promote_debris(l.num(1), l.num(2), l.num(3), l.num(4));
+    endfun
     defun(remove_cube)
        game.remove_cube(l.num(1));
     endfun 
@@ -57,12 +252,27 @@ void scripting::register_game_functions(Game& game, Lua& l) {
     defun(carsteer)
         game.physics.steer(l.num(1), l.num(2));
     endfun
+    defun(set_tires)
+        physics::TireType tires;
+        if (!physics::tire_type_by_name(l.str(2), tires)) l.error("Unknown tires " + l.str(2));
+        game.physics.set_tires(l.num(1), tires);
+    endfun
 
     defun(setcam)
-        game.graphics.set_camera(
-                glm::vec3(l.num(1), l.num(2), l.num(3)),
-                glm::vec3(l.num(4), l.num(5), l.num(6)),
-                glm::vec3(0.f, 1.f, 0.f));
+        game.set_camera(l.num(1), l.num(2), l.num(3), l.num(4), l.num(5), l.num(6));
+    endfun
+
+    defun(set_focus)
+        game.set_focus(l.num(1), l.num(2), l.num(3), l.num(4));
+    endfun
+    defun(remove_focus)
+        game.physics.remove_focus(l.num(1));
+    endfun
+    defun(set_lod_radius)
+        game.physics.set_lod_radius(l.num(1));
+    endfun
+    defun(set_origin_rebasing)
+        game.rebase_distance = l.num(1);
     endfun
 
     defun(readline)
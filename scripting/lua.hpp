@@ -4,6 +4,7 @@
 #include <sstream>
 #include <forward_list>
 #include <functional>
+#include <vector>
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -44,16 +45,47 @@ namespace scripting {
         void push(const string& str) {
             push(str.c_str());
         }
+        /** Array of numbers as a table */
+        void push(const std::vector<double>& arr) {
+            lua_createtable(L, int(arr.size()), 0);
+            for (size_t i = 0; i < arr.size(); i++) {
+                lua_pushnumber(L, arr[i]);
+                lua_rawseti(L, -2, lua_Integer(i + 1));
+            }
+        }
         double num(int i) {
             if (lua_isnumber(L, i)) return lua_tonumber(L, i);
             getter_error(i, "number");
             return 0;
         }
+        bool boolean(int i) {
+            return lua_toboolean(L, i);
+        }
         string str(int i) {
             if (lua_isstring(L, i)) return lua_tostring(L, i);
             getter_error(i, "string");
             return "";
         }
+        /** Array of numbers from a table argument */
+        std::vector<double> numbers(int i) {
+            std::vector<double> result;
+            if (!lua_istable(L, i)) {
+                getter_error(i, "table");
+                return result;
+            }
+            lua_Integer len = luaL_len(L, i);
+            for (lua_Integer n = 1; n <= len; n++) {
+                lua_rawgeti(L, i, n);
+                if (!lua_isnumber(L, -1)) {
+                    lua_pop(L, 1);
+                    getter_error(i, "table of numbers");
+                    return result;
+                }
+                result.push_back(lua_tonumber(L, -1));
+                lua_pop(L, 1);
+            }
+            return result;
+        }
         int argc() {
             return lua_gettop(L);
         }
@@ -0,0 +1,118 @@
+#include "../physics/hash_grid.hpp"
+#include "../physics/world.hpp"
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
+#include <BulletCollision/BroadphaseCollision/btOverlappingPairCache.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+
+// The cube rain scene of bench-groups on both broadphases. The rain falls
+// through the whole run, so most of the tiny cubes move every step. The
+// whole step is mostly narrowphase and solver, so the broadphases are also
+// timed alone with the boxes of the scene falling straight down.
+
+typedef std::chrono::duration<double, std::milli> Millis;
+
+static void cube_rain(physics::World& phys) {
+    ObjectId id = 0;
+    auto cube = [&](float x, float y, float z, float size) {
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+        phys.add_cube(++id, t, size*size*size, size, size, size);
+    };
+
+    phys.add_static_cube(++id, glm::mat4(1.0f), 20, 1, 20);
+    const int a = 12;
+    for (int y = 3; y <= 5; y++) {
+        for (int i = -a; i <= a; i++) {
+            cube(i, y, a, 0.5);
+            cube(i, y, -a, 0.5);
+            if (i != -a && i != a) {
+                cube(a, y, i, 0.5);
+                cube(-a, y, i, 0.5);
+            }
+        }
+    }
+    for (int y = 1; y <= 3000; y++) {
+        cube(std::sin(y), y*0.2+5, std::sin(y+1), 0.1);
+    }
+}
+
+static void run(const char* name, physics::Broadphase broadphase) {
+    const int steps = 600;
+    physics::World phys(broadphase);
+    cube_rain(phys);
+
+    long pairs = 0, manifolds = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        phys.single_step();
+        pairs += phys.stats().overlapping_pairs;
+        manifolds += phys.stats().manifolds;
+    }
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+
+    cout << name << ": "
+        << pairs / steps << " pairs/step, "
+        << manifolds / steps << " manifolds/step, "
+        << took.count() / steps << " ms/step" << endl;
+}
+
+static void run_alone(const char* name, btBroadphaseInterface& broadphase) {
+    const int steps = 600;
+    std::vector<btBroadphaseProxy*> proxies;
+    std::vector<btVector3> centers;
+    std::vector<float> sizes;
+    auto add = [&](const btVector3& c, float size) {
+        const btVector3 half(size, size, size);
+        proxies.push_back(broadphase.createProxy(c - half, c + half, BOX_SHAPE_PROXYTYPE,
+                    nullptr, 1, -1, nullptr, nullptr));
+        centers.push_back(c);
+        sizes.push_back(size);
+    };
+    add(btVector3(0, 0, 0), 20);
+    const int a = 12;
+    for (int y = 3; y <= 5; y++) {
+        for (int i = -a; i <= a; i++) {
+            add(btVector3(i, y, a), 0.5f);
+            add(btVector3(i, y, -a), 0.5f);
+            if (i != -a && i != a) {
+                add(btVector3(a, y, i), 0.5f);
+                add(btVector3(-a, y, i), 0.5f);
+            }
+        }
+    }
+    const size_t first_rain = proxies.size();
+    for (int y = 1; y <= 3000; y++) add(btVector3(std::sin(y), y*0.2+5, std::sin(y+1)), 0.1f);
+
+    long pairs = 0;
+    Millis took(0);
+    for (int i = 0; i < steps; i++) {
+        // both do part of the work when boxes move, time that too
+        auto start = std::chrono::steady_clock::now();
+        // rain falls at 10 m/s and stops on the ground
+        for (size_t k = first_rain; k < proxies.size(); k++) {
+            btVector3& c = centers[k];
+            if (c.y() <= 1.1f) continue;
+            c.setY(std::max(1.1f, c.y() - 10.0f / 60));
+            const btVector3 half(sizes[k], sizes[k], sizes[k]);
+            broadphase.setAabb(proxies[k], c - half, c + half, nullptr);
+        }
+        broadphase.calculateOverlappingPairs(nullptr);
+        took += std::chrono::steady_clock::now() - start;
+        pairs += broadphase.getOverlappingPairCache()->getNumOverlappingPairs();
+    }
+    cout << name << ": " << pairs / steps << " pairs/step, " << took.count() / steps << " ms/step" << endl;
+    for (btBroadphaseProxy* p : proxies) broadphase.destroyProxy(p, nullptr);
+}
+
+int main() {
+    cout << "cube rain, " << 3000 << " tiny cubes" << endl;
+    run("tree     ", physics::Broadphase::Tree);
+    run("hash grid", physics::Broadphase::HashGrid);
+
+    cout << "broadphase alone" << endl;
+    btDbvtBroadphase tree;
+    physics::HashGridBroadphase grid;
+    run_alone("tree     ", tree);
+    run_alone("hash grid", grid);
+}
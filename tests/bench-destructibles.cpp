@@ -0,0 +1,49 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+
+// A row of prefractured walls with heavy boxes falling on them one by one
+// for the first half of the run. Step time and manifold count are reported
+// per window to show how quickly the scene calms down again.
+
+const int WALLS = 10;
+const int PIECES = 64;
+const int WINDOW = 300;
+const int WINDOWS = 6;
+
+static void run(const char* name, bool merging) {
+    physics::World phys;
+    phys.set_pile_merging(merging);
+    phys.add_static_cube(1, glm::mat4(1.0f), 60, 1, 20);
+    for (int i = 0; i < WALLS; i++) {
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(i * 10.0f - 45.0f, 3.0f, 0.0f));
+        phys.add_destructible(1000 + i * PIECES, t, 200, 3, 2, 0.5, PIECES, 100);
+    }
+
+    cout << name << ":";
+    ObjectId next_box = 100;
+    for (int w = 0; w < WINDOWS; w++) {
+        std::chrono::duration<double, std::milli> took(0);
+        for (int i = 0; i < WINDOW; i++) {
+            if (i % 60 == 0 && w < WINDOWS / 2) {
+                const int wall = (w * WINDOW + i) / 60 % WALLS;
+                glm::mat4 t = glm::translate(glm::mat4(1.0f),
+                        glm::vec3(wall * 10.0f - 45.0f + (i % 120 ? 1.5f : -1.5f), 10.0f, 0.0f));
+                phys.add_cube(next_box++, t, 300, 0.5, 0.5, 0.5);
+            }
+            auto start = std::chrono::steady_clock::now();
+            phys.single_step();
+            took += std::chrono::steady_clock::now() - start;
+            phys.take_snapshot();
+        }
+        cout << " " << took.count() / WINDOW << " (" << phys.stats().manifolds << ")";
+    }
+    cout << endl;
+}
+
+int main() {
+    cout << WALLS << " walls of " << PIECES << " fragments, ms/step (manifolds) per "
+        << WINDOW << " steps" << endl;
+    run("fragments stay loose", false);
+    run("fragments re-merge  ", true);
+}
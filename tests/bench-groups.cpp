@@ -0,0 +1,56 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+
+// The cube rain scene of data/scripts/cubes.lua, with the tiny cubes in
+// given collision category
+static void cube_rain(physics::World& phys, physics::Category rain_category) {
+    ObjectId id = 0;
+    auto cube = [&](float x, float y, float z, float size, physics::Category c) {
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+        phys.add_cube(++id, t, size*size*size, size, size, size, c);
+    };
+
+    phys.add_static_cube(++id, glm::mat4(1.0f), 20, 1, 20);
+    const int a = 12;
+    for (int y = 3; y <= 5; y++) {
+        for (int i = -a; i <= a; i++) {
+            cube(i, y, a, 0.5, physics::Category::Default);
+            cube(i, y, -a, 0.5, physics::Category::Default);
+            if (i != -a && i != a) {
+                cube(a, y, i, 0.5, physics::Category::Default);
+                cube(-a, y, i, 0.5, physics::Category::Default);
+            }
+        }
+    }
+    for (int y = 1; y <= 3000; y++) {
+        cube(std::sin(y), y*0.2+5, std::sin(y+1), 0.1, rain_category);
+    }
+}
+
+static void run(const char* name, physics::Category rain_category) {
+    const int steps = 600;
+    physics::World phys;
+    cube_rain(phys, rain_category);
+
+    long pairs = 0, manifolds = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        phys.single_step();
+        pairs += phys.stats().overlapping_pairs;
+        manifolds += phys.stats().manifolds;
+    }
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+
+    cout << name << ": "
+        << pairs / steps << " pairs/step, "
+        << manifolds / steps << " manifolds/step, "
+        << took.count() / steps << " ms/step" << endl;
+}
+
+int main() {
+    cout << "cube rain, " << 3000 << " tiny cubes" << endl;
+    run("default category", physics::Category::Default);
+    run("debris category ", physics::Category::Debris);
+}
@@ -0,0 +1,54 @@
+#include "../physics/world.hpp"
+#include "../util/thread.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Step start lateness of the background thread while other threads keep
+// every CPU busy, with and without scheduling settings for the threads.
+
+const int SECONDS = 3;
+
+static void run(const char* title, bool load, util::ThreadPriority load_priority,
+        const util::ThreadConfig& physics_config) {
+    physics::World phys;
+    phys.add_static_cube(0, glm::mat4(1.0f), 50, 1, 50);
+    for (int i = 0; i < 200; i++) {
+        glm::vec3 pos((i % 10) * 2.5f - 12, 2 + (i / 100) * 2.5f, ((i / 10) % 10) * 2.5f - 12);
+        phys.add_cube(1 + i, glm::translate(glm::mat4(1.0f), pos), 1, 1, 1, 1);
+    }
+    phys.set_governor(false);
+    phys.set_thread_config(physics_config);
+
+    std::atomic<bool> busy(load);
+    std::vector<std::thread> workers;
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; load && i < cpus * 2; i++) {
+        workers.emplace_back([&busy, load_priority]() {
+            util::configure_thread(util::ThreadConfig("load", -1, load_priority));
+            volatile unsigned x = 0;
+            while (busy) x = x * 31 + 7;
+        });
+    }
+
+    phys.run();
+    std::this_thread::sleep_for(std::chrono::seconds(SECONDS));
+    phys.stop();
+    busy = false;
+    for (auto& t : workers) t.join();
+
+    physics::WorldStats s = phys.stats();
+    cout << title << s.step << " steps, lateness average " << s.average_lateness_ms
+        << " ms, max " << s.max_lateness_ms << " ms, " << s.late_starts << " late" << endl;
+}
+
+int main() {
+    const util::ThreadConfig plain("physics");
+    run("idle machine:               ", false, util::ThreadPriority::Normal, plain);
+    run("loaded, default scheduling: ", true, util::ThreadPriority::Normal, plain);
+    run("loaded, background load:    ", true, util::ThreadPriority::Background, plain);
+    run("loaded, realtime physics:   ", true, util::ThreadPriority::Normal,
+            util::ThreadConfig("physics", 0, util::ThreadPriority::Realtime));
+}
@@ -0,0 +1,55 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+
+// The walls of data/scripts/cubes.lua, left to settle
+static void walls(physics::World& phys) {
+    ObjectId id = 0;
+    auto cube = [&](float x, float y, float z) {
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+        phys.add_cube(++id, t, 1, 0.5, 0.5, 0.5);
+    };
+
+    phys.add_static_cube(++id, glm::mat4(1.0f), 20, 1, 20);
+    const int a = 12;
+    for (int y = 2; y <= 9; y++) {
+        for (int i = -a; i <= a; i++) {
+            cube(i, y, a);
+            cube(i, y, -a);
+            if (i != -a && i != a) {
+                cube(a, y, i);
+                cube(-a, y, i);
+            }
+        }
+    }
+}
+
+static void run(const char* name, bool merging) {
+    const int settle = 600, steps = 600;
+    physics::World phys;
+    phys.set_pile_merging(merging);
+    walls(phys);
+    for (int i = 0; i < settle; i++) {
+        phys.single_step();
+    }
+
+    long pairs = 0, manifolds = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        phys.single_step();
+        pairs += phys.stats().overlapping_pairs;
+        manifolds += phys.stats().manifolds;
+    }
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+
+    cout << name << ": "
+        << pairs / steps << " pairs/step, "
+        << manifolds / steps << " manifolds/step, "
+        << took.count() / steps << " ms/step" << endl;
+}
+
+int main() {
+    cout << "settled walls, " << 8 * 96 << " cubes" << endl;
+    run("separate bodies", false);
+    run("merged piles   ", true);
+}
@@ -0,0 +1,88 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+
+// Cubes dropped on a floor in layers, so that some are falling while the
+// earlier ones sleep, and cars driving in circles around them. The same
+// scene runs without and with a rollback window, the difference of the
+// step times is what capturing the changes costs. Pile merging is off, it
+// would start the window over whenever a pile forms.
+
+const int LAYERS = 8, PER_LAYER = 64, CARS = 16;
+const int STEPS = 600, WINDOW = 300;
+
+typedef std::chrono::duration<double, std::milli> Millis;
+
+struct Scene {
+    physics::World phys;
+    int steps;
+    long active;
+    Millis took;
+
+    explicit Scene(int window) : steps(0), active(0), took(0) {
+        phys.set_pile_merging(false);
+        phys.add_static_cube(1, glm::mat4(1.0f), 60, 1, 60);
+        for (int i = 0; i < CARS; i++) {
+            const ObjectId id = 100 + i;
+            phys.add_car(id, glm::translate(glm::mat4(1.0f), glm::vec3(i * 6.0f - 45, 3, -40)));
+            phys.engine(id, true);
+            phys.steer(id, 0.3f);
+        }
+        phys.set_rollback_window(window);
+    }
+
+    void run(int count) {
+        for (int i = 0; i < count; i++) {
+            // a new layer every second, added before the timed part
+            if (steps % 60 == 0 && steps / 60 < LAYERS) {
+                const int layer = steps / 60;
+                for (int k = 0; k < PER_LAYER; k++) {
+                    const glm::vec3 pos(k % 8 * 1.5f - 6, 4 + layer * 0.1f, k / 8 * 1.5f - 6);
+                    phys.add_cube(1000 + layer * PER_LAYER + k, glm::translate(glm::mat4(1.0f), pos),
+                            1, 0.5f, 0.5f, 0.5f);
+                }
+                phys.single_step();
+                steps++;
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            phys.single_step();
+            took += std::chrono::steady_clock::now() - start;
+            active += phys.stats().active_bodies;
+            steps++;
+        }
+        phys.take_snapshot();
+    }
+
+    /** Time of a step which first goes back to step */
+    double rollback(uint64_t step) {
+        phys.rollback(step);
+        auto start = std::chrono::steady_clock::now();
+        phys.single_step();
+        Millis t = std::chrono::steady_clock::now() - start;
+        steps++;
+        return t.count();
+    }
+};
+
+int main() {
+    cout << LAYERS * PER_LAYER << " cubes, " << CARS << " cars, " << STEPS << " steps" << endl;
+    Scene off(0), on(WINDOW);
+    off.run(STEPS);
+    on.run(STEPS);
+    const int timed = STEPS - LAYERS;
+    const double off_ms = off.took.count() / timed, on_ms = on.took.count() / timed;
+    const physics::WorldStats stats = on.phys.stats();
+    cout << "without window: " << off_ms << " ms/step" << endl;
+    cout << "with " << WINDOW << " steps: " << on_ms << " ms/step, capture "
+        << (on_ms - off_ms) * 1000 << " us/step for " << on.active / timed << " active bodies, "
+        << stats.rollback_bytes / 1024 << " KB" << endl;
+
+    // stepping after a rollback costs the step and the undo of every change since
+    const double step_ms = on.rollback(on.phys.stats().step);
+    const double back_60 = on.rollback(on.phys.stats().step - 60);
+    const uint64_t first = on.phys.stats().rollback_first;
+    const double back_all = on.rollback(first);
+    cout << "step after rollback: none " << step_ms << " ms, 60 steps " << back_60
+        << " ms, " << on.phys.stats().step - 2 - first << " steps " << back_all << " ms" << endl;
+}
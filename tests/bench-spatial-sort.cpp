@@ -0,0 +1,77 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <algorithm>
+#include <vector>
+
+// A long session: cubes keep raining on heaps around a field and old ones
+// are removed, so bodies come and go all the time and Bullet's arrays get
+// shuffled. For every size both runs build the same scene without sorting,
+// then one of them starts sorting its arrays every second. Sorting changes
+// the solver order, so the scenes drift apart while timed, pairs and
+// manifolds tell how far.
+
+typedef std::chrono::duration<double, std::milli> Millis;
+
+static void run(const char* name, int lifetime, float sort_interval) {
+    const int heaps = 36, per_step = 20;
+    const int warmup = lifetime + 100, steps = 120;
+    srand(1);
+    physics::World phys;
+    phys.set_pile_merging(false);
+    phys.add_static_cube(1, glm::mat4(1.0f), 100, 1, 100);
+
+    ObjectId id = 1;
+    std::deque<ObjectId> alive;
+    auto rain = [&]() {
+        for (int i = 0; i < per_step; i++) {
+            const int heap = rand() % heaps;
+            const float x = (heap % 6) * 30.0f - 75 + (rand() % 100) * 0.03f;
+            const float z = (heap / 6) * 30.0f - 75 + (rand() % 100) * 0.03f;
+            glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(x, 8 + (rand() % 100) * 0.05f, z));
+            phys.add_cube(++id, t, 1, 0.4f, 0.4f, 0.4f);
+            alive.push_back(id);
+        }
+        while (alive.size() > size_t(per_step * lifetime)) {
+            phys.remove(alive.front());
+            alive.pop_front();
+        }
+    };
+    for (int i = 0; i < warmup; i++) {
+        rain();
+        phys.single_step();
+    }
+    phys.set_spatial_sort(sort_interval);
+
+    long pairs = 0, manifolds = 0, active = 0;
+    std::vector<double> took;
+    for (int i = 0; i < steps; i++) {
+        rain();
+        auto start = std::chrono::steady_clock::now();
+        phys.single_step();
+        took.push_back(Millis(std::chrono::steady_clock::now() - start).count());
+        const physics::WorldStats s = phys.stats();
+        pairs += s.overlapping_pairs;
+        manifolds += s.manifolds;
+        active += s.active_bodies;
+    }
+    // the median, a busy machine makes some steps take much longer
+    std::nth_element(took.begin(), took.begin() + steps / 2, took.end());
+    cout << "  " << name << ": " << active / steps << " active bodies, "
+        << pairs / steps << " pairs/step, "
+        << manifolds / steps << " manifolds/step, "
+        << took[steps / 2] << " ms/step (median)" << endl;
+}
+
+int main() {
+    // cubes alive at a time, 20 new ones every step
+    for (int bodies : { 3000, 8000, 12000 }) {
+        const int lifetime = bodies / 20;
+        cout << "cube rain on heaps, " << bodies << " cubes removed after "
+            << lifetime << " steps" << endl;
+        run("creation order ", lifetime, 0);
+        run("sorted every 1s", lifetime, 1);
+    }
+}
@@ -0,0 +1,176 @@
+#include "../physics/world.hpp"
+#include <btBulletDynamicsCommon.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// Trucks driving in circles, each pulling a long chain of trailers. The
+// articulated trucks of World are compared with the same rig built from
+// rigid bodies and hinge constraints.
+
+const int TRUCKS = 8;
+const int TRAILERS = 6;
+const int STEPS = 600;
+const float SPACING = 30.0f;
+
+static btVector3 to_bt(const glm::vec3& v) {
+    return btVector3(v.x, v.y, v.z);
+}
+
+static glm::vec3 transform_point(const glm::mat4& m, const glm::vec3& p) {
+    return glm::vec3(m * glm::vec4(p, 1.0f));
+}
+
+static glm::vec3 hitch_of(int trailer) {
+    return trailer == 0 ? physics::TRUCK_FIFTH_WHEEL : physics::TRUCK_TRAILER_REAR;
+}
+
+static void run_multibody() {
+    physics::World phys;
+    phys.add_static_cube(0, glm::mat4(1.0f), 400, 1, 400);
+    std::vector<ObjectId> ids;
+    for (int i = 0; i < TRUCKS; i++) {
+        ObjectId id = 1 + i * (TRAILERS + 1);
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(i * SPACING, 2.9f, 0.0f));
+        phys.add_truck(id, t, TRAILERS);
+        phys.engine(id, true);
+        phys.steer(id, 0.3f);
+        ids.push_back(id);
+    }
+
+    std::unordered_map<ObjectId, glm::mat4> poses;
+    float max_error = 0;
+    std::chrono::duration<double, std::milli> took(0);
+    for (int step = 0; step < STEPS; step++) {
+        auto start = std::chrono::steady_clock::now();
+        phys.single_step();
+        took += std::chrono::steady_clock::now() - start;
+
+        auto snapshot = phys.take_snapshot();
+        for (const auto& c : snapshot.new_cubes) poses[c.id] = c.transform;
+        for (const auto& c : snapshot.changes) poses[c.first] = c.second;
+        for (ObjectId id : ids) {
+            for (int k = 0; k < TRAILERS; k++) {
+                glm::vec3 a = transform_point(poses[id + k], hitch_of(k));
+                glm::vec3 b = transform_point(poses[id + k + 1], physics::TRUCK_TRAILER_FRONT);
+                max_error = std::max(max_error, glm::length(a - b));
+            }
+        }
+    }
+    cout << "multibody trucks:        " << took.count() / STEPS << " ms/step, "
+        << "max hitch gap " << max_error << " m" << endl;
+}
+
+// The same rig from rigid bodies, stepped like World steps at full quality
+struct ConstraintRig {
+    btDbvtBroadphase broadphase;
+    btDefaultCollisionConfiguration config;
+    btCollisionDispatcher dispatcher;
+    btSequentialImpulseConstraintSolver solver;
+    btDiscreteDynamicsWorld world;
+    btBoxShape ground_shape, tractor_shape, trailer_shape;
+    std::vector<unique_ptr<btRigidBody>> bodies;
+    std::vector<unique_ptr<btHingeConstraint>> hitches;
+    std::vector<btRigidBody*> tractors;
+
+    ConstraintRig(int iterations)
+        : dispatcher(&config), world(&dispatcher, &broadphase, &solver, &config),
+        ground_shape(btVector3(400, 1, 400)),
+        tractor_shape(to_bt(physics::TRUCK_TRACTOR_SIZE)),
+        trailer_shape(to_bt(physics::TRUCK_TRAILER_SIZE)) {
+        world.setGravity(btVector3(0, -10, 0));
+        world.getSolverInfo().m_numIterations = iterations;
+        world.setInternalTickCallback(&ConstraintRig::pre_tick, this, true);
+        add_body(0, &ground_shape, btVector3(0, 0, 0));
+        for (int i = 0; i < TRUCKS; i++) {
+            btVector3 pos(i * SPACING, 2.1f, 0.0f);
+            btRigidBody* parent = add_body(6000, &tractor_shape, pos);
+            parent->setFriction(0.1);
+            tractors.push_back(parent);
+            for (int k = 0; k < TRAILERS; k++) {
+                btVector3 hitch = to_bt(hitch_of(k));
+                btVector3 front = to_bt(physics::TRUCK_TRAILER_FRONT);
+                pos += hitch - front;
+                btRigidBody* trailer = add_body(8000, &trailer_shape, pos);
+                trailer->setAnisotropicFriction(btVector3(1, 1, 0.02),
+                        btCollisionObject::CF_ANISOTROPIC_FRICTION);
+                btVector3 axis(0, 1, 0);
+                hitches.emplace_back(new btHingeConstraint(
+                            *parent, *trailer, hitch, front, axis, axis));
+                world.addConstraint(hitches.back().get(), true);
+                parent = trailer;
+            }
+        }
+    }
+
+    ~ConstraintRig() {
+        for (auto& hitch : hitches) world.removeConstraint(hitch.get());
+        for (auto& body : bodies) world.removeRigidBody(body.get());
+    }
+
+    btRigidBody* add_body(btScalar mass, btCollisionShape* shape, const btVector3& pos) {
+        btVector3 inertia(0, 0, 0);
+        if (mass > 0) shape->calculateLocalInertia(mass, inertia);
+        btRigidBody::btRigidBodyConstructionInfo info(mass, nullptr, shape, inertia);
+        info.m_startWorldTransform = btTransform(btQuaternion::getIdentity(), pos);
+        bodies.emplace_back(new btRigidBody(info));
+        bodies.back()->setActivationState(DISABLE_DEACTIVATION);
+        world.addRigidBody(bodies.back().get());
+        return bodies.back().get();
+    }
+
+    // no wheels, the tractor is pushed by its velocity at full throttle. The
+    // articulated trucks also cast a ray per wheel, so this is the cheaper rig
+    static void pre_tick(btDynamicsWorld* world, btScalar dt) {
+        auto self = static_cast<ConstraintRig*>(world->getWorldUserInfo());
+        for (btRigidBody* tractor : self->tractors) {
+            const btMatrix3x3& basis = tractor->getWorldTransform().getBasis();
+            const btVector3 forward = basis.getColumn(2);
+            const btVector3 right = basis.getColumn(0);
+            const btVector3 up = basis.getColumn(1);
+            btVector3 vel = tractor->getLinearVelocity();
+            const btScalar speed = vel.dot(forward);
+            if (btFabs(speed) < 25) vel += forward * (4 * dt);
+            vel -= right * (vel.dot(right) * btMin(8 * dt, btScalar(1)));
+            tractor->setLinearVelocity(vel);
+            btVector3 omega = tractor->getAngularVelocity();
+            const btScalar change = (speed * 0.3f / 4 - omega.dot(up)) * btMin(10 * dt, btScalar(1));
+            tractor->setAngularVelocity(omega + up * change);
+        }
+    }
+
+    float max_hitch_gap() {
+        float gap = 0;
+        for (auto& hitch : hitches) {
+            btVector3 a = hitch->getRigidBodyA().getWorldTransform() * hitch->getAFrame().getOrigin();
+            btVector3 b = hitch->getRigidBodyB().getWorldTransform() * hitch->getBFrame().getOrigin();
+            gap = std::max(gap, float(a.distance(b)));
+        }
+        return gap;
+    }
+};
+
+static void run_constraints(int iterations) {
+    ConstraintRig rig(iterations);
+    float max_error = 0;
+    std::chrono::duration<double, std::milli> took(0);
+    for (int step = 0; step < STEPS; step++) {
+        auto start = std::chrono::steady_clock::now();
+        const btScalar step_time = 1.0/60.0;
+        rig.world.stepSimulation(step_time, 2, step_time / 2);
+        took += std::chrono::steady_clock::now() - start;
+        max_error = std::max(max_error, rig.max_hitch_gap());
+    }
+    cout << "hinge rig, " << iterations << " iterations: "
+        << (iterations < 10 ? " " : "")
+        << took.count() / STEPS << " ms/step, "
+        << "max hitch gap " << max_error << " m" << endl;
+}
+
+int main() {
+    cout << TRUCKS << " trucks with " << TRAILERS << " trailers, " << STEPS << " steps" << endl;
+    run_multibody();
+    run_constraints(10);
+    run_constraints(4);
+}
@@ -0,0 +1,176 @@
+#include "../physics/vehicles.hpp"
+#include <btBulletDynamicsCommon.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// A parking lot of cars set up like World::add_car, accelerating, turning
+// and braking. Each btRaycastVehicle updating itself as an action is
+// compared with the batch updating all of them at once. Cars bumping into
+// each other make the lot chaotic, so the difference of the results is
+// shown next to what nudging the cars by a hundredth of a millimeter does.
+// Batched cars on dry tires show what the tire curves cost.
+
+const int CARS = 128;
+const int STEPS = 300;
+const float SPACING = 8.0f;
+
+struct Lot {
+    // times whatever updates the vehicles
+    struct Timed : public btActionInterface {
+        Lot* lot;
+        std::vector<double> took; // ms of each update
+        Timed(Lot* lot) : lot(lot) {}
+        virtual void updateAction(btCollisionWorld* world, btScalar dt) {
+            auto start = std::chrono::steady_clock::now();
+            if (lot->batched) {
+                lot->batch.updateAction(world, dt);
+            } else {
+                for (auto& vehicle : lot->vehicles) vehicle->updateAction(world, dt);
+            }
+            took.push_back(std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count());
+        }
+        // the median, a busy machine makes some updates take much longer
+        double median() {
+            std::nth_element(took.begin(), took.begin() + took.size() / 2, took.end());
+            return took[took.size() / 2];
+        }
+        virtual void debugDraw(btIDebugDraw*) {}
+    };
+
+    btDbvtBroadphase broadphase;
+    btDefaultCollisionConfiguration config;
+    btCollisionDispatcher dispatcher;
+    btSequentialImpulseConstraintSolver solver;
+    btDiscreteDynamicsWorld world;
+    btBoxShape ground_shape, chassis_shape;
+    btCompoundShape compound;
+    btRaycastVehicle::btVehicleTuning tuning;
+    unique_ptr<btRigidBody> ground;
+    std::vector<unique_ptr<btRigidBody>> chassis;
+    std::vector<unique_ptr<btVehicleRaycaster>> raycasters;
+    std::vector<unique_ptr<btRaycastVehicle>> vehicles;
+    physics::VehicleBatch batch;
+    bool batched;
+    physics::TireType tires;
+    Timed timed;
+
+    Lot(bool batched, btScalar nudge = 0, physics::TireType tires = physics::TireType::Stock)
+        : dispatcher(&config), world(&dispatcher, &broadphase, &solver, &config),
+        ground_shape(btVector3(1000, 1, 1000)), chassis_shape(btVector3(1, 0.5f, 2)),
+        batched(batched), tires(tires), timed(this) {
+        world.setGravity(btVector3(0, -10, 0));
+        btTransform local(btQuaternion::getIdentity(), btVector3(0, 1, 0));
+        compound.addChildShape(local, &chassis_shape);
+
+        btRigidBody::btRigidBodyConstructionInfo ground_info(0, nullptr, &ground_shape);
+        ground.reset(new btRigidBody(ground_info));
+        world.addRigidBody(ground.get());
+
+        const int row = 16;
+        for (int i = 0; i < CARS; i++) {
+            const btScalar mass = 800;
+            btVector3 inertia(0, 0, 0);
+            compound.calculateLocalInertia(mass, inertia);
+            btRigidBody::btRigidBodyConstructionInfo info(mass, nullptr, &compound, inertia);
+            info.m_startWorldTransform = btTransform(btQuaternion(btVector3(0, 1, 0), 0.1f * i),
+                    btVector3((i % row) * SPACING + nudge, 3, (i / row) * SPACING * 2));
+            chassis.emplace_back(new btRigidBody(info));
+            btRigidBody* body = chassis.back().get();
+            body->setActivationState(DISABLE_DEACTIVATION);
+            world.addRigidBody(body);
+
+            raycasters.emplace_back(new btDefaultVehicleRaycaster(&world));
+            vehicles.emplace_back(new btRaycastVehicle(tuning, body, raycasters.back().get()));
+            btRaycastVehicle* vehicle = vehicles.back().get();
+            const btVector3 down(0, -1, 0), axle(-1, 0, 0);
+            const btScalar width = 0.4, radius = 1.5, height = 1.2, rest = 0.6;
+            vehicle->addWheel(btVector3(1 - 0.3 * width, height, 2 - radius), down, axle, rest, radius, tuning, true);
+            vehicle->addWheel(btVector3(-1 + 0.3 * width, height, 2 - radius), down, axle, rest, radius, tuning, true);
+            vehicle->addWheel(btVector3(1 - 0.3 * width, height, -2 + radius), down, axle, rest, radius, tuning, false);
+            vehicle->addWheel(btVector3(-1 + 0.3 * width, height, -2 + radius), down, axle, rest, radius, tuning, false);
+            for (int k = 0; k < vehicle->getNumWheels(); k++) {
+                btWheelInfo& wheel = vehicle->getWheelInfo(k);
+                wheel.m_suspensionStiffness = 20;
+                wheel.m_wheelsDampingRelaxation = 2.3f;
+                wheel.m_wheelsDampingCompression = 4.4f;
+                wheel.m_frictionSlip = 1000;
+                wheel.m_rollInfluence = 0.1f;
+            }
+            if (batched) batch.add(vehicle, tires);
+        }
+        world.addAction(&timed);
+    }
+
+    ~Lot() {
+        world.removeAction(&timed);
+        for (auto& body : chassis) world.removeRigidBody(body.get());
+        world.removeRigidBody(ground.get());
+    }
+
+    void drive(int step) {
+        for (int i = 0; i < CARS; i++) {
+            btRaycastVehicle* vehicle = vehicles[i].get();
+            // every third car brakes for a while, the others accelerate
+            const bool braking = i % 3 == 0 && step > STEPS / 2;
+            const btScalar steering = 0.3f * std::sin(step * 0.02f + i);
+            for (int k = 0; k < 4; k++) {
+                vehicle->applyEngineForce(!braking && k >= 2 ? 2000 : 0, k);
+                vehicle->setBrake(braking ? 50 : 0, k);
+                if (k < 2) vehicle->setSteeringValue(steering, k);
+            }
+        }
+    }
+
+    void run() {
+        for (int step = 0; step < STEPS; step++) {
+            drive(step);
+            const btScalar step_time = 1.0 / 60.0;
+            world.stepSimulation(step_time, 2, step_time / 2);
+        }
+    }
+};
+
+static float max_difference(const Lot& a, const Lot& b) {
+    float difference = 0;
+    for (int i = 0; i < CARS; i++) {
+        const btVector3 pa = a.chassis[i]->getCenterOfMassPosition();
+        const btVector3 pb = b.chassis[i]->getCenterOfMassPosition();
+        difference = std::max(difference, float(pa.distance(pb)));
+    }
+    return difference;
+}
+
+// evaluating the curve at many slips, straight from the formula or baked
+static void run_tire_curves() {
+    const int samples = 1000000;
+    for (bool baked : { false, true }) {
+        float sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < samples; i++) {
+            const float slip = (i % 1000) * 0.001f;
+            sum += baked ? physics::tire_force(physics::TireType::Dry, slip)
+                : physics::tire_formula(physics::TireType::Dry, slip);
+        }
+        std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        cout << (baked ? "baked curve:  " : "formula:      ") << took.count() / samples
+            << " ns per wheel (sum " << sum << ")" << endl;
+    }
+}
+
+int main() {
+    cout << CARS << " cars, " << STEPS << " steps" << endl;
+    Lot single(false), batched(true), tired(true, 0, physics::TireType::Dry), nudged(false, 1e-5f);
+    for (Lot* lot : { &single, &batched, &tired, &nudged }) lot->run();
+
+    for (Lot* lot : { &single, &batched, &tired }) {
+        cout << (!lot->batched ? "per car:      " :
+                lot->tires == physics::TireType::Stock ? "batch:        " : "batch, tires: ")
+            << CARS / lot->timed.median() << " cars/ms" << endl;
+    }
+    cout << "max chassis position difference " << max_difference(single, batched)
+        << " m, nudged " << max_difference(single, nudged) << " m" << endl;
+    run_tire_curves();
+}
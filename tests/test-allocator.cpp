@@ -0,0 +1,70 @@
+#include "../physics/allocator.hpp"
+#include "../physics/world.hpp"
+#include <LinearMath/btAlignedAllocator.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+int main() {
+    physics::install_allocator();
+
+    // blocks of every size class and past it keep alignment and contents,
+    // and bytes are counted to the category of the scope
+    const physics::AllocatorStats before = physics::allocator_stats();
+    std::vector<void*> blocks;
+    {
+        physics::AllocScope scope(physics::AllocCategory::Solver);
+        for (size_t size = 1; size <= 4096; size = size * 3 / 2 + 1) {
+            void* p = btAlignedAlloc(size, 16);
+            assert(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+            std::memset(p, int(size), size);
+            blocks.push_back(p);
+        }
+        void* wide = btAlignedAlloc(100, 64);
+        assert(reinterpret_cast<uintptr_t>(wide) % 64 == 0);
+        blocks.push_back(wide);
+    }
+    const physics::AllocatorStats during = physics::allocator_stats();
+    const int solver = int(physics::AllocCategory::Solver);
+    assert(during.allocations[solver] - before.allocations[solver] == blocks.size());
+    assert(during.live_bytes[solver] > before.live_bytes[solver]);
+    assert(during.heap_bytes > before.heap_bytes && during.pooled_bytes > 0);
+    for (size_t i = 0, size = 1; i + 1 < blocks.size(); i++, size = size * 3 / 2 + 1) {
+        const unsigned char* bytes = static_cast<unsigned char*>(blocks[i]);
+        assert(bytes[0] == (unsigned char)size && bytes[size - 1] == (unsigned char)size);
+    }
+    for (void* p : blocks) btAlignedFree(p);
+    const physics::AllocatorStats after = physics::allocator_stats();
+    assert(after.live_bytes[solver] == before.live_bytes[solver]);
+    assert(after.heap_bytes == before.heap_bytes);
+
+    // a stepping world allocates in its collision and solver phases
+    {
+        physics::World phys;
+        phys.add_static_cube(0, glm::mat4(1.0f), 20, 1, 20);
+        for (int i = 0; i < 50; i++) {
+            glm::vec3 pos(i % 5 * 1.5f, 2 + i / 25 * 2.0f, i / 5 % 5 * 1.5f);
+            phys.add_cube(1 + i, glm::translate(glm::mat4(1.0f), pos), 1, 0.5f, 0.5f, 0.5f);
+        }
+        const physics::AllocatorStats start = physics::allocator_stats();
+        for (int i = 0; i < 60; i++) phys.single_step();
+        physics::WorldStats stats = phys.stats();
+        const int collision = int(physics::AllocCategory::Collision);
+        assert(stats.memory.live_bytes[collision] > start.live_bytes[collision]);
+        assert(stats.memory.allocations[collision] > start.allocations[collision]);
+        assert(stats.memory.allocations[solver] > start.allocations[solver]);
+        cout << "world holds " << stats.memory.live_bytes[0] << " + "
+            << stats.memory.live_bytes[1] << " + " << stats.memory.live_bytes[2]
+            << " bytes, " << stats.memory.pooled_bytes << " pooled" << endl;
+    }
+
+    // with the world gone nothing is left in the pools, and they are freed
+    const physics::AllocatorStats end = physics::allocator_stats();
+    for (int i = 0; i < physics::ALLOC_CATEGORIES; i++) assert(end.live_bytes[i] == 0);
+    assert(physics::uninstall_allocator());
+    assert(physics::allocator_stats().pooled_bytes == 0);
+    void* p = btAlignedAlloc(64, 16);
+    assert(physics::allocator_stats().allocations[0] == end.allocations[0]);
+    btAlignedFree(p);
+}
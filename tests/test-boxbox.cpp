@@ -0,0 +1,75 @@
+#include "../physics/box_box.hpp"
+#include <BulletCollision/CollisionDispatch/btBoxBoxDetector.h>
+#include <BulletCollision/CollisionShapes/btBoxShape.h>
+#include <cstdlib>
+#include <vector>
+
+struct Contact {
+    btVector3 normal, point;
+    btScalar depth;
+};
+
+struct Contacts : public btDiscreteCollisionDetectorInterface::Result {
+    std::vector<Contact> contacts;
+    void setShapeIdentifiersA(int, int) {}
+    void setShapeIdentifiersB(int, int) {}
+    void addContactPoint(const btVector3& normal, const btVector3& point, btScalar depth) {
+        Contact c = { normal, point, depth };
+        contacts.push_back(c);
+    }
+};
+
+static float random(float lo, float hi) {
+    return lo + (hi - lo) * (rand() / float(RAND_MAX));
+}
+
+static btTransform random_transform(float spread, float tilt) {
+    btQuaternion q(btVector3(random(-1, 1), random(-1, 1), random(-1, 1)).normalized(), random(-tilt, tilt));
+    return btTransform(q, btVector3(random(-spread, spread), random(-spread, spread), random(-spread, spread)));
+}
+
+static bool same(const btVector3& a, const btVector3& b) {
+    return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+int main() {
+    // the contacts must be exactly those of btBoxBoxDetector, for boxes
+    // anywhere near each other and for boxes resting on each other
+    int touching = 0, contacts = 0, edges = 0;
+    for (int i = 0; i < 200000; i++) {
+        const bool resting = i % 2 == 0;
+        btBoxShape box_a(btVector3(random(0.1f, 2), random(0.1f, 2), random(0.1f, 2)));
+        btBoxShape box_b(btVector3(random(0.1f, 2), random(0.1f, 2), random(0.1f, 2)));
+        btTransform ta = random_transform(resting ? 0 : 3, resting ? 0.02f : SIMD_PI);
+        btTransform tb = random_transform(resting ? 0.5f : 3, resting ? 0.02f : SIMD_PI);
+        if (resting) {
+            // b sits on top of a, sinking a little into it
+            const btScalar top = ta.getOrigin().y() + box_a.getHalfExtentsWithMargin().y()
+                + box_b.getHalfExtentsWithMargin().y() - random(0, 0.05f);
+            tb.getOrigin().setY(top);
+        }
+
+        btDiscreteCollisionDetectorInterface::ClosestPointInput input;
+        input.m_transformA = ta;
+        input.m_transformB = tb;
+        Contacts expected, got;
+        btBoxBoxDetector(&box_a, &box_b).getClosestPoints(input, expected, nullptr);
+        const int n = physics::collide_boxes(ta, box_a.getHalfExtentsWithMargin(),
+                tb, box_b.getHalfExtentsWithMargin(), got);
+
+        assert(size_t(n) == got.contacts.size());
+        assert(got.contacts.size() == expected.contacts.size());
+        for (size_t k = 0; k < got.contacts.size(); k++) {
+            const Contact& g = got.contacts[k];
+            const Contact& e = expected.contacts[k];
+            assert(same(g.normal, e.normal) && same(g.point, e.point) && g.depth == e.depth);
+        }
+        touching += n > 0;
+        contacts += n;
+        edges += n == 1;
+    }
+    // both face and edge contacts were covered
+    assert(touching > 10000 && edges > 1000);
+    cout << touching << " touching pairs, " << contacts << " contacts, "
+        << edges << " single point contacts, all same as btBoxBoxDetector" << endl;
+}
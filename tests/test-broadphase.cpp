@@ -0,0 +1,117 @@
+#include "../physics/hash_grid.hpp"
+#include "../physics/world.hpp"
+#include <BulletCollision/BroadphaseCollision/btOverlappingPairCache.h>
+#include <LinearMath/btAabbUtil2.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdlib>
+#include <set>
+
+typedef std::set<std::pair<int, int>> Pairs;
+
+static float random(float lo, float hi) {
+    return lo + (hi - lo) * (rand() / float(RAND_MAX));
+}
+
+static bool overlap(const btBroadphaseProxy* a, const btBroadphaseProxy* b) {
+    return TestAabbAgainstAabb2(a->m_aabbMin, a->m_aabbMax, b->m_aabbMin, b->m_aabbMax);
+}
+
+static Pairs pairs_of(btOverlappingPairCache* cache) {
+    Pairs pairs;
+    btBroadphasePairArray& array = cache->getOverlappingPairArray();
+    for (int i = 0; i < array.size(); i++) {
+        int a = array[i].m_pProxy0->getUid(), b = array[i].m_pProxy1->getUid();
+        pairs.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+    }
+    return pairs;
+}
+
+struct Collector : public btBroadphaseAabbCallback {
+    std::set<int> found;
+    bool process(const btBroadphaseProxy* proxy) {
+        found.insert(proxy->getUid());
+        return true;
+    }
+};
+
+// the grid against testing every pair, with boxes of all levels moving,
+// appearing and disappearing
+static void compare_to_brute_force() {
+    physics::HashGridBroadphase grid;
+    std::vector<btBroadphaseProxy*> proxies;
+    auto box = [](btVector3& min, btVector3& max) {
+        const btVector3 c(random(-20, 20), random(-5, 5), random(-20, 20));
+        // mostly small, some on each coarser level and a few larger than all
+        const float r = rand() % 50 == 0 ? random(0.1f, 40) : random(0.05f, 0.3f);
+        min = c - btVector3(r, r, r);
+        max = c + btVector3(r, r, r * 0.5f);
+    };
+    for (int i = 0; i < 500; i++) {
+        btVector3 min, max;
+        box(min, max);
+        proxies.push_back(grid.createProxy(min, max, BOX_SHAPE_PROXYTYPE, nullptr, 1, -1, nullptr, nullptr));
+    }
+    for (int round = 0; round < 20; round++) {
+        for (size_t i = 0; i < proxies.size(); i++) {
+            btVector3 min, max;
+            grid.getAabb(proxies[i], min, max);
+            const int what = rand() % 10;
+            if (what == 0) {
+                box(min, max);
+            } else if (what < 5) {
+                const btVector3 d(random(-0.2f, 0.2f), random(-0.2f, 0.2f), random(-0.2f, 0.2f));
+                min += d;
+                max += d;
+            } else if (what == 5 && round % 4 == 3) {
+                grid.destroyProxy(proxies[i], nullptr);
+                box(min, max);
+                proxies[i] = grid.createProxy(min, max, BOX_SHAPE_PROXYTYPE, nullptr, 1, -1, nullptr, nullptr);
+                continue;
+            }
+            grid.setAabb(proxies[i], min, max, nullptr);
+        }
+        grid.calculateOverlappingPairs(nullptr);
+
+        Pairs expected;
+        for (size_t i = 0; i < proxies.size(); i++) {
+            for (size_t k = i + 1; k < proxies.size(); k++) {
+                if (!overlap(proxies[i], proxies[k])) continue;
+                const int a = proxies[i]->getUid(), b = proxies[k]->getUid();
+                expected.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        assert(pairs_of(grid.getOverlappingPairCache()) == expected);
+    }
+
+    const btVector3 min(-3, -1, -3), max(2, 1, 4);
+    Collector collector;
+    grid.aabbTest(min, max, collector);
+    std::set<int> expected;
+    for (btBroadphaseProxy* p : proxies) {
+        if (TestAabbAgainstAabb2(min, max, p->m_aabbMin, p->m_aabbMax)) expected.insert(p->getUid());
+    }
+    assert(collector.found == expected);
+    cout << "hash grid: " << pairs_of(grid.getOverlappingPairCache()).size() << " pairs of "
+        << proxies.size() << " boxes in " << grid.occupied_cells() << " cells" << endl;
+}
+
+int main() {
+    compare_to_brute_force();
+
+    // a world on the grid: cubes fall on the ground and come to rest
+    physics::World phys(physics::Broadphase::HashGrid);
+    phys.set_pile_merging(false);
+    phys.add_static_cube(1, glm::mat4(1.0f), 20, 1, 20);
+    for (int i = 0; i < 25; i++) {
+        const glm::vec3 pos(i % 5 * 2.0f - 4, 3 + i * 0.1f, i / 5 * 2.0f - 4);
+        phys.add_cube(10 + i, glm::translate(glm::mat4(1.0f), pos), 1, 0.5f, 0.5f, 0.5f);
+    }
+    for (int i = 0; i < 600; i++) phys.single_step();
+    for (const auto& c : phys.take_snapshot().changes) {
+        if (c.first >= 10) assert(std::abs(c.second[3][1] - 1.5f) < 0.05f);
+    }
+    physics::WorldStats stats = phys.stats();
+    assert(stats.sleeping_bodies == 25);
+    // every cube touches the ground only
+    assert(stats.overlapping_pairs == 25);
+}
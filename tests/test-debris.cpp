@@ -0,0 +1,56 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+int main() {
+    physics::World phys;
+
+    // ground top is at y = 1
+    phys.add_static_cube(1, glm::mat4(1.0f), 20, 1, 20);
+    for (int i = 0; i < 1001; i++) {
+        phys.add_debris(glm::vec3(std::sin(i) * 10, 5.0f + i * 0.01f, std::cos(i) * 10),
+                glm::vec3(0.0f), 0.1f);
+    }
+    // this one falls past the ground and gets dropped
+    phys.add_debris(glm::vec3(50.0f, 5.0f, 0.0f), glm::vec3(0.0f), 0.1f);
+
+    for (int i = 0; i < 600; i++) {
+        phys.single_step();
+    }
+    auto snapshot = phys.take_snapshot();
+    assert(snapshot.debris_updated);
+    assert(snapshot.debris.size() == 1001);
+    for (const auto& d : snapshot.debris) {
+        assert(std::fabs(d.y - 1.1f) < 0.01f);
+    }
+
+    phys.promote_debris(glm::vec3(0.0f, 1.0f, 10.0f), 1.0f);
+    phys.single_step();
+    snapshot = phys.take_snapshot();
+    assert(!snapshot.new_cubes.empty());
+    assert(snapshot.debris.size() + snapshot.new_cubes.size() == 1001);
+    cout << "promoted " << snapshot.new_cubes.size() << " debris to cubes" << endl;
+
+    // the game hears when the last particles are gone, both when promoted
+    // and when they fall out of the world
+    for (int pass = 0; pass < 2; pass++) {
+        physics::World phys;
+        phys.add_static_cube(1, glm::mat4(1.0f), 20, 1, 20);
+        for (int i = 0; i < 10; i++) {
+            phys.add_debris(glm::vec3(pass == 0 ? 0.0f : 50.0f, 5.0f + i, 0.0f), glm::vec3(0.0f), 0.1f);
+        }
+        phys.single_step();
+        assert(phys.take_snapshot().debris.size() == 10);
+        if (pass == 0) phys.promote_debris(glm::vec3(0.0f, 10.0f, 0.0f), 20.0f);
+        bool cleared = false;
+        for (int i = 0; i < 600 && !cleared; i++) {
+            phys.single_step();
+            snapshot = phys.take_snapshot();
+            cleared = snapshot.debris_updated && snapshot.debris.empty();
+        }
+        assert(cleared);
+        // and nothing more after that
+        phys.single_step();
+        assert(!phys.take_snapshot().debris_updated);
+    }
+}
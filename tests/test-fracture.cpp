@@ -0,0 +1,51 @@
+#include "../physics/fracture.hpp"
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+int main() {
+    // fragments fill the box exactly
+    const glm::vec3 size(2.0f, 1.0f, 0.5f);
+    auto fragments = physics::prefracture(size, 20);
+    assert(fragments.size() == 20);
+    float volume = 0;
+    for (const auto& f : fragments) {
+        for (int i = 0; i < 3; i++) {
+            assert(f.size[i] > 0);
+            assert(std::fabs(f.center[i]) + f.size[i] <= size[i] + 1e-4f);
+        }
+        volume += f.size.x * f.size.y * f.size.z;
+    }
+    assert(std::fabs(volume - size.x * size.y * size.z) < 1e-3f);
+
+    // a wall resting on the ground, hit by a falling box on one end
+    physics::World phys;
+    phys.add_static_cube(1, glm::mat4(1.0f), 20, 1, 20);
+    glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 3.0f, 0.0f));
+    phys.add_destructible(100, t, 100, 2, 2, 0.5, 32, 50);
+    std::unordered_map<ObjectId, glm::mat4> rest;
+    for (int i = 0; i < 120; i++) {
+        phys.single_step();
+        auto snapshot = phys.take_snapshot();
+        for (const auto& c : snapshot.new_cubes) rest[c.id] = c.transform;
+        for (const auto& c : snapshot.changes) rest[c.first] = c.second;
+    }
+    assert(rest.size() == 32);
+
+    t = glm::translate(glm::mat4(1.0f), glm::vec3(1.5f, 12.0f, 0.0f));
+    phys.add_cube(2, t, 200, 0.5, 0.5, 0.5);
+    std::unordered_map<ObjectId, glm::mat4> poses = rest;
+    for (int i = 0; i < 120; i++) {
+        phys.single_step();
+        for (const auto& c : phys.take_snapshot().changes) poses[c.first] = c.second;
+    }
+    // fragments on the hit end broke off, the other end stayed in place
+    int moved = 0;
+    for (ObjectId id = 100; id < 132; id++) {
+        glm::vec3 before(rest[id][3]);
+        glm::vec3 now(poses[id][3]);
+        if (glm::length(now - before) > 0.2f) moved++;
+    }
+    assert(moved > 0 && moved < 32);
+    cout << moved << " of 32 fragments broke off" << endl;
+}
@@ -0,0 +1,51 @@
+#include "../physics/governor.hpp"
+
+/** Feed steps of ms to the governor, returns the level changes seen */
+static int feed(physics::Governor& g, float ms, int steps) {
+    int changes = 0;
+    for (int i = 0; i < steps; i++) {
+        changes += g.update(ms);
+    }
+    return changes;
+}
+
+int main() {
+    physics::Governor g;
+    // full quality is one step per frame with Bullet's defaults
+    assert(g.level == 0 && g.quality().substeps == 1 && g.quality().solver_iterations == 10);
+
+    // steps well within the budget keep full quality
+    assert(feed(g, 2, 600) == 0 && g.level == 0);
+
+    // slow steps lower the quality, one level per cooldown
+    feed(g, 30, physics::Governor::DOWNGRADE_COOLDOWN * 2);
+    const int dropped = g.level;
+    assert(dropped >= 1);
+    assert(g.quality().solver_iterations < physics::QUALITY_LEVELS[0].solver_iterations);
+    feed(g, 30, physics::Governor::DOWNGRADE_COOLDOWN * physics::QUALITY_LEVEL_COUNT);
+    assert(g.level == physics::QUALITY_LEVEL_COUNT - 1);
+
+    // steps between the thresholds neither lower nor raise it
+    const float between = (physics::Governor::PRESSURE_MS + physics::Governor::RELAXED_MS) / 2;
+    assert(feed(g, between, 600) == 0 && g.level == physics::QUALITY_LEVEL_COUNT - 1);
+
+    // fast steps bring it back one level at a time, with the longer cooldown
+    int steps = 0;
+    while (!g.update(1)) steps++;
+    assert(steps < 30 && g.level == physics::QUALITY_LEVEL_COUNT - 2);
+    assert(feed(g, 1, physics::Governor::UPGRADE_COOLDOWN - 1) == 0);
+    assert(feed(g, 1, 1) == 1 && g.level == physics::QUALITY_LEVEL_COUNT - 3);
+    feed(g, 1, physics::Governor::UPGRADE_COOLDOWN * physics::QUALITY_LEVEL_COUNT);
+    assert(g.level == 0);
+
+    const physics::GovernorMetrics m = g.read_metrics();
+    assert(m.downgrades == unsigned(physics::QUALITY_LEVEL_COUNT - 1));
+    assert(m.upgrades == m.downgrades && m.level == 0);
+
+    // disabled, it goes straight back to full quality
+    feed(g, 30, physics::Governor::DOWNGRADE_COOLDOWN * 2);
+    assert(g.level > 0);
+    g.enabled = false;
+    assert(feed(g, 30, 1) == 1 && g.level == 0);
+    cout << m.downgrades << " downgrades and " << m.upgrades << " upgrades" << endl;
+}
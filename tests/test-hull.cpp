@@ -0,0 +1,70 @@
+#include "../physics/hull.hpp"
+#include "../util/file.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+
+static string cache_file(const string& dir, uint64_t key) {
+    std::stringstream ss;
+    ss << dir << '/' << std::hex << key << ".hull";
+    return ss.str();
+}
+
+int main() {
+    // the cache goes to a fresh directory, not into the game data
+    char dir_template[] = "/tmp/test-hull-XXXXXX";
+    const string dir = mkdtemp(dir_template);
+    physics::set_hull_cache_dir(dir);
+
+    // sphere-ish point cloud, its hull has all points as vertices
+    std::vector<glm::vec3> points;
+    for (int i = 0; i < 400; i++) {
+        float y = 1.0f - 2.0f * (i + 0.5f) / 400;
+        float r = std::sqrt(1.0f - y*y);
+        points.push_back(glm::vec3(std::cos(i * 2.4f) * r, y, std::sin(i * 2.4f) * r));
+    }
+
+    auto hull = physics::simplified_hull(points, 32);
+    assert(hull.size() >= 4);
+    assert(hull.size() <= 32);
+    const string file = cache_file(dir, physics::hull_key(points, 32));
+    const string stored = util::read_file(file.c_str());
+
+    // without the memo it comes from the disk and is identical
+    physics::clear_hull_memo();
+    auto cached = physics::simplified_hull(points, 32);
+    assert(cached.size() == hull.size());
+    for (size_t i = 0; i < hull.size(); i++) {
+        assert(cached[i].x == hull[i].x && cached[i].y == hull[i].y && cached[i].z == hull[i].z);
+    }
+
+    // it really is the file: one with a vertex moved gives the moved vertex
+    string moved = stored;
+    const float x = 5.0f;
+    memcpy(&moved[8], &x, sizeof(x));
+    util::write_file(file.c_str(), moved);
+    physics::clear_hull_memo();
+    assert(physics::simplified_hull(points, 32)[0].x == 5.0f);
+
+    // a broken file is simplified again and rewritten
+    util::write_file(file.c_str(), "HULL");
+    physics::clear_hull_memo();
+    assert(physics::simplified_hull(points, 32).size() == hull.size());
+    assert(util::read_file(file.c_str()) == stored);
+
+    // small hulls are kept as they are
+    std::vector<glm::vec3> box;
+    for (int i = 0; i < 8; i++) {
+        box.push_back(glm::vec3(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1));
+    }
+    box.push_back(glm::vec3(0.0f)); // interior point is dropped
+    assert(physics::simplified_hull(box, 32).size() == 8);
+
+    std::remove(file.c_str());
+    std::remove(cache_file(dir, physics::hull_key(box, 32)).c_str());
+    rmdir(dir.c_str());
+    cout << "hull of " << points.size() << " points simplified to " << hull.size() << endl;
+}
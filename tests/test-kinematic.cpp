@@ -0,0 +1,47 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+static physics::Keyframe key(float time, glm::vec3 pos, float yaw = 0) {
+    physics::Keyframe k = { time, pos, yaw, 0, 0 };
+    return k;
+}
+
+int main() {
+    physics::World phys;
+    phys.add_static_cube(0, glm::translate(glm::mat4(1.0f), glm::vec3(0, -5, 0)), 50, 1, 50);
+
+    // a ferry going back and forth carries a box
+    std::vector<physics::Keyframe> ferry = {
+        key(0, glm::vec3(0, 1, 0)), key(4, glm::vec3(4, 1, 0)), key(8, glm::vec3(0, 1, 0)) };
+    phys.add_kinematic(1, ferry, true, 3, 0.5f, 3);
+    phys.add_cube(2, glm::translate(glm::mat4(1.0f), glm::vec3(0, 2.1f, 0)), 1, 0.5f, 0.5f, 0.5f);
+
+    // a gate turns a quarter and stays
+    std::vector<physics::Keyframe> gate = {
+        key(0, glm::vec3(20, 0, 0)), key(1, glm::vec3(20, 0, 0), float(M_PI / 2)) };
+    phys.add_kinematic(3, gate, false, 0.2f, 2, 4);
+
+    std::unordered_map<ObjectId, glm::mat4> poses;
+    for (int i = 0; i < 120; i++) {
+        phys.single_step();
+        for (const auto& c : phys.take_snapshot().changes) poses[c.first] = c.second;
+    }
+    // halfway there and easing, the box rides along on friction
+    assert(std::fabs(poses[1][3].x - 2) < 0.05f && std::fabs(poses[1][3].y - 1) < 1e-3f);
+    assert(std::fabs(poses[2][3].x - 2) < 0.2f && poses[2][3].y > 1.9f);
+
+    for (int i = 0; i < 360; i++) {
+        phys.single_step();
+        for (const auto& c : phys.take_snapshot().changes) poses[c.first] = c.second;
+    }
+    // the loop is back at the start, the box with it
+    assert(std::fabs(poses[1][3].x) < 0.1f);
+    assert(std::fabs(poses[2][3].x) < 0.2f && poses[2][3].y > 1.9f);
+    // gate x axis now points along -z
+    assert(std::fabs(poses[3][0].z + 1) < 1e-3f && std::fabs(poses[3][3].x - 20) < 1e-3f);
+
+    physics::WorldStats stats = phys.stats();
+    assert(stats.bodies == 3);
+    cout << "box rode to " << poses[2][3].x << ", " << poses[2][3].y << endl;
+}
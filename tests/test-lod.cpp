@@ -0,0 +1,68 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <unordered_map>
+
+typedef std::unordered_map<ObjectId, glm::mat4> Poses;
+
+static glm::mat4 at(float x, float y, float z) {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+}
+
+/** Steps for two full sweeps, and whether the slab published a pose */
+static bool run(physics::World& phys, Poses& poses, int steps = 30) {
+    bool slab_moved = false;
+    for (int i = 0; i < steps; i++) {
+        phys.single_step();
+        for (const auto& c : phys.take_snapshot().changes) {
+            poses[c.first] = c.second;
+            slab_moved = slab_moved || c.first == 2;
+        }
+    }
+    return slab_moved;
+}
+
+int main() {
+    physics::World phys;
+    phys.set_pile_merging(false);
+    phys.set_lod_radius(10);
+    phys.add_static_cube(1, glm::mat4(1.0f), 40, 1, 40);
+    // a slab resting on the ground at x 0, its center is 1.5 up
+    phys.add_cube(2, at(0, 1.5f, 0), 10, 3, 0.5f, 3);
+    phys.set_focus(0, glm::vec3(0, 0, 0));
+    Poses poses;
+    run(phys, poses, 120);
+    assert(phys.stats().frozen_bodies == 0);
+    const glm::mat4 rest = poses[2];
+
+    // past the radius but within radius * HYSTERESIS nothing freezes yet
+    phys.set_focus(0, glm::vec3(-11, 0, 0));
+    run(phys, poses);
+    assert(phys.stats().frozen_bodies == 0);
+
+    // further out the slab freezes and a cube dropped nearer the focus
+    // lands on it, the frozen slab does not budge
+    phys.set_focus(0, glm::vec3(-13, 0, 0));
+    run(phys, poses);
+    assert(phys.stats().frozen_bodies == 1);
+    phys.add_cube(3, at(-2.5f, 5, 0), 1, 0.5f, 0.5f, 0.5f);
+    assert(!run(phys, poses, 120));
+    assert(phys.stats().frozen_bodies == 1);
+    assert(std::fabs(poses[3][3].y - 2.5f) < 0.05f);
+    assert(std::fabs(poses[3][3].x + 2.5f) < 0.05f);
+
+    // coming back within radius * HYSTERESIS keeps it frozen, within radius
+    // wakes it where it was
+    phys.set_focus(0, glm::vec3(-11, 0, 0));
+    assert(!run(phys, poses));
+    assert(phys.stats().frozen_bodies == 1);
+    phys.set_focus(0, glm::vec3(-9, 0, 0));
+    run(phys, poses);
+    assert(phys.stats().frozen_bodies == 0);
+    for (int i = 0; i < 3; i++) assert(std::fabs(poses[2][3][i] - rest[3][i]) < 0.01f);
+
+    // and it is a real body again, a heavy box knocks it
+    phys.add_cube(4, at(2.5f, 6, 0), 200, 0.5f, 0.5f, 0.5f);
+    assert(run(phys, poses, 60));
+    cout << "slab froze at 13 m, woke at 9 m, cube rests at " << poses[3][3].y << endl;
+}
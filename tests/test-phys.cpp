@@ -16,8 +16,29 @@ int main() {
     glm::mat4 groundtrans = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -10.0f, -30.0f));
     phys.add_cube(2, groundtrans, 0.0, 50, 1, 50);
 
+    // static pieces are merged into one body, removal rebuilds it incrementally
+    for (int i = 0; i < 10; i++) {
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(i * 2.0f, -8.0f, -30.0f));
+        phys.add_static_cube(10 + i, t, 1, 1, 1);
+    }
+    phys.single_step();
+    phys.remove(10);
+    phys.remove(15);
+
     for (int i = 0; i < 5; i++) {
         phys.single_step();
     }
+    physics::WorldStats stats = phys.stats();
+    assert(stats.step == 6 && stats.bodies == 2 && stats.active_bodies == 2);
+    assert(stats.islands >= 1 && stats.active_islands == stats.islands);
+
+    // both cubes come to rest on the ground and fall asleep
+    for (int i = 0; i < 600; i++) {
+        phys.single_step();
+    }
+    stats = phys.stats();
+    assert(stats.sleeping_bodies == 2 && stats.active_islands == 0 && stats.islands >= 1);
+    assert(stats.manifolds > 0 && stats.contact_points >= stats.manifolds);
+    assert(stats.manifold_pool_used == stats.manifolds && stats.pool_bytes > 0);
     phys.printworld();
 }
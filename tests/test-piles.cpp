@@ -0,0 +1,43 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <unordered_map>
+
+int main() {
+    physics::World phys;
+
+    // ground top is at y = 1, a stack of boxes on it
+    phys.add_static_cube(1, glm::mat4(1.0f), 20, 1, 20);
+    for (int i = 0; i < 3; i++) {
+        for (int y = 0; y < 3; y++) {
+            glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(i * 1.0f, 1.5f + y, 0.0f));
+            phys.add_cube(10 + i * 3 + y, t, 1, 0.5, 0.5, 0.5);
+        }
+    }
+    for (int i = 0; i < 600; i++) {
+        phys.single_step();
+    }
+    std::unordered_map<ObjectId, glm::mat4> poses;
+    for (const auto& c : phys.take_snapshot().changes) poses[c.first] = c.second;
+    assert(poses.size() == 9);
+
+    // merged into a single body resting on the ground
+    assert(phys.stats().overlapping_pairs == 1);
+
+    // a heavy box falling on the stack splits it, members continue from
+    // where they rested
+    glm::mat4 t = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 8.0f, 0.0f));
+    phys.add_cube(100, t, 50, 0.5, 0.5, 0.5);
+    for (int i = 0; i < 60; i++) {
+        phys.single_step();
+        for (const auto& c : phys.take_snapshot().changes) {
+            if (c.first == 100) continue;
+            glm::vec3 before(poses[c.first][3]);
+            glm::vec3 now(c.second[3]);
+            assert(glm::length(now - before) < 0.5f);
+            poses[c.first] = c.second;
+        }
+    }
+    assert(phys.stats().overlapping_pairs > 1);
+    cout << "pile split with " << phys.stats().overlapping_pairs << " pairs" << endl;
+}
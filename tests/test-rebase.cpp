@@ -0,0 +1,123 @@
+#include "../physics/recorder.hpp"
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+typedef std::unordered_map<ObjectId, glm::mat4> Poses;
+
+static physics::Keyframe key(float time, glm::vec3 pos) {
+    physics::Keyframe k = { time, pos, 0, 0, 0 };
+    return k;
+}
+
+/** Largest distance between positions of a and b moved by offset */
+static float max_distance(const Poses& a, const Poses& b, glm::vec3 offset) {
+    assert(a.size() == b.size());
+    float d = 0;
+    for (const auto& kv : a) {
+        auto it = b.find(kv.first);
+        assert(it != b.end());
+        d = std::max(d, glm::length(glm::vec3(kv.second[3]) - offset - glm::vec3(it->second[3])));
+    }
+    return d;
+}
+
+/** Cubes asleep on the ground, a car, a truck, a lift, a trigger and debris */
+static void build(physics::World& phys) {
+    phys.add_static_cube(0, glm::mat4(1.0f), 40, 1, 40);
+    for (int i = 0; i < 8; i++) {
+        phys.add_cube(i + 1, glm::translate(glm::mat4(1.0f), glm::vec3(i * 2.0f - 8, 2, 15)),
+                1, 0.5f, 0.5f, 0.5f);
+    }
+    phys.add_car(20, glm::translate(glm::mat4(1.0f), glm::vec3(-20, 3, -10)));
+    phys.add_truck(30, glm::translate(glm::mat4(1.0f), glm::vec3(20, 2.9f, -20)), 1);
+    phys.add_kinematic(40, { key(0, glm::vec3(25, 2, 10)), key(2, glm::vec3(25, 5, 10)),
+            key(4, glm::vec3(25, 2, 10)) }, true, 1, 0.2f, 1);
+    phys.add_trigger(50, glm::translate(glm::mat4(1.0f), glm::vec3(20, 2, 20)), 2, 2, 2);
+    for (int i = 0; i < 20; i++) {
+        phys.add_debris(glm::vec3(i * 0.5f, 3, -5), glm::vec3(0, 0, 1), 0.05f);
+    }
+    phys.set_pile_merging(false);
+}
+
+static void run(physics::Broadphase broadphase) {
+    const char* path = "test-rebase.poses";
+    // the world is moved, the same world next to it is not
+    physics::World moved(broadphase), still(broadphase);
+    build(moved);
+    build(still);
+    Poses moved_poses, still_poses;
+    int moved_events = 0, still_events = 0;
+    glm::dvec3 origin(0.0);
+    auto step = [&]() {
+        moved.single_step();
+        still.single_step();
+        physics::Snapshot a = moved.take_snapshot(), b = still.take_snapshot();
+        for (const auto& c : a.changes) moved_poses[c.first] = c.second;
+        for (const auto& c : b.changes) still_poses[c.first] = c.second;
+        moved_events += int(a.trigger_events.size());
+        still_events += int(b.trigger_events.size());
+        origin = a.origin;
+        return a;
+    };
+    moved.engine(20, true);
+    still.engine(20, true);
+    moved.engine(30, true);
+    still.engine(30, true);
+    for (int i = 0; i < 260; i++) step();
+    const physics::WorldStats before = moved.stats();
+    assert(before.sleeping_bodies == 8);
+    moved.start_recording(path);
+
+    // the truck drives through the trigger while the origin moves
+    const glm::vec3 offset(-256, 0, 512);
+    moved.rebase(offset);
+    // sleeping bodies publish nothing, poses seen before move like graphics
+    for (auto& kv : moved_poses) kv.second[3] -= glm::vec4(offset, 0.0f);
+    physics::Snapshot snapshot = step();
+    assert(origin == glm::dvec3(offset));
+    // moving did not wake anything up or lose pairs and contacts
+    physics::WorldStats after = moved.stats();
+    assert(after.sleeping_bodies == before.sleeping_bodies);
+    assert(after.overlapping_pairs == still.stats().overlapping_pairs);
+    assert(after.manifolds == still.stats().manifolds);
+    assert(max_distance(still_poses, moved_poses, offset) < 1e-3f);
+    // debris still lies on the moved ground
+    assert(snapshot.debris.size() == 20);
+    for (const glm::vec4& d : snapshot.debris) assert(std::fabs(d.y - 1.05f) < 0.01f);
+
+    for (int i = 0; i < 120; i++) {
+        step();
+        moved.drain_recording();
+    }
+    after = moved.stats();
+    assert(after.sleeping_bodies == before.sleeping_bodies);
+    const float drift = max_distance(still_poses, moved_poses, offset);
+    assert(drift < 0.05f);
+    assert(moved_events == still_events && moved_events > 0);
+
+    // the recording is relative to the first origin
+    moved.stop_recording();
+    moved.single_step();
+    moved.take_snapshot();
+    physics::PoseReplay replay(path);
+    std::vector<physics::ReplayPose> out;
+    assert(replay.seek(replay.last_step(), out));
+    float replay_drift = 0;
+    for (const auto& p : out) {
+        replay_drift = std::max(replay_drift,
+                glm::length(glm::vec3(p.transform[3]) - glm::vec3(still_poses[p.id][3])));
+    }
+    assert(replay_drift < 0.05f);
+    std::remove(path);
+
+    cout << (broadphase == physics::Broadphase::Tree ? "tree     " : "hash grid")
+        << ": drift " << drift << " m after 120 steps, " << moved_events << " trigger events" << endl;
+}
+
+int main() {
+    run(physics::Broadphase::Tree);
+    run(physics::Broadphase::HashGrid);
+}
@@ -0,0 +1,115 @@
+#include "../physics/recorder.hpp"
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+typedef std::unordered_map<ObjectId, glm::mat4> Poses;
+
+static float max_difference(const glm::mat4& a, const glm::mat4& b) {
+    float d = 0;
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) d = std::max(d, std::fabs(a[c][r] - b[c][r]));
+    }
+    return d;
+}
+
+int main() {
+    const char* path = "test-recorder.poses";
+    const char* cut_path = "test-recorder-cut.poses";
+    const int steps = 150, chunk_steps = 64;
+
+    physics::World phys;
+    phys.add_static_cube(0, glm::mat4(1.0f), 20, 1, 20);
+    for (int i = 0; i < 12; i++) {
+        glm::mat4 trans = glm::translate(glm::mat4(1.0f), glm::vec3(i % 4 * 1.5f - 2, 3 + i / 4 * 1.5f, 0));
+        trans = glm::rotate(trans, 0.3f * i, glm::vec3(1, 1, 0));
+        phys.add_cube(i + 1, trans, 1, 0.5f, 0.25f + 0.05f * i, 0.5f);
+    }
+    phys.start_recording(path, chunk_steps);
+
+    // what the game saw after each step
+    std::vector<Poses> seen(1);
+    for (int i = 0; i < steps; i++) {
+        if (i == 100) phys.remove(5);
+        phys.single_step();
+        Poses poses = seen.back();
+        if (i == 100) poses.erase(5);
+        for (const auto& c : phys.take_snapshot().changes) poses[c.first] = c.second;
+        assert(phys.stats().step == seen.size());
+        seen.push_back(poses);
+        // one frame in flight at a time, so nothing gets dropped
+        phys.drain_recording();
+    }
+    assert(phys.stats().recorder_dropped == 0);
+    phys.stop_recording();
+    phys.single_step();
+    // the game thread closes the file
+    phys.take_snapshot();
+
+    physics::PoseReplay replay(path);
+    assert(replay.first_step() == 1);
+    assert(replay.last_step() == uint64_t(steps));
+    std::vector<physics::ReplayPose> out;
+    assert(!replay.seek(0, out) && !replay.seek(steps + 1, out));
+
+    float difference = 0;
+    for (uint64_t step : { 1, 2, 63, 64, 65, 100, 101, 102, 128, 129, steps }) {
+        assert(replay.seek(step, out));
+        const Poses& expected = seen[step];
+        assert(out.size() == expected.size());
+        for (const auto& pose : out) {
+            auto it = expected.find(pose.id);
+            assert(it != expected.end());
+            difference = std::max(difference, max_difference(pose.transform, it->second));
+            // half extents as given, no matter how the body has turned
+            assert(std::fabs(pose.shape.size.y - (0.25f + 0.05f * (pose.id - 1))) < 1e-4f);
+            assert(glm::length(pose.shape.center) < 1e-4f);
+        }
+    }
+    // millimeters and 16 bit quaternions
+    assert(difference < 1e-3f);
+    assert(replay.seek(steps, out) && out.size() == 11);
+
+    // a recording cut short keeps its complete chunks
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::ofstream cut(cut_path, std::ios::binary);
+        cut.write(bytes.data(), bytes.size() - 16);
+    }
+    {
+        physics::PoseReplay cut(cut_path);
+        assert(cut.last_step() == 2 * chunk_steps);
+        assert(cut.seek(2 * chunk_steps, out) && out.size() == 11);
+    }
+
+    // a chunk which points outside of itself is rejected, not read
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        // last entry of the pose start column of the first chunk
+        const size_t pose_start = 16 + 40 + chunk_steps * 8;
+        const uint32_t bogus = 1 << 30;
+        std::memcpy(&bytes[pose_start + chunk_steps * 4], &bogus, 4);
+        std::ofstream corrupt(cut_path, std::ios::binary);
+        corrupt.write(bytes.data(), bytes.size());
+    }
+    for (const char* bad_path : { cut_path, "SConstruct" }) {
+        bool failed = false;
+        try {
+            physics::PoseReplay bad(bad_path);
+        } catch (const std::runtime_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+
+    std::remove(path);
+    std::remove(cut_path);
+    cout << steps << " steps replayed within " << difference << endl;
+}
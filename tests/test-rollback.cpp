@@ -0,0 +1,167 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <unordered_map>
+
+typedef std::unordered_map<ObjectId, glm::mat4> Poses;
+
+static physics::Keyframe key(float time, glm::vec3 pos) {
+    physics::Keyframe k = { time, pos, 0, 0, 0 };
+    return k;
+}
+
+static float max_distance(const Poses& a, const Poses& b) {
+    assert(a.size() == b.size());
+    float d = 0;
+    for (const auto& kv : a) {
+        auto it = b.find(kv.first);
+        assert(it != b.end());
+        d = std::max(d, glm::length(glm::vec3(kv.second[3]) - glm::vec3(it->second[3])));
+    }
+    return d;
+}
+
+/**
+ * A tower of cubes merges into a pile and is knocked apart by a sweeping
+ * platform, a cube far from the focus is frozen and woken. None of it
+ * starts the window over, and going back undoes all of it.
+ */
+static void piles_and_lod() {
+    physics::World phys;
+    phys.add_static_cube(0, glm::mat4(1.0f), 100, 1, 100);
+    for (int i = 0; i < 6; i++) {
+        phys.add_cube(i + 1, glm::translate(glm::mat4(1.0f),
+                    glm::vec3(i % 2 - 0.5f, 1.5f + i / 2 * 1.02f, 0)), 1, 0.5f, 0.5f, 0.5f);
+    }
+    phys.add_cube(10, glm::translate(glm::mat4(1.0f), glm::vec3(60, 3, 0)), 1, 0.5f, 0.5f, 0.5f);
+    // waits beside the tower, then sweeps through it
+    phys.add_kinematic(20, { key(0, glm::vec3(0, 2, -8)), key(6, glm::vec3(0, 2, -8)),
+            key(8, glm::vec3(0, 2, 8)) }, false, 2, 1, 0.2f);
+    phys.set_lod_radius(30);
+    phys.set_focus(0, glm::vec3(0));
+    phys.set_rollback_window(600);
+
+    std::vector<Poses> seen(1);
+    std::vector<physics::WorldStats> stats(1);
+    Poses shown;
+    auto step = [&]() {
+        phys.single_step();
+        for (const auto& c : phys.take_snapshot().changes) shown[c.first] = c.second;
+        return shown;
+    };
+    int merged = 0, split = 0;
+    for (int i = 1; i <= 540; i++) {
+        // the far cube wakes, the platform is close enough to keep going
+        if (i == 400) phys.set_focus(0, glm::vec3(32, 0, 0));
+        seen.push_back(step());
+        stats.push_back(phys.stats());
+        // the tower and the platform, then the ground, platform and far cube
+        if (!merged && stats[i].bodies == 3) merged = i;
+        if (merged && !split && stats[i].bodies > 3) split = i;
+    }
+    assert(merged > 0 && merged < 360 && split > 360);
+    assert(stats[10].frozen_bodies == 1 && stats[399].frozen_bodies == 1);
+    assert(stats[420].frozen_bodies == 0 && stats[540].frozen_bodies > 0);
+    // the window kept going through all of that
+    assert(stats[540].rollback_first == 0 && stats[540].rollback_last == 540);
+
+    // back to the pile, before the split and the wake
+    phys.set_focus(0, glm::vec3(0));
+    phys.rollback(merged + 20);
+    Poses poses = step();
+    physics::WorldStats now = phys.stats();
+    assert(now.bodies == 3 && now.frozen_bodies == 1);
+    assert(max_distance(poses, seen[merged + 21]) < 1e-3f);
+
+    // back to where the tower fell, before the merge
+    const uint64_t back = 30;
+    phys.rollback(back);
+    poses = step();
+    now = phys.stats();
+    assert(now.bodies == stats[back + 1].bodies && now.frozen_bodies == 1);
+    // contacts of the stacked tower are not warm started after going back
+    const float difference = max_distance(poses, seen[back + 1]);
+    assert(difference < 0.01f);
+
+    // and forward again, the tower merges again as it did the first time
+    for (uint64_t i = back + 2; i <= uint64_t(merged) + 40; i++) poses = step();
+    now = phys.stats();
+    assert(now.bodies == 3 && now.rollback_first == 0);
+    assert(max_distance(poses, seen[merged + 40]) < 0.05f);
+
+    cout << "merged at " << merged << " and split at " << split
+        << ", rolled back to step " << back << " within " << difference << " m" << endl;
+}
+
+int main() {
+    physics::World phys;
+    phys.add_static_cube(0, glm::mat4(1.0f), 30, 1, 30);
+    // a few cubes settle and fall asleep, a car drives and a platform loops
+    for (int i = 0; i < 8; i++) {
+        phys.add_cube(i + 1, glm::translate(glm::mat4(1.0f), glm::vec3(i * 2.0f - 8, 2 + 0.2f * i, 5)),
+                1, 0.5f, 0.5f, 0.5f);
+    }
+    phys.add_car(20, glm::translate(glm::mat4(1.0f), glm::vec3(0, 3, -10)));
+    phys.add_kinematic(30, { key(0, glm::vec3(10, 2, 0)), key(2, glm::vec3(10, 5, 0)),
+            key(4, glm::vec3(10, 2, 0)) }, true, 1, 0.2f, 1);
+    phys.engine(20, true);
+    phys.set_rollback_window(300);
+
+    std::vector<Poses> seen(1);
+    auto step = [&]() {
+        phys.single_step();
+        Poses poses = seen.back();
+        for (const auto& c : phys.take_snapshot().changes) poses[c.first] = c.second;
+        return poses;
+    };
+    for (int i = 0; i < 290; i++) {
+        seen.push_back(step());
+        assert(phys.stats().step == seen.size() - 1);
+    }
+    physics::WorldStats stats = phys.stats();
+    // window starts from the objects as added, the cubes went to sleep
+    assert(stats.rollback_first == 0 && stats.rollback_last == 290);
+    assert(stats.sleeping_bodies == 8);
+    assert(stats.rollback_bytes > 0);
+
+    // back to when the cubes were still falling, they wake up and the rest
+    // continues from there
+    const uint64_t back = 20;
+    phys.rollback(back);
+    Poses poses = step();
+    float difference = max_distance(poses, seen[back + 1]);
+    stats = phys.stats();
+    assert(difference < 1e-3f);
+    assert(stats.sleeping_bodies == 0);
+    assert(stats.rollback_first == 0 && stats.rollback_last == 291);
+
+    // the replayed steps stay close to the first run for a while
+    seen.push_back(poses);
+    for (int i = 0; i < 30; i++) poses = step();
+    assert(max_distance(poses, seen[back + 31]) < 0.05f);
+
+    // steps which were undone are gone
+    phys.rollback(100);
+    Poses before = poses;
+    poses = step();
+    assert(max_distance(poses, before) < 0.5f);
+
+    // the window is full at 300 steps and slides, older steps are gone too
+    for (int i = 0; i < 300; i++) poses = step();
+    stats = phys.stats();
+    assert(stats.rollback_last == stats.step && stats.rollback_first + 300 == stats.step);
+    phys.rollback(stats.rollback_first - 1);
+    before = poses;
+    poses = step();
+    assert(max_distance(poses, before) < 0.5f);
+
+    // new objects start the window over
+    phys.add_cube(40, glm::translate(glm::mat4(1.0f), glm::vec3(0, 5, 0)), 1, 0.5f, 0.5f, 0.5f);
+    step();
+    stats = phys.stats();
+    assert(stats.rollback_first == stats.step && stats.rollback_last == stats.step);
+
+    cout << "rolled back to step " << back << " within " << difference << " m" << endl;
+
+    piles_and_lod();
+}
@@ -0,0 +1,99 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <unordered_map>
+
+typedef std::unordered_map<ObjectId, glm::mat4> Poses;
+
+static glm::mat4 at(float x, float y, float z) {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+}
+
+/**
+ * Stacks which settle into piles, and loose cubes added and removed in
+ * between so the arrays are out of order
+ */
+static void build(physics::World& phys) {
+    phys.add_static_cube(1, glm::mat4(1.0f), 40, 1, 40);
+    for (int s = 0; s < 4; s++) {
+        for (int i = 0; i < 3; i++) {
+            for (int y = 0; y < 3; y++) {
+                phys.add_cube(10 + s * 10 + i * 3 + y, at(s * 8.0f - 12 + i, 1.5f + y, 6), 1, 0.5f, 0.5f, 0.5f);
+            }
+        }
+    }
+    for (int i = 0; i < 40; i++) {
+        phys.add_cube(100 + i, at((i * 7 % 40) - 20.0f, 2 + i % 3, -6.0f - i % 5), 1, 0.4f, 0.4f, 0.4f);
+    }
+}
+
+static void step(physics::World& phys, Poses& poses) {
+    phys.single_step();
+    physics::Snapshot snapshot = phys.take_snapshot();
+    for (const auto& c : snapshot.changes) poses[c.first] = c.second;
+}
+
+int main() {
+    physics::World plain, sorted;
+    Poses plain_poses, sorted_poses;
+    build(plain);
+    build(sorted);
+    for (int i = 0; i < 600; i++) {
+        if (i == 60) {
+            // every other loose cube goes, the last ones move into the holes
+            for (int k = 0; k < 40; k += 2) {
+                plain.remove(100 + k);
+                sorted.remove(100 + k);
+            }
+        }
+        step(plain, plain_poses);
+        step(sorted, sorted_poses);
+    }
+    // the stacks merged into piles, and both worlds are still the same
+    const physics::WorldStats before = plain.stats();
+    assert(before.bodies == 4 + 20);
+    assert(sorted.stats().bodies == before.bodies);
+    for (const auto& p : plain_poses) assert(sorted_poses[p.first] == p.second);
+
+    // a sort right before a step leaves broadphase and narrowphase as they were
+    sorted.set_spatial_sort(1.0f / 60);
+    step(plain, plain_poses);
+    step(sorted, sorted_poses);
+    const physics::WorldStats a = plain.stats(), b = sorted.stats();
+    assert(a.overlapping_pairs == b.overlapping_pairs);
+    assert(a.manifolds == b.manifolds && a.contact_points == b.contact_points);
+    assert(a.bodies == b.bodies && a.islands == b.islands);
+
+    // sorting every step: heavy boxes split the piles, the members carry on
+    // from where they rested
+    const Poses rest = sorted_poses;
+    for (int s = 0; s < 4; s++) {
+        sorted.add_cube(200 + s, at(s * 8.0f - 11, 8, 6), 50, 0.5f, 0.5f, 0.5f);
+    }
+    for (int i = 0; i < 60; i++) {
+        step(sorted, sorted_poses);
+    }
+    assert(sorted.stats().bodies == 36 + 20 + 4);
+    for (int s = 0; s < 4; s++) {
+        for (int k = 0; k < 9; k++) {
+            const ObjectId id = 10 + s * 10 + k;
+            const glm::vec3 then(rest.at(id)[3]), now(sorted_poses[id][3]);
+            assert(glm::length(now - then) < 0.5f && now.y > 1.3f);
+        }
+    }
+
+    // removing bodies out of sorted arrays takes the right ones, the rest
+    // keeps simulating
+    for (int k = 1; k < 40; k += 2) sorted.remove(100 + k);
+    sorted.remove(10);
+    sorted.add_cube(300, at(20, 5, -20), 1, 0.5f, 0.5f, 0.5f);
+    sorted_poses.clear();
+    for (int i = 0; i < 120; i++) {
+        step(sorted, sorted_poses);
+    }
+    assert(sorted.stats().bodies == 36 - 1 + 4 + 1);
+    for (int k = 0; k < 40; k++) assert(!sorted_poses.count(100 + k));
+    assert(!sorted_poses.count(10));
+    assert(std::fabs(sorted_poses[300][3].y - 1.5f) < 0.05f);
+    cout << b.overlapping_pairs << " pairs and " << b.manifolds << " manifolds kept through a sort" << endl;
+}
@@ -0,0 +1,60 @@
+#include "../physics/world.hpp"
+#include "../util/spsc_ring.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <thread>
+
+int main() {
+    // items come out in order across threads, nothing is lost while the
+    // consumer keeps up and nothing blocks when it does not
+    util::SpscRing<int> ring(1000);
+    assert(ring.capacity() == 1024);
+    const int count = 1000000;
+    std::thread producer([&]() {
+        for (int i = 0; i < count; i++) {
+            while (!ring.push(i)) std::this_thread::yield();
+        }
+    });
+    for (int expected = 0; expected < count; expected++) {
+        int value;
+        while (!ring.pop(value)) std::this_thread::yield();
+        assert(value == expected);
+    }
+    producer.join();
+    for (int i = 0; i < 2000; i++) ring.push(i);
+    assert(ring.size() == 1024 && ring.dropped() > 0);
+
+    physics::World phys;
+    phys.add_static_cube(1, glm::mat4(1.0f), 50, 1, 50);
+    phys.add_car(2, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 3.0f, 0.0f)));
+    auto stream = phys.open_telemetry(256);
+    phys.engine(2, true);
+    for (int i = 0; i < 120; i++) {
+        phys.single_step();
+    }
+    physics::VehicleTelemetry t = physics::VehicleTelemetry();
+    int samples = 0;
+    while (stream->pop(t)) {
+        assert(t.vehicle == 2 && t.wheel_count == 4);
+        samples++;
+    }
+    assert(samples == 120);
+    assert(std::fabs(t.speed) > 0.05f);
+    for (int i = 0; i < t.wheel_count; i++) {
+        assert(t.wheels[i].in_contact && t.wheels[i].contact == 0);
+        assert(t.wheels[i].compression > 0);
+        // rolling, not spinning in place
+        assert(t.wheels[i].rpm * t.speed > 0);
+    }
+
+    // wheels are published with the chassis, scaled to wheel size and
+    // resting on the ground
+    auto snapshot = phys.take_snapshot();
+    assert(snapshot.wheels.size() == 1 && snapshot.wheels[2].size() == 4);
+    for (const glm::mat4& wheel : snapshot.wheels[2]) {
+        assert(std::fabs(glm::length(glm::vec3(wheel[0])) - 0.2f) < 1e-3f);
+        assert(std::fabs(glm::length(glm::vec3(wheel[1])) - 1.5f) < 1e-3f);
+        assert(std::fabs(wheel[3].y - 2.5f) < 0.2f);
+    }
+    cout << "car at " << t.speed << " m/s, wheel at " << t.wheels[0].rpm << " rpm" << endl;
+}
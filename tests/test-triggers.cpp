@@ -0,0 +1,85 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+static glm::mat4 at(float x, float y, float z) {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+}
+
+struct Crossing {
+    int enter, exit; // step of the event, -1 if none
+    int first_in, first_out; // first step the box overlaps, first one after it left
+};
+
+/**
+ * Drop a cube of half size 0.5 from height through a trigger at y 4..6, with
+ * no ground below, and note when the events come and when the published
+ * pose crosses the trigger
+ */
+static Crossing drop(physics::Broadphase broadphase, float height, int steps) {
+    physics::World phys(broadphase);
+    phys.add_trigger(2, at(0, 5, 0), 2, 1, 2);
+    phys.add_cube(3, at(0, height, 0), 1, 0.5f, 0.5f, 0.5f);
+    Crossing c = { -1, -1, -1, -1 };
+    for (int step = 0; step < steps; step++) {
+        phys.single_step();
+        physics::Snapshot snapshot = phys.take_snapshot();
+        for (const auto& e : snapshot.trigger_events) {
+            assert(e.trigger == 2 && e.object == 3);
+            int& at_step = e.enter ? c.enter : c.exit;
+            assert(at_step == -1);
+            at_step = step;
+        }
+        auto it = snapshot.changes.find(3);
+        if (it == snapshot.changes.end()) continue;
+        const float y = it->second[3].y;
+        const bool inside = y - 0.5f < 6 && y + 0.5f > 4;
+        if (inside && c.first_in < 0) c.first_in = step;
+        if (!inside && c.first_in >= 0 && c.first_out < 0) c.first_out = step;
+    }
+    return c;
+}
+
+int main() {
+    for (int pass = 0; pass < 2; pass++) {
+        const auto broadphase = pass == 0 ? physics::Broadphase::Tree : physics::Broadphase::HashGrid;
+
+        // falling through slowly, the broadphase finds the pair within a
+        // step and the exit comes on the step the box leaves
+        Crossing slow = drop(broadphase, 12, 120);
+        assert(slow.first_in >= 0 && slow.first_out > slow.first_in + 3);
+        assert(slow.enter >= slow.first_in && slow.enter <= slow.first_in + 1);
+        assert(slow.exit == slow.first_out);
+
+        // fast enough to go from inside to well below in a single step
+        Crossing fast = drop(broadphase, 300, 600);
+        assert(fast.first_in >= 0 && fast.first_out >= 0);
+        assert(fast.enter >= fast.first_in && fast.enter <= fast.first_in + 1);
+        assert(fast.exit == fast.first_out);
+        cout << (pass == 0 ? "tree" : "hash grid") << ": slow cube inside steps "
+            << slow.enter << ".." << slow.exit << ", fast cube " << fast.enter << ".." << fast.exit << endl;
+
+        // a body resting inside exits when it is removed, one sitting on top
+        // stays out and the trigger goes quiet
+        physics::World phys(broadphase);
+        phys.add_static_cube(1, glm::mat4(1.0f), 20, 1, 20);
+        phys.add_trigger(2, at(0, 2, 0), 2, 1, 2);
+        phys.add_cube(3, at(0, 1.5f, 0), 1, 0.5f, 0.5f, 0.5f);
+        phys.add_cube(4, at(6, 1.5f, 0), 1, 0.5f, 0.5f, 0.5f);
+        std::vector<physics::TriggerEvent> events;
+        for (int step = 0; step < 120; step++) {
+            phys.single_step();
+            auto e = phys.take_snapshot().trigger_events;
+            events.insert(events.end(), e.begin(), e.end());
+        }
+        assert(events.size() == 1 && events[0].object == 3 && events[0].enter);
+        phys.remove(3);
+        phys.single_step();
+        events = phys.take_snapshot().trigger_events;
+        assert(events.size() == 1 && events[0].object == 3 && !events[0].enter);
+        for (int step = 0; step < 60; step++) {
+            phys.single_step();
+            assert(phys.take_snapshot().trigger_events.empty());
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#include "../physics/world.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <unordered_map>
+
+typedef std::unordered_map<ObjectId, glm::mat4> Poses;
+
+static void update(physics::World& phys, Poses& poses) {
+    physics::Snapshot snapshot = phys.take_snapshot();
+    for (const auto& c : snapshot.new_cubes) poses[c.id] = c.transform;
+    for (const auto& c : snapshot.changes) poses[c.first] = c.second;
+}
+
+static glm::vec3 position(const glm::mat4& m) {
+    return glm::vec3(m[3]);
+}
+
+/** Largest distance between the hitch of a segment and the front of the next */
+static float hitch_gap(Poses& poses, ObjectId id, int trailers) {
+    float gap = 0;
+    for (int k = 0; k < trailers; k++) {
+        const glm::vec3 hitch = k == 0 ? physics::TRUCK_FIFTH_WHEEL : physics::TRUCK_TRAILER_REAR;
+        const glm::vec3 a = glm::vec3(poses[id + k] * glm::vec4(hitch, 1.0f));
+        const glm::vec3 b = glm::vec3(poses[id + k + 1] * glm::vec4(physics::TRUCK_TRAILER_FRONT, 1.0f));
+        gap = std::max(gap, glm::length(a - b));
+    }
+    return gap;
+}
+
+static glm::mat4 at(float x, float y, float z) {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+}
+
+int main() {
+    // a rig with three trailers over speed bumps and a hill, then coasting
+    // into a turn
+    {
+        const int trailers = 3;
+        physics::World phys;
+        phys.add_static_cube(1, glm::mat4(1.0f), 200, 1, 200);
+        for (int i = 0; i < 6; i++) {
+            phys.add_static_cube(2 + i, at(0, 1, -10.0f + i * 12), 8, 0.15f, 0.6f);
+        }
+        phys.add_static_cube(10, glm::rotate(at(0, 1, 75), -0.08f, glm::vec3(1, 0, 0)), 8, 0.8f, 10);
+        phys.add_static_cube(11, glm::rotate(at(0, 1, 95), 0.08f, glm::vec3(1, 0, 0)), 8, 0.8f, 10);
+        const ObjectId id = 100;
+        phys.add_truck(id, at(0, 2.9f, -40), trailers);
+        phys.engine(id, true);
+        auto telemetry = phys.open_telemetry(16);
+
+        Poses poses;
+        float max_gap = 0, max_speed = 0;
+        int grounded = 0;
+        for (int step = 0; step < 900; step++) {
+            if (step == 600) phys.engine(id, false);
+            if (step == 780) phys.steer(id, 0.08f);
+            phys.single_step();
+            update(phys, poses);
+            max_gap = std::max(max_gap, hitch_gap(poses, id, trailers));
+            physics::VehicleTelemetry t;
+            while (telemetry->pop(t)) {
+                assert(std::isfinite(t.speed) && t.wheel_count == 4);
+                max_speed = std::max(max_speed, std::fabs(t.speed));
+                grounded += t.wheels[2].in_contact && t.wheels[3].in_contact;
+            }
+            for (int k = 0; k <= trailers; k++) {
+                const glm::vec3 p = position(poses[id + k]);
+                assert(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z));
+                assert(p.y > 1 && p.y < 10);
+            }
+        }
+        const glm::mat4& tractor = poses[id];
+        // it drove over everything, stayed upright, turned and held together
+        assert(max_gap < 0.05f);
+        assert(max_speed < 30);
+        assert(position(tractor).z > 105);
+        assert(tractor[1].y > 0.8f);
+        assert(std::fabs(tractor[2].x) > 0.1f);
+        assert(grounded > 800);
+        cout << "rig drove to " << position(tractor).z << " m at up to " << max_speed
+            << " m/s, max hitch gap " << max_gap << " m" << endl;
+    }
+
+    // in the air the engine and steering do nothing
+    {
+        physics::World phys;
+        phys.add_static_cube(1, glm::mat4(1.0f), 50, 1, 50);
+        phys.add_truck(1000, at(0, 40, 0), 1);
+        phys.engine(1000, true);
+        phys.steer(1000, 0.5f);
+        Poses poses;
+        for (int step = 0; step < 60; step++) {
+            phys.single_step();
+            update(phys, poses);
+        }
+        const glm::mat4& tractor = poses[1000];
+        assert(position(tractor).y < 39 && position(tractor).y > 30);
+        assert(std::fabs(position(tractor).x) < 1e-3f && std::fabs(position(tractor).z) < 1e-3f);
+        assert(tractor[2].z > 0.9999f);
+    }
+
+    // neither on its roof, the trailer roof is lower so it drops a little
+    {
+        physics::World phys;
+        phys.add_static_cube(1, glm::mat4(1.0f), 50, 1, 50);
+        const glm::mat4 flipped = glm::rotate(at(0, 3.05f, 0), 3.14159265f, glm::vec3(0, 0, 1));
+        phys.add_truck(2000, flipped, 1);
+        phys.engine(2000, true);
+        phys.steer(2000, 0.5f);
+        Poses poses;
+        for (int step = 0; step < 240; step++) {
+            phys.single_step();
+            update(phys, poses);
+        }
+        const glm::mat4& tractor = poses[2000];
+        assert(tractor[1].y < -0.99f);
+        assert(std::hypot(position(tractor).x, position(tractor).z) < 0.1f);
+    }
+}
@@ -0,0 +1,155 @@
+#include "../physics/vehicles.hpp"
+#include <btBulletDynamicsCommon.h>
+#include <cmath>
+#include <vector>
+
+// Cars updated by the batch end up where btRaycastVehicle takes them. Sums
+// are rounded differently, and driving cars amplify that as much as a
+// micrometer nudge of the start, so results only match to a few cm.
+
+struct Lot {
+    btDbvtBroadphase broadphase;
+    btDefaultCollisionConfiguration config;
+    btCollisionDispatcher dispatcher;
+    btSequentialImpulseConstraintSolver solver;
+    btDiscreteDynamicsWorld world;
+    btBoxShape ground_shape, chassis_shape;
+    btRaycastVehicle::btVehicleTuning tuning;
+    unique_ptr<btRigidBody> ground;
+    std::vector<unique_ptr<btRigidBody>> chassis;
+    std::vector<unique_ptr<btVehicleRaycaster>> raycasters;
+    std::vector<unique_ptr<btRaycastVehicle>> vehicles;
+    physics::VehicleBatch batch;
+
+    Lot(bool batched, int cars, physics::TireType tires = physics::TireType::Stock)
+        : dispatcher(&config), world(&dispatcher, &broadphase, &solver, &config),
+        ground_shape(btVector3(100, 1, 100)), chassis_shape(btVector3(1, 0.5f, 2)) {
+        world.setGravity(btVector3(0, -10, 0));
+        btRigidBody::btRigidBodyConstructionInfo ground_info(0, nullptr, &ground_shape);
+        ground.reset(new btRigidBody(ground_info));
+        world.addRigidBody(ground.get());
+        if (batched) world.addAction(&batch);
+
+        for (int i = 0; i < cars; i++) {
+            btVector3 inertia(0, 0, 0);
+            chassis_shape.calculateLocalInertia(800, inertia);
+            btRigidBody::btRigidBodyConstructionInfo info(800, nullptr, &chassis_shape, inertia);
+            info.m_startWorldTransform = btTransform(btQuaternion(btVector3(0, 1, 0), i),
+                    btVector3(i * 10.0f, 3, 0));
+            chassis.emplace_back(new btRigidBody(info));
+            chassis.back()->setActivationState(DISABLE_DEACTIVATION);
+            world.addRigidBody(chassis.back().get());
+
+            raycasters.emplace_back(new btDefaultVehicleRaycaster(&world));
+            vehicles.emplace_back(new btRaycastVehicle(tuning, chassis.back().get(), raycasters.back().get()));
+            btRaycastVehicle* vehicle = vehicles.back().get();
+            // y up like the rest of the game, and one car the Bullet default way
+            if (i > 0) vehicle->setCoordinateSystem(0, 1, 2);
+            const btVector3 down(0, -1, 0), axle(-1, 0, 0);
+            for (int k = 0; k < 4; k++) {
+                const btVector3 at(k % 2 ? -0.9f : 0.9f, 0.2f, k < 2 ? 1.5f : -1.5f);
+                vehicle->addWheel(at, down, axle, 0.6f, 0.5f, tuning, k < 2);
+                vehicle->getWheelInfo(k).m_rollInfluence = 0.1f;
+            }
+            if (batched) {
+                batch.add(vehicle, tires);
+            } else {
+                world.addAction(vehicle);
+            }
+        }
+    }
+
+    ~Lot() {
+        for (auto& vehicle : vehicles) world.removeAction(vehicle.get());
+        world.removeAction(&batch);
+        for (auto& body : chassis) world.removeRigidBody(body.get());
+        world.removeRigidBody(ground.get());
+    }
+
+    void run(int steps) {
+        for (int step = 0; step < steps; step++) {
+            for (size_t i = 0; i < vehicles.size(); i++) {
+                btRaycastVehicle* vehicle = vehicles[i].get();
+                const bool braking = step > steps / 2 && i % 2 == 0;
+                for (int k = 0; k < 4; k++) {
+                    vehicle->applyEngineForce(braking || k < 2 ? 0 : 400, k);
+                    vehicle->setBrake(braking ? 20 : 0, k);
+                    if (k < 2) vehicle->setSteeringValue(0.2f, k);
+                }
+            }
+            world.stepSimulation(1.0f / 60, 2, 1.0f / 120);
+        }
+    }
+};
+
+int main() {
+    const int cars = 5, steps = 180;
+    Lot single(false, cars), batched(true, cars);
+    single.run(steps);
+    batched.run(steps);
+    assert(batched.batch.size() == cars);
+
+    float difference = 0;
+    for (int i = 0; i < cars; i++) {
+        const btRaycastVehicle* a = single.vehicles[i].get();
+        const btRaycastVehicle* b = batched.vehicles[i].get();
+        const btVector3 pa = a->getRigidBody()->getCenterOfMassPosition();
+        const btVector3 pb = b->getRigidBody()->getCenterOfMassPosition();
+        difference = std::max(difference, float(pa.distance(pb)));
+        assert(pa.distance(btVector3(i * 10.0f, 3, 0)) > 1);
+        assert(std::fabs(a->getCurrentSpeedKmHour() / 3.6f - batched.batch.speed(b)) < 0.01f);
+        for (int k = 0; k < 4; k++) {
+            const btWheelInfo& wa = a->getWheelInfo(k);
+            const btWheelInfo& wb = b->getWheelInfo(k);
+            assert(wb.m_raycastInfo.m_isInContact);
+            assert(std::fabs(wa.m_raycastInfo.m_suspensionLength - wb.m_raycastInfo.m_suspensionLength) < 1e-3f);
+            assert(std::fabs(wa.m_rotation - wb.m_rotation) < 0.05f);
+            assert(std::fabs(wa.m_skidInfo - wb.m_skidInfo) < 1e-3f);
+        }
+    }
+    assert(difference < 0.05f);
+
+    // removed cars are left alone
+    const btVector3 parked = batched.chassis[0]->getCenterOfMassPosition();
+    batched.batch.remove(batched.vehicles[0].get());
+    batched.chassis[0]->setLinearVelocity(btVector3(0, 0, 0));
+    batched.chassis[0]->forceActivationState(DISABLE_SIMULATION);
+    batched.run(10);
+    assert(batched.batch.size() == cars - 1);
+    assert(batched.chassis[0]->getCenterOfMassPosition() == parked);
+
+    // baked tire curves follow the formula
+    for (int t = 0; t < physics::TIRE_TYPES; t++) {
+        auto type = physics::TireType(t);
+        for (float slip = -1; slip <= 1; slip += 0.01f) {
+            const float f = physics::tire_formula(type, std::fabs(slip));
+            assert(std::fabs(physics::tire_force(type, slip) - (slip < 0 ? -f : f)) < 0.02f);
+        }
+    }
+
+    // a car thrown sideways at 8 m/s stops like a sliding box would, quickly
+    // on dry road and hardly at all on ice
+    float drift[2];
+    bool slid[2] = { false, false };
+    const physics::TireType road[2] = { physics::TireType::Dry, physics::TireType::Ice };
+    for (int r = 0; r < 2; r++) {
+        Lot lot(true, 2, road[r]);
+        btRigidBody* body = lot.chassis[1].get();
+        lot.run(40); // settle on the wheels
+        const btVector3 start = body->getCenterOfMassPosition();
+        const btVector3 side = body->getWorldTransform().getBasis().getColumn(0);
+        body->setLinearVelocity(side * 8);
+        for (int step = 0; step < 60; step++) {
+            lot.world.stepSimulation(1.0f / 60, 2, 1.0f / 120);
+            slid[r] = slid[r] || lot.vehicles[1]->getWheelInfo(0).m_skidInfo < 1;
+        }
+        drift[r] = (body->getCenterOfMassPosition() - start).dot(side);
+    }
+    // about v^2 / 2 g mu
+    assert(drift[0] > 3 && drift[0] < 4.5f);
+    assert(drift[1] > 7 && drift[1] < 8);
+    assert(slid[1]);
+
+    cout << cars << " cars within " << difference << " m of btRaycastVehicle, drift "
+        << drift[0] << " m on dry and " << drift[1] << " m on ice" << endl;
+}
@@ -7,4 +7,7 @@ namespace util {
     using namespace std;
 
     string read_file(const char* filename);
+    void write_file(const char* filename, const string& data);
+    /** Create directory and its parents, existing ones are fine */
+    void make_dirs(const char* path);
 }
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace util {
+    /**
+     * Lock-free single producer, single consumer ring buffer
+     *
+     * One thread may push and one other thread may pop, neither ever waits.
+     * When the ring is full, push drops the new item and counts it, so a
+     * stalled consumer cannot slow down the producer.
+     */
+    template <typename T>
+    class SpscRing {
+        // head is written only by the consumer and tail only by the producer,
+        // padding keeps them on separate cache lines
+        struct Index {
+            std::atomic<size_t> value;
+            char padding[64 - sizeof(std::atomic<size_t>)];
+            Index() : value(0) {}
+        };
+
+        std::vector<T> items;
+        size_t mask;
+        Index head;
+        Index tail;
+        std::atomic<size_t> dropped_count;
+
+    public:
+        /** Capacity is rounded up to a power of two */
+        explicit SpscRing(size_t capacity) : dropped_count(0) {
+            size_t size = 2;
+            while (size < capacity) size *= 2;
+            items.resize(size);
+            mask = size - 1;
+        }
+
+        /** Producer side, returns false and drops item when full */
+        bool push(const T& item) {
+            const size_t t = tail.value.load(std::memory_order_relaxed);
+            if (t - head.value.load(std::memory_order_acquire) > mask) {
+                dropped_count.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            items[t & mask] = item;
+            tail.value.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Consumer side, returns false when empty */
+        bool pop(T& out) {
+            const size_t h = head.value.load(std::memory_order_relaxed);
+            if (h == tail.value.load(std::memory_order_acquire)) return false;
+            out = items[h & mask];
+            head.value.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Items pushed but not popped yet, exact only on the consumer side */
+        size_t size() const {
+            return tail.value.load(std::memory_order_acquire) - head.value.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const {
+            return items.size();
+        }
+
+        /** Items dropped because the ring was full */
+        size_t dropped() const {
+            return dropped_count.load(std::memory_order_relaxed);
+        }
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../common.hpp"
+
+namespace util {
+    enum class ThreadPriority {
+        Background, // runs only when no other thread wants the CPU
+        Normal,
+        Realtime // fixed priority above all normal threads, needs privileges
+    };
+
+    /** Where and how a thread gets scheduled */
+    struct ThreadConfig {
+        string name; // shown by top and debuggers, at most 15 characters
+        int cpu; // pin to this CPU, negative keeps the inherited affinity
+        ThreadPriority priority;
+
+        ThreadConfig(const string& name = "", int cpu = -1,
+                ThreadPriority priority = ThreadPriority::Normal)
+            : name(name), cpu(cpu), priority(priority) {}
+    };
+
+    /**
+     * Apply config to the calling thread
+     *
+     * Parts the OS refuses, such as realtime priority without privileges,
+     * are reported to cerr and skipped. Returns false if any part failed.
+     */
+    bool configure_thread(const ThreadConfig& config);
+}
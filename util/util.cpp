@@ -2,11 +2,20 @@
 
 #include "file.hpp"
 #include "task_list.hpp"
+#include "thread.hpp"
 
 #include <fstream>
 #include <sstream>
 #include <thread>
 
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 namespace util {
     string read_file(const char* filename) {
         ifstream ifs(filename, ios::in | ios::binary | ios::ate);
@@ -24,6 +33,87 @@ namespace util {
         return string{bytes.begin(), bytes.end()};
     }
 
+    void write_file(const char* filename, const string& data) {
+        ofstream ofs(filename, ios::out | ios::binary | ios::trunc);
+        ofs.write(data.data(), data.size());
+        if (!ofs.good()) {
+            throw runtime_error(string("Could not write file ") + filename);
+        }
+    }
+
+    void make_dirs(const char* path) {
+        string p(path);
+        for (size_t i = 1; i <= p.size(); i++) {
+            if (i == p.size() || p[i] == '/') {
+                string dir = p.substr(0, i);
+                if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+                    throw runtime_error(string("Could not create directory ") + dir);
+                }
+            }
+        }
+    }
+
+    static bool thread_error(const char* what, int err) {
+        cerr << "Could not set thread " << what << ": " << strerror(err) << endl;
+        return false;
+    }
+
+#ifdef __linux__
+    bool configure_thread(const ThreadConfig& config) {
+        bool ok = true;
+        pthread_t self = pthread_self();
+        int err;
+        if (!config.name.empty()) {
+            err = pthread_setname_np(self, config.name.substr(0, 15).c_str());
+            if (err) ok = thread_error("name", err);
+        }
+
+        if (config.cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(config.cpu, &cpus);
+            err = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+            if (err) ok = thread_error("CPU", err);
+        }
+
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        int policy = SCHED_OTHER;
+        if (config.priority == ThreadPriority::Background) {
+            policy = SCHED_IDLE;
+        } else if (config.priority == ThreadPriority::Realtime) {
+            policy = SCHED_FIFO;
+            param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+        }
+        err = pthread_setschedparam(self, policy, &param);
+        if (err) ok = thread_error("priority", err);
+        return ok;
+    }
+#else
+    bool configure_thread(const ThreadConfig& config) {
+        bool ok = true;
+#ifdef __APPLE__
+        if (!config.name.empty()) {
+            int err = pthread_setname_np(config.name.substr(0, 15).c_str());
+            if (err) ok = thread_error("name", err);
+        }
+#endif
+        // no CPU pinning outside Linux, priorities only map to the normal
+        // policy with its min and max
+        if (config.cpu >= 0) ok = thread_error("CPU", ENOTSUP);
+        if (config.priority != ThreadPriority::Normal) {
+            int policy = SCHED_OTHER;
+            sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = config.priority == ThreadPriority::Realtime
+                ? sched_get_priority_max(policy) : sched_get_priority_min(policy);
+            int err = pthread_setschedparam(pthread_self(), policy, &param);
+            if (err) ok = thread_error("priority", err);
+        }
+        return ok;
+    }
+#endif
+
     void TaskList::add(Task t) {
         std::lock_guard<std::mutex> lock(mutex);
         tasks.push_back(t);